@@ -0,0 +1,105 @@
+#include <cstdio>
+#include <tuple>
+#include <vector>
+
+#include "bucketed_histogram.h"
+#include "tests.h"
+
+using namespace std;
+
+namespace
+{
+    // increments cell count times from as many threads, so wraps race with ordinary increments
+    void increment_cell(BucketedHistogram& histogram, unsigned cell, unsigned count)
+    {
+        auto& dense = histogram.dense;
+        auto& spill_keys = histogram.spill_keys;
+        auto& spill_values = histogram.spill_values;
+        auto& spill_dropped = histogram.spill_dropped;
+        const auto spill_mask = histogram.spill_mask;
+        parallel_for_each(concurrency::extent<1>(int(count)),
+            [=, &dense, &spill_keys, &spill_values, &spill_dropped](concurrency::index<1>) restrict(amp)
+            {
+                BucketedHistogram::increment(dense, spill_keys, spill_values, spill_dropped, spill_mask, cell);
+            }
+        );
+    }
+
+    vector<unsigned> composed(const BucketedHistogram& histogram, tuple<unsigned, unsigned> iteration_range)
+    {
+        auto output = concurrency::array<unsigned, 2>(histogram.get_extent(), warp_view());
+        histogram.compose(iteration_range, output);
+        auto result = vector<unsigned>(histogram.get_extent().size());
+        concurrency::copy(output, result.begin());
+        return result;
+    }
+}
+
+// every escape iteration below max_iterations lands in a bucket whose range holds it, a range starting there takes
+//  only the buckets beginning at or after it, & consecutive buckets tile the iterations without gaps or overlaps,
+//  so ranges starting on an octave split the buckets exactly. a dense counter wrapped twice, next to one wrapped
+//  once in the same word, composes with its spill into the true count
+void test_bucketed_histogram()
+{
+    const auto max_iterations = (1u << 16) + 123;
+    for (unsigned sub_bits = 0; sub_bits <= MAX_BUCKET_SUB_BITS; ++sub_bits)
+    {
+        const auto buckets = EscapeBuckets(max_iterations, sub_bits);
+
+        auto contained = true;
+        auto owned = true;
+        for (unsigned i = 0; i < max_iterations; ++i)
+        {
+            const auto b = buckets.bucket_of(i);
+            const auto range = buckets.range(b);
+            contained = contained && b < buckets.count && get<0>(range) <= i && i < get<1>(range);
+
+            // a range starting part way into a bucket leaves that bucket to the range below
+            const auto first = get<0>(buckets.buckets_in(make_tuple(i, max_iterations)));
+            owned = owned && first == (get<0>(range) < i ? b + 1 : b);
+        }
+        check(contained, "bucketed_histogram: an iteration falls outside its bucket's range");
+        check(owned, "bucketed_histogram: a range takes a bucket whose first iteration lies below it");
+
+        auto tiled = get<0>(buckets.range(0)) == 0;
+        for (unsigned b = 0; b + 1 < buckets.count; ++b) tiled = tiled && get<1>(buckets.range(b)) == get<0>(buckets.range(b + 1));
+        check(tiled, "bucketed_histogram: consecutive bucket ranges leave a gap or overlap");
+
+        auto split = true;
+        for (auto octave = 1u << sub_bits; octave < max_iterations; octave <<= 1)
+        {
+            const auto below = buckets.buckets_in(make_tuple(0u, octave));
+            const auto above = buckets.buckets_in(make_tuple(octave, max_iterations));
+            split = split && get<0>(below) == 0 && get<1>(below) == get<0>(above) && get<1>(above) == buckets.count;
+            split = split && get<1>(buckets.range(get<1>(below) - 1)) == octave && get<0>(buckets.range(get<0>(above))) == octave;
+        }
+        check(split, "bucketed_histogram: a range starting on an octave doesn't split the buckets exactly");
+    }
+
+    BucketedHistogram histogram(warp_view(), concurrency::extent<2>(2, 3), 1000, 2, 64);
+    const auto count = histogram.get_buckets().count;
+    const auto cell = 4 * count + histogram.get_buckets().bucket_of(500);
+    const auto neighbour = cell ^ 1;
+    auto expected = vector<unsigned>(6 * count, 0);
+    expected[cell] = 2 * 65536 + 5;
+    expected[neighbour] = 65536 + 2;
+    increment_cell(histogram, cell, expected[cell]);
+    increment_cell(histogram, neighbour, expected[neighbour]);
+
+    auto composes = histogram.get_spill_dropped() == 0;
+    for (unsigned b = 0; b < count; ++b)
+    {
+        const auto bucket_counts = composed(histogram, histogram.get_buckets().range(b));
+        for (unsigned pixel = 0; pixel < 6; ++pixel) composes = composes && bucket_counts[pixel] == expected[pixel * count + b];
+    }
+    const auto all_counts = composed(histogram, make_tuple(0u, 1000u));
+    for (unsigned pixel = 0; pixel < 6; ++pixel)
+    {
+        auto sum = 0u;
+        for (unsigned b = 0; b < count; ++b) sum += expected[pixel * count + b];
+        composes = composes && all_counts[pixel] == sum;
+    }
+    check(composes, "bucketed_histogram: a wrapped counter & its spill don't compose into the true count");
+
+    printf("bucketed_histogram: sub_bits 0 to %u over %u iterations, & counters wrapped once & twice\n", MAX_BUCKET_SUB_BITS, max_iterations);
+}
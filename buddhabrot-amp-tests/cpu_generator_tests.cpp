@@ -0,0 +1,46 @@
+#include <cstdio>
+
+#include "cpu_generator.h"
+#include "tests.h"
+
+namespace
+{
+    // the inverse of spreading v to the even bit positions
+    unsigned compact_bits(unsigned v)
+    {
+        v &= 0x55555555;
+        v = (v | v >> 1) & 0x33333333;
+        v = (v | v >> 2) & 0x0f0f0f0f;
+        v = (v | v >> 4) & 0x00ff00ff;
+        return v;
+    }
+}
+
+// every cell of the canvas maps into the stored tiles & decodes back to itself, partial edge tiles included
+void test_morton_tile_cell()
+{
+    const auto tile_size = 1u << MORTON_TILE_BITS;
+    const unsigned sizes[][2] = { { 1, 1 }, { 64, 64 }, { 100, 130 }, { 257, 63 } };
+    for (const auto& size : sizes)
+    {
+        const auto tiles_down = (size[0] + tile_size - 1) / tile_size;
+        const auto tiles_across = (size[1] + tile_size - 1) / tile_size;
+        const auto stored = tiles_down * tiles_across * tile_size * tile_size;
+
+        auto round_trips = true;
+        for (unsigned y = 0; y < size[0]; ++y)
+        {
+            for (unsigned x = 0; x < size[1]; ++x)
+            {
+                const auto cell = morton_tile_cell(y, x, tiles_across);
+                const auto tile = cell >> (2 * MORTON_TILE_BITS);
+                const auto within = cell & (tile_size * tile_size - 1);
+                const auto decoded_y = tile / tiles_across * tile_size + compact_bits(within >> 1);
+                const auto decoded_x = tile % tiles_across * tile_size + compact_bits(within);
+                round_trips = round_trips && cell < stored && decoded_y == y && decoded_x == x;
+            }
+        }
+        check(round_trips, "morton_tile_cell: a cell doesn't decode back to its pixel");
+    }
+    printf("morton_tile_cell: %u canvas sizes\n", unsigned(sizeof(sizes) / sizeof(sizes[0])));
+}
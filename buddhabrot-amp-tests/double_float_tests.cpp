@@ -0,0 +1,78 @@
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "double_float.h"
+#include "utilities.h"
+#include "tests.h"
+
+using namespace std;
+
+namespace
+{
+    // the same orbit in doubles on the host
+    Complex<double> host_orbit(double c_r, double c_i, unsigned steps)
+    {
+        auto z_r = 0.0;
+        auto z_i = 0.0;
+        for (unsigned step = 0; step < steps; ++step)
+        {
+            const auto next_r = z_r * z_r - z_i * z_i + c_r;
+            z_i = 2.0 * z_r * z_i + c_i;
+            z_r = next_r;
+        }
+        return Complex<double>(z_r, z_i);
+    }
+}
+
+// DoubleFloat's error terms only survive when every float operation is rounded as written; a shader compiler that
+//  contracts to fma or reassociates loses them without any other sign. orbits followed in DoubleFloat on WARP & in
+//  double on the host, from the same c inside the main cardioid (where they contract onto a fixed point rather than
+//  amplify differences), agree well past float
+void test_double_float()
+{
+    const unsigned ORBITS = 256;
+    const unsigned STEPS = 64;
+    auto points = vector<float>(ORBITS * 4);
+    for (unsigned k = 0; k < ORBITS; ++k)
+    {
+        const auto c = DoubleFloat::two_sum(-0.5f + 0.3f * k / ORBITS, 1.0e-9f * k);
+        const auto d = DoubleFloat::two_sum(0.2f * k / ORBITS, -3.0e-9f * k);
+        points[k * 4 + 0] = c.hi;
+        points[k * 4 + 1] = c.lo;
+        points[k * 4 + 2] = d.hi;
+        points[k * 4 + 3] = d.lo;
+    }
+
+    auto orbits = concurrency::array<float, 2>(concurrency::extent<2>(ORBITS, 4), points.begin(), points.end(), warp_view());
+    parallel_for_each(concurrency::extent<1>(ORBITS),
+        [=, &orbits](concurrency::index<1> idx) restrict(amp)
+        {
+            const auto k = idx[0];
+            const auto c = Complex<DoubleFloat>(DoubleFloat(orbits[concurrency::index<2>(k, 0)], orbits[concurrency::index<2>(k, 1)]), DoubleFloat(orbits[concurrency::index<2>(k, 2)], orbits[concurrency::index<2>(k, 3)]));
+            auto z = Complex<DoubleFloat>(DoubleFloat(0.0f), DoubleFloat(0.0f));
+            for (unsigned step = 0; step < STEPS; ++step) z = c + (z * z);
+            orbits[concurrency::index<2>(k, 0)] = z.r.hi;
+            orbits[concurrency::index<2>(k, 1)] = z.r.lo;
+            orbits[concurrency::index<2>(k, 2)] = z.i.hi;
+            orbits[concurrency::index<2>(k, 3)] = z.i.lo;
+        }
+    );
+    auto results = vector<float>(points.size());
+    concurrency::copy(orbits, results.begin());
+
+    // about 2^-44 per operation; float alone would be off by around 2^-24
+    const auto tolerance = ldexp(1.0, -38);
+    auto agree = true;
+    auto largest = 0.0;
+    for (unsigned k = 0; k < ORBITS; ++k)
+    {
+        const auto z = host_orbit(double(points[k * 4 + 0]) + points[k * 4 + 1], double(points[k * 4 + 2]) + points[k * 4 + 3], STEPS);
+        const auto error = abs(double(results[k * 4 + 0]) + results[k * 4 + 1] - z.r) + abs(double(results[k * 4 + 2]) + results[k * 4 + 3] - z.i);
+        agree = agree && error <= tolerance;
+        largest = !(error <= largest) ? error : largest;
+    }
+    check(agree, "double_float: an orbit on WARP drifts from the host's doubles");
+
+    printf("double_float: %u orbits of %u steps, largest error 2^%.1f\n", ORBITS, STEPS, log2(largest));
+}
@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <climits>
+#include <limits>
+
+#define NOMINMAX
+#include <windows.h>
+
+#include "histogram_file.h"
+#include "tests.h"
+
+using namespace std;
+
+namespace
+{
+    template<typename T> vector<uint8_t> patched(vector<uint8_t> bytes, size_t offset, T value)
+    {
+        memcpy(bytes.data() + offset, &value, sizeof(value));
+        return bytes;
+    }
+
+    bool read_histogram(const wstring& filename, Histogram& histogram)
+    {
+        try
+        {
+            histogram = read_histogram_file(filename);
+            return true;
+        }
+        catch (HRESULT)
+        {
+            return false;
+        }
+    }
+}
+
+// both element types come back with the dimensions, viewport & every channel's range, samples & counts they were
+//  written with. counts stay exact as floats up to 2^24, & the largest count turns into 2^32, which reads back
+//  clamped to it. damaged float cells read as the nearest count or 0, & headers with an unknown type, no pixels,
+//  more pixels than the file holds or a channel offset past the end (including one that wraps when its size is
+//  added) are rejected
+void test_histogram_file()
+{
+    const auto filename = test_filename(L"histogram.bin");
+    const auto extent = concurrency::extent<2>(3, 5);
+    const vector<unsigned> counts[] = {
+        { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14 },
+        { 0, 1000, 65535, 65536, 1 << 24, 0, 0, 0, 0, 0, 0, 0, 0, 0, UINT_MAX },
+        { 7, 7, 7, 7, 7, 0, 0, 0, 0, 0, 1 << 20, 1 << 20, 1 << 20, 1 << 20, 1 << 20 }
+    };
+    const tuple<unsigned, unsigned> ranges[] = { make_tuple(0u, 1024u), make_tuple(20u, 2048u), make_tuple(500u, 100000u) };
+    const unsigned long long samples[] = { 1ull << 40, 12345, 0 };
+
+    auto arrays = vector<concurrency::array<unsigned, 2>>();
+    auto channels = vector<HistogramChannelSource>();
+    for (unsigned c = 0; c < 3; ++c) arrays.emplace_back(extent, counts[c].begin(), counts[c].end(), warp_view());
+    for (unsigned c = 0; c < 3; ++c) channels.push_back({ &arrays[c], ranges[c], samples[c] });
+
+    auto viewport = Viewport();
+    viewport.center_r = -0.743643887037151;
+    viewport.center_i = 0.131825904205330;
+    viewport.span = 1e-6;
+    viewport.rotation = 0.5;
+
+    const HistogramDataType types[] = { HistogramDataType::uint32, HistogramDataType::float32 };
+    for (const auto data_type : types)
+    {
+        write_histogram_file(filename, channels, viewport, data_type);
+
+        auto histogram = Histogram();
+        auto matches = read_histogram(filename, histogram) && histogram.width == 5 && histogram.height == 3 && histogram.flags == 0 && histogram.channels.size() == 3;
+        matches = matches && histogram.viewport.center_r == viewport.center_r && histogram.viewport.center_i == viewport.center_i;
+        matches = matches && histogram.viewport.span == viewport.span && histogram.viewport.rotation == viewport.rotation;
+        for (unsigned c = 0; matches && c < 3; ++c)
+        {
+            const auto& channel = histogram.channels[c];
+            matches = channel.iteration_range == ranges[c] && channel.samples == samples[c] && channel.counts == counts[c];
+        }
+        check(matches, "histogram file: dimensions, viewport, ranges, samples or counts don't round trip");
+    }
+
+    // the float32 file is still on disk: damage the first channel's cells
+    const auto file = read_test_file(filename);
+    const auto first_cell = size_t(HISTOGRAM_FILE_ALIGNMENT);
+    auto damaged = patched(file, first_cell, numeric_limits<float>::quiet_NaN());
+    damaged = patched(damaged, first_cell + 4, -3.0f);
+    damaged = patched(damaged, first_cell + 8, 1e20f);
+    damaged = patched(damaged, first_cell + 12, 2.5f);
+    write_test_file(filename, damaged);
+    auto histogram = Histogram();
+    check(read_histogram(filename, histogram) && histogram.channels[0].counts[0] == 0 && histogram.channels[0].counts[1] == 0 &&
+        histogram.channels[0].counts[2] == UINT_MAX && histogram.channels[0].counts[3] == 3, "histogram file: NaN, negative or huge float cells aren't read as 0, 0 & the largest count");
+
+    const auto second_offset = offsetof(HistogramFileHeader, channels) + sizeof(HistogramFileChannel) + offsetof(HistogramFileChannel, data_offset);
+    write_test_file(filename, patched(file, offsetof(HistogramFileHeader, data_type), uint32_t(2)));
+    check(!read_histogram(filename, histogram), "histogram file: an unknown element type is accepted");
+    write_test_file(filename, patched(file, offsetof(HistogramFileHeader, width), uint32_t(0)));
+    check(!read_histogram(filename, histogram), "histogram file: a width of 0 is accepted");
+    // 2^31 x 2^31 cells of 4 bytes wrap to a channel of 0 bytes
+    write_test_file(filename, patched(patched(file, offsetof(HistogramFileHeader, width), 1u << 31), offsetof(HistogramFileHeader, height), 1u << 31));
+    check(!read_histogram(filename, histogram), "histogram file: channels larger than the file are accepted");
+    write_test_file(filename, patched(file, second_offset, uint64_t(file.size())));
+    check(!read_histogram(filename, histogram), "histogram file: a channel starting at the end of the file is accepted");
+    write_test_file(filename, patched(file, second_offset, numeric_limits<uint64_t>::max() - 8));
+    check(!read_histogram(filename, histogram), "histogram file: a channel offset wrapping past the end is accepted");
+
+    DeleteFileW(filename.c_str());
+    printf("histogram file: 3 channels of %u cells as uint32 & float32\n", unsigned(extent.size()));
+}
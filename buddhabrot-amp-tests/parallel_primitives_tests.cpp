@@ -0,0 +1,68 @@
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "parallel_primitives.h"
+#include "tests.h"
+
+using namespace std;
+
+namespace
+{
+    // std::exclusive_scan is c++17; the projects build as c++14
+    vector<unsigned> exclusive_sums(const vector<unsigned>& values)
+    {
+        auto sums = vector<unsigned>(values.size(), 0);
+        if (values.size() > 1) partial_sum(values.begin(), values.end() - 1, sums.begin() + 1);
+        return sums;
+    }
+
+    vector<unsigned> read_back(const concurrency::array<unsigned, 1>& values, size_t count)
+    {
+        auto result = vector<unsigned>(values.get_extent()[0]);
+        concurrency::copy(values, result.begin());
+        result.resize(count);
+        return result;
+    }
+}
+
+// sizes either side of one tile (256) & of a tile of tile totals (65536), so the tile totals are scanned through one,
+//  two & three levels. compact's count is the last level's total, so flags with none, some & all set check it
+void test_prefix_scan()
+{
+    auto engine = mt19937(11);
+    auto value = uniform_int_distribution<unsigned>(0, 1000);
+    auto flag = bernoulli_distribution(0.3);
+
+    const int sizes[] = { 1, 255, 256, 257, 65535, 65536, 65537 };
+    for (const auto size : sizes)
+    {
+        auto prefix_scan = PrefixScan(size, warp_view());
+
+        auto values = vector<unsigned>(size);
+        for (auto& v : values) v = value(engine);
+        const auto input = concurrency::array<unsigned, 1>(size, values.begin(), values.end(), warp_view());
+        auto output = concurrency::array<unsigned, 1>(size, warp_view());
+        prefix_scan.scan(input, output);
+        check(read_back(output, size) == exclusive_sums(values), "prefix_scan: scan doesn't match an exclusive scan on the host");
+
+        for (unsigned pattern = 0; pattern < 3; ++pattern)
+        {
+            auto flags = vector<unsigned>(size);
+            auto expected = vector<unsigned>();
+            for (int i = 0; i < size; ++i)
+            {
+                flags[i] = pattern == 0 ? 0 : pattern == 2 ? 1 : flag(engine) ? 1 : 0;
+                if (flags[i] != 0) expected.push_back(unsigned(i));
+            }
+
+            const auto flags_array = concurrency::array<unsigned, 1>(size, flags.begin(), flags.end(), warp_view());
+            auto positions = concurrency::array<unsigned, 1>(size, warp_view());
+            const auto count = prefix_scan.compact(flags_array, positions);
+            check(count == expected.size() && read_back(positions, count) == expected, "prefix_scan: compact's count or positions are wrong");
+        }
+    }
+
+    printf("prefix_scan: %u sizes up to %d\n", unsigned(sizeof(sizes) / sizeof(sizes[0])), sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+}
@@ -0,0 +1,85 @@
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "interval.h"
+#include "sample_culling.h"
+#include "tests.h"
+
+using namespace std;
+
+namespace
+{
+    // the escape iteration of c as classify_square counts them, or max_iterations
+    unsigned escape_iteration(double c_r, double c_i, unsigned max_iterations)
+    {
+        auto z_r = 0.0;
+        auto z_i = 0.0;
+        for (unsigned n = 0; n < max_iterations; ++n)
+        {
+            const auto next_r = z_r * z_r - z_i * z_i + c_r;
+            z_i = 2.0 * z_r * z_i + c_i;
+            z_r = next_r;
+            if (z_r * z_r + z_i * z_i >= 4.0) return n;
+        }
+        return max_iterations;
+    }
+}
+
+// interval bounds have to hold the exact results whichever way they round
+void test_interval()
+{
+    // 0.1 + 0.2 isn't representable, so the rounded sum has to lie strictly inside
+    const auto sum = Interval::point(0.1) + Interval::point(0.2);
+    check(sum.lo < 0.1 + 0.2 && sum.hi > 0.1 + 0.2, "Interval: a sum isn't rounded outwards");
+
+    const auto straddling = Interval::outward(-0.5, 0.25).square();
+    check(straddling.lo == 0.0 && straddling.hi >= 0.25, "Interval: the square of an interval holding 0 doesn't start at 0");
+
+    const auto difference = Interval::outward(1.0, 2.0) - Interval::outward(0.5, 3.0);
+    check(difference.lo <= -2.0 && difference.hi >= 1.5, "Interval: a difference doesn't hold every result");
+}
+
+// squares inside the cardioid & bulb are bounded, squares beyond radius 2 escape straight away, & across a grid over
+//  the sample square every decided square agrees with its corners, centre & random points iterated alone
+void test_classify_square()
+{
+    const unsigned first_recorded = 20;
+    const unsigned max_iterations = 200;
+    check(classify_square(-0.2, -0.05, 0.1, first_recorded, max_iterations) == SquareClass::bounded, "classify_square: a square in the cardioid isn't bounded");
+    check(classify_square(-1.05, -0.05, 0.1, first_recorded, max_iterations) == SquareClass::bounded, "classify_square: a square in the period 2 bulb isn't bounded");
+    check(classify_square(1.5, 1.5, 0.25, first_recorded, max_iterations) == SquareClass::escapes, "classify_square: a square beyond radius 2 doesn't escape");
+    check(classify_square(-2.0, -2.0, 4.0, first_recorded, max_iterations) == SquareClass::undecided, "classify_square: the whole sample square is decided");
+
+    auto engine = mt19937(11);
+    auto unit = uniform_real_distribution<double>(0.0, 1.0);
+    const auto grid = 64u;
+    const auto size = 4.0 / grid;
+    unsigned decided[2] = {};
+    for (unsigned y = 0; y < grid; ++y)
+    {
+        for (unsigned x = 0; x < grid; ++x)
+        {
+            const auto r = -2.0 + x * size;
+            const auto i = -2.0 + y * size;
+            const auto kind = classify_square(r, i, size, first_recorded, max_iterations);
+            if (kind == SquareClass::undecided) continue;
+            ++decided[kind == SquareClass::escapes ? 0 : 1];
+
+            auto sound = true;
+            const double offsets[][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 }, { 0.5, 0.5 } };
+            auto points = vector<pair<double, double>>();
+            for (const auto& offset : offsets) points.emplace_back(offset[0], offset[1]);
+            for (unsigned p = 0; p < 16; ++p) points.emplace_back(unit(engine), unit(engine));
+            for (const auto& point : points)
+            {
+                const auto n = escape_iteration(r + point.first * size, i + point.second * size, max_iterations);
+                sound = sound && (kind == SquareClass::escapes ? n < first_recorded : n == max_iterations);
+            }
+            check(sound, kind == SquareClass::escapes ? "classify_square: a point of an escaping square is recorded" : "classify_square: a point of a bounded square escapes");
+        }
+    }
+    check(decided[0] != 0 && decided[1] != 0, "classify_square: the grid decided no escaping or no bounded square");
+    printf("classify_square: %u escaping & %u bounded squares of %u\n", decided[0], decided[1], grid * grid);
+}
@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "scatter_increment.h"
+#include "tests.h"
+
+using namespace std;
+
+namespace
+{
+    // runs both increment paths over cells from counts starting at base & compares them
+    bool scatter_paths_agree(const vector<unsigned>& cells, unsigned cell_count, unsigned base)
+    {
+        auto scalar = vector<unsigned>(cell_count, base);
+        auto avx512 = vector<unsigned>(cell_count, base);
+        scatter_increment_scalar(scalar.data(), cells.data(), cells.size());
+        scatter_increment_avx512(avx512.data(), cells.data(), cells.size());
+        return scalar == avx512;
+    }
+}
+
+// vectors full of repeats are where the conflict folding can go wrong: every lane the same, pairs, chains longer
+//  than one pointer jump, a repeat at the two ends, & random mixes of a few cells with partial tails
+void test_scatter_increment()
+{
+    if (!has_avx512_conflict_detection())
+    {
+        printf("scatter_increment: skipped, no avx-512 F & CD\n");
+        return;
+    }
+
+    const unsigned lanes = 16;
+    auto patterns = vector<vector<unsigned>>();
+    patterns.push_back(vector<unsigned>(lanes, 5));
+    patterns.push_back(vector<unsigned>(lanes * 4 + 3, 0));
+
+    auto pairs = vector<unsigned>();
+    auto alternating = vector<unsigned>();
+    auto ends = vector<unsigned>();
+    auto runs = vector<unsigned>();
+    for (unsigned lane = 0; lane < lanes; ++lane)
+    {
+        pairs.push_back(lane / 2);
+        alternating.push_back(lane & 1);
+        ends.push_back(lane == lanes - 1 ? 0 : lane);
+        runs.push_back(lane < 11 ? 3 : lane);
+    }
+    patterns.push_back(pairs);
+    patterns.push_back(alternating);
+    patterns.push_back(ends);
+    patterns.push_back(runs);
+
+    auto engine = mt19937(7);
+    for (const auto distinct : { 1u, 2u, 3u, 5u, 17u })
+    {
+        auto cell = uniform_int_distribution<unsigned>(0, distinct - 1);
+        for (unsigned length = 0; length <= lanes * 6; ++length)
+        {
+            auto cells = vector<unsigned>(length);
+            for (auto& c : cells) c = cell(engine);
+            patterns.push_back(cells);
+        }
+    }
+
+    for (const auto& cells : patterns)
+    {
+        check(scatter_paths_agree(cells, 32, 0), "scatter_increment: avx-512 & scalar counts differ");
+        check(scatter_paths_agree(cells, 32, 1000), "scatter_increment: avx-512 & scalar counts differ over non zero counts");
+    }
+    printf("scatter_increment: %u index vectors\n", unsigned(patterns.size()));
+}
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <tuple>
+
+#define NOMINMAX
+#include <windows.h>
+
+#include "seed_log.h"
+#include "tests.h"
+
+using namespace std;
+
+namespace
+{
+    // seeds compared bit for bit, so -0 & 0 stay apart
+    tuple<uint32_t, uint32_t, uint32_t> seed_bits(const OrbitSeed& seed)
+    {
+        auto r = uint32_t();
+        auto i = uint32_t();
+        memcpy(&r, &seed.r, sizeof(r));
+        memcpy(&i, &seed.i, sizeof(i));
+        return make_tuple(r, i, seed.escape_iteration);
+    }
+
+    vector<tuple<uint32_t, uint32_t, uint32_t>> sorted_bits(const vector<OrbitSeed>& seeds)
+    {
+        auto bits = vector<tuple<uint32_t, uint32_t, uint32_t>>();
+        for (const auto& seed : seeds) bits.push_back(seed_bits(seed));
+        sort(bits.begin(), bits.end());
+        return bits;
+    }
+
+    // every seed & sample of the log in one list, or false when reading it fails
+    bool read_log(const wstring& filename, vector<OrbitSeed>& seeds, unsigned long long& samples)
+    {
+        seeds.clear();
+        samples = 0;
+        try
+        {
+            const SeedLogReader reader(filename);
+            reader.for_each_batch(1 << 20,
+                [&](const vector<OrbitSeed>& batch, unsigned long long batch_samples)
+                {
+                    seeds.insert(seeds.end(), batch.begin(), batch.end());
+                    samples += batch_samples;
+                }
+            );
+            return true;
+        }
+        catch (HRESULT)
+        {
+            return false;
+        }
+    }
+}
+
+// values either side of zero (signed zeros, denormals, the extremes) have to come back bit for bit through the
+//  ordered encoding & the deltas between them; a block cut short by a killed run is dropped with the samples behind
+//  it, & a block claiming more seeds than its payload can hold is rejected
+void test_seed_log()
+{
+    const auto filename = test_filename(L"seeds.bin");
+    const auto negative_zero = -0.0f;
+    const auto denormal = numeric_limits<float>::denorm_min();
+    const auto first = vector<OrbitSeed>{
+        { 0.0f, negative_zero, 401 }, { negative_zero, 0.0f, 402 }, { -1.5f, 0.25f, 1000 }, { 1.5f, -0.25f, 4095 },
+        { denormal, -denormal, 500 }, { -denormal, denormal, 501 }, { -2.0f, 2.0f, 0xffffffff }, { 2.0f, -2.0f, 0 },
+        { numeric_limits<float>::max(), -numeric_limits<float>::max(), 7 }, { -0.5f, -0.5f, 128 }, { -0.5f, -0.5f, 128 }
+    };
+    const auto second = vector<OrbitSeed>{ { 0.125f, 0.125f, 600 }, { -0.125f, -0.125f, 601 } };
+
+    auto empty_size = size_t();
+    {
+        auto writer = SeedLogWriter(filename, 100, 5000);
+        empty_size = read_test_file(filename).size();
+        auto seeds = first;
+        writer.append(seeds, 1000);
+        seeds = second;
+        writer.append(seeds, 24);
+    }
+
+    auto all = first;
+    all.insert(all.end(), second.begin(), second.end());
+    auto seeds = vector<OrbitSeed>();
+    auto samples = 0ull;
+    check(read_log(filename, seeds, samples) && sorted_bits(seeds) == sorted_bits(all) && samples == 1024, "seed log: seeds or samples don't round trip");
+    check(read_seed_log_range(filename) == make_tuple(100u, 5000u), "seed log: the header's iteration window doesn't round trip");
+
+    // the second block loses its last byte
+    const auto whole = read_test_file(filename);
+    write_test_file(filename, vector<uint8_t>(whole.begin(), whole.end() - 1));
+    check(read_log(filename, seeds, samples) && sorted_bits(seeds) == sorted_bits(first) && samples == 1000, "seed log: a truncated trailing block isn't dropped");
+
+    // the first block's count (the first field of its header, before the payload size) grows past what its payload
+    //  can hold
+    auto inflated = whole;
+    auto count = uint32_t();
+    auto payload_size = uint32_t();
+    memcpy(&count, inflated.data() + empty_size, sizeof(count));
+    memcpy(&payload_size, inflated.data() + empty_size + sizeof(count), sizeof(payload_size));
+    check(count == first.size(), "seed log: the block header isn't where the test expects it");
+    count = payload_size / 6 + 1;
+    memcpy(inflated.data() + empty_size, &count, sizeof(count));
+    write_test_file(filename, inflated);
+    auto rejected = false;
+    try
+    {
+        // rejected on opening, before any seeds are allocated for the block
+        const SeedLogReader reader(filename);
+    }
+    catch (HRESULT)
+    {
+        rejected = true;
+    }
+    check(rejected, "seed log: a block with more seeds than its payload can hold is accepted");
+
+    DeleteFileW(filename.c_str());
+    printf("seed log: %u seeds in 2 blocks\n", unsigned(all.size()));
+}
@@ -0,0 +1,142 @@
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "task_scheduler.h"
+#include "tests.h"
+
+using namespace std;
+
+namespace
+{
+    // every index of [first, last) handed to body exactly once, & nothing outside it
+    bool covers_exactly(TaskScheduler& scheduler, size_t first, size_t last, size_t grain)
+    {
+        auto visits = unique_ptr<atomic<unsigned>[]>(new atomic<unsigned>[last + 1]);
+        for (size_t i = 0; i <= last; ++i) visits[i] = 0;
+
+        atomic<bool> in_bounds{ true };
+        scheduler.parallel_for(first, last, grain,
+            [&](size_t piece_first, size_t piece_last)
+            {
+                if (piece_first < first || piece_last > last || piece_first >= piece_last) in_bounds = false;
+                for (auto i = piece_first; i < piece_last && i <= last; ++i) ++visits[i];
+            }
+        );
+
+        auto exact = in_bounds.load();
+        for (size_t i = 0; i <= last; ++i) exact = exact && visits[i] == (i >= first && i < last ? 1u : 0u);
+        return exact;
+    }
+}
+
+// ranges split at awkward grains (0, 1, odd, larger than the range) are covered exactly once; the first exception a
+//  piece throws comes back out of parallel_for after the other pieces have run; a parallel_for nested inside a
+//  piece completes; a submitted task is left to a worker rather than run by a thread waiting in parallel_for; & a
+//  scheduler being destroyed runs everything still queued first
+void test_task_scheduler()
+{
+    TaskScheduler scheduler(4, false);
+
+    const size_t ranges[][2] = { { 0, 1 }, { 0, 2 }, { 5, 1000 }, { 17, 18 }, { 3, 4099 }, { 10, 10 } };
+    const size_t grains[] = { 0, 1, 3, 7, 64, 1000, 1 << 20 };
+    auto pieces = 0u;
+    for (const auto& range : ranges)
+    {
+        for (const auto grain : grains)
+        {
+            check(covers_exactly(scheduler, range[0], range[1], grain), "task_scheduler: a range isn't covered exactly once");
+            ++pieces;
+        }
+    }
+
+    atomic<unsigned> finished{ 0 };
+    auto caught = false;
+    try
+    {
+        scheduler.parallel_for(0, 1000, 1,
+            [&](size_t first, size_t)
+            {
+                if (first == 500) throw runtime_error("piece 500");
+                ++finished;
+            }
+        );
+    }
+    catch (const runtime_error&)
+    {
+        caught = true;
+    }
+    check(caught && finished == 999, "task_scheduler: an exception from a piece isn't rethrown after the rest have run");
+
+    atomic<unsigned> nested{ 0 };
+    scheduler.parallel_for(0, 16, 1,
+        [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; ++i)
+            {
+                scheduler.parallel_for(0, 1000, 7,
+                    [&](size_t inner_first, size_t inner_last)
+                    {
+                        nested += unsigned(inner_last - inner_first);
+                    }
+                );
+            }
+        }
+    );
+    check(nested == 16 * 1000, "task_scheduler: a nested parallel_for doesn't complete");
+
+    // the only worker is held in one submitted task while another waits behind it & the caller runs a parallel_for
+    auto single = make_unique<TaskScheduler>(1, false);
+    atomic<bool> holding{ false };
+    atomic<bool> release{ false };
+    auto waiting_ran_on = thread::id();
+    single->submit(
+        [&]()
+        {
+            holding = true;
+            while (!release) this_thread::yield();
+        }
+    );
+    while (!holding) this_thread::yield();
+    single->submit(
+        [&]()
+        {
+            waiting_ran_on = this_thread::get_id();
+        }
+    );
+
+    atomic<unsigned> sum{ 0 };
+    single->parallel_for(0, 64, 1,
+        [&](size_t first, size_t)
+        {
+            sum += unsigned(first);
+        }
+    );
+    release = true;
+    check(sum == 64 * 63 / 2, "task_scheduler: a parallel_for with every worker busy doesn't complete");
+
+    // the destructor runs the waiting task on the worker, & joining it publishes what the task wrote
+    single.reset();
+    check(waiting_ran_on != thread::id() && waiting_ran_on != this_thread::get_id(), "task_scheduler: a submitted task was run by a thread waiting in parallel_for");
+
+    atomic<unsigned> drained{ 0 };
+    {
+        TaskScheduler draining(2, false);
+        for (unsigned t = 0; t < 200; ++t)
+        {
+            draining.submit(
+                [&]()
+                {
+                    this_thread::yield();
+                    ++drained;
+                }
+            );
+        }
+    }
+    check(drained == 200, "task_scheduler: destruction doesn't run every queued task");
+
+    printf("task_scheduler: %u ranges & grains, exceptions, nesting, submitted tasks & draining\n", pieces);
+}
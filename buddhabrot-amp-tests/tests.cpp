@@ -0,0 +1,71 @@
+#include <cstdio>
+
+#define NOMINMAX
+#include <windows.h>
+
+#include "utilities.h"
+#include "tests.h"
+
+using namespace std;
+
+namespace
+{
+    unsigned failures = 0;
+}
+
+void check(bool passed, const char* what)
+{
+    if (passed) return;
+    printf("FAILED: %s\n", what);
+    ++failures;
+}
+
+wstring test_filename(const wchar_t* name)
+{
+    wchar_t directory[MAX_PATH + 1];
+    const auto length = GetTempPathW(MAX_PATH + 1, directory);
+    throw_hresult_on_failure(length == 0 ? last_win32_error() : S_OK);
+    return wstring(directory, length) + L"buddhabrot-amp-tests-" + name;
+}
+
+vector<uint8_t> read_test_file(const wstring& filename)
+{
+    const auto file = FileHandle(CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    auto size = LARGE_INTEGER();
+    throw_hresult_on_failure(GetFileSizeEx(file.handle, &size) ? S_OK : last_win32_error());
+
+    auto bytes = vector<uint8_t>(size_t(size.QuadPart));
+    auto read = DWORD(0);
+    throw_hresult_on_failure(ReadFile(file.handle, bytes.data(), DWORD(bytes.size()), &read, nullptr) && read == bytes.size() ? S_OK : last_win32_error());
+    return bytes;
+}
+
+void write_test_file(const wstring& filename, const vector<uint8_t>& bytes)
+{
+    const auto file = FileHandle(CreateFileW(filename.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+    write_file_at(file.handle, 0, bytes.data(), bytes.size());
+}
+
+concurrency::accelerator_view warp_view()
+{
+    static const auto view = concurrency::accelerator(concurrency::accelerator::direct3d_warp).get_default_view();
+    return view;
+}
+
+int main()
+{
+    test_scatter_increment();
+    test_morton_tile_cell();
+    test_interval();
+    test_classify_square();
+    test_seed_log();
+    test_histogram_file();
+    test_task_scheduler();
+    test_prefix_scan();
+    test_bucketed_histogram();
+    test_double_float();
+
+    if (failures == 0) printf("all checks passed\n");
+    else printf("%u checks failed\n", failures);
+    return int(failures);
+}
@@ -0,0 +1,33 @@
+#ifndef _TESTS_H_
+#define _TESTS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <amp.h>
+
+// checks for the pieces that are easy to get subtly wrong & hard to see in a render: each test prints what it
+//  covered & reports failures through check, & the process exits with the number of failed checks
+void check(bool passed, const char* what);
+
+// a path in the temporary directory for a test's files, & whole file reads & writes for building damaged ones
+std::wstring test_filename(const wchar_t* name);
+std::vector<uint8_t> read_test_file(const std::wstring& filename);
+void write_test_file(const std::wstring& filename, const std::vector<uint8_t>& bytes);
+
+// the software rasterizer's accelerator, so kernels are checked the same way whatever gpu the machine has
+concurrency::accelerator_view warp_view();
+
+void test_scatter_increment();
+void test_morton_tile_cell();
+void test_interval();
+void test_classify_square();
+void test_seed_log();
+void test_histogram_file();
+void test_task_scheduler();
+void test_prefix_scan();
+void test_bucketed_histogram();
+void test_double_float();
+
+#endif
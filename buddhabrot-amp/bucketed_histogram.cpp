@@ -0,0 +1,110 @@
+#include <limits>
+
+#include <amp.h>
+
+#include "utilities.h"
+#include "bucketed_histogram.h"
+
+using namespace std;
+
+namespace
+{
+    // spill values count whole wraps of a dense counter
+    const unsigned SPILL_UNIT = 1 << 16;
+
+    unsigned round_up_power_of_two(unsigned value)
+    {
+        auto result = 1u;
+        while (result < value) result <<= 1;
+        return result;
+    }
+
+    // two 16 bit cells per word; cells are addressed with 32 bits in the kernels
+    int dense_words(concurrency::extent<2> dims, const EscapeBuckets& buckets)
+    {
+        const auto cells = unsigned long long(dims.size()) * buckets.count;
+        throw_hresult_on_failure(cells >= numeric_limits<unsigned>::max() || BucketedHistogram::dense_bytes(dims, buckets) > MAX_DENSE_TIER_BYTES ? E_INVALIDARG : S_OK);
+        return static_cast<int>((cells + 1) / 2);
+    }
+
+    concurrency::array<unsigned, 1> filled_array(int size, unsigned value, concurrency::accelerator_view accel_view)
+    {
+        auto result = concurrency::array<unsigned, 1>(size, accel_view);
+        parallel_for_each(result.get_extent(),
+            [=, &result](concurrency::index<1> idx) restrict(amp)
+            {
+                result[idx] = value;
+            }
+        );
+        return result;
+    }
+}
+
+BucketedHistogram::BucketedHistogram(concurrency::accelerator_view accel_view, concurrency::extent<2> dims, unsigned max_iterations, unsigned sub_bits, unsigned spill_capacity) :
+    dims(dims),
+    buckets(max_iterations, sub_bits),
+    dense(filled_array(dense_words(dims, buckets), 0, accel_view)),
+    spill_keys(filled_array(round_up_power_of_two(spill_capacity), EMPTY_KEY, accel_view)),
+    spill_values(filled_array(round_up_power_of_two(spill_capacity), 0, accel_view)),
+    spill_dropped(filled_array(1, 0, accel_view)),
+    spill_mask(round_up_power_of_two(spill_capacity) - 1)
+{
+}
+
+unsigned BucketedHistogram::get_spill_dropped() const
+{
+    auto dropped = 0u;
+    concurrency::copy(spill_dropped, &dropped);
+    return dropped;
+}
+
+void BucketedHistogram::compose(tuple<unsigned, unsigned> iteration_range, concurrency::array<unsigned, 2>& output) const
+{
+    throw_hresult_on_failure(output.get_extent() != dims ? E_INVALIDARG : S_OK);
+
+    const auto bucket_range = buckets.buckets_in(iteration_range);
+    const auto first_bucket = get<0>(bucket_range);
+    const auto last_bucket = get<1>(bucket_range);
+    const auto bucket_count = buckets.count;
+    const auto width = unsigned(dims[1]);
+    const auto empty_key = EMPTY_KEY;
+    const auto& dense_counts = dense;
+    const auto& keys = spill_keys;
+    const auto& values = spill_values;
+
+    parallel_for_each(dims,
+        [=, &dense_counts, &output](concurrency::index<2> idx) restrict(amp)
+        {
+            const auto base = (unsigned(idx[0]) * width + unsigned(idx[1])) * bucket_count;
+            auto sum = 0u;
+            for (auto b = first_bucket; b < last_bucket; ++b)
+            {
+                const auto cell = base + b;
+                sum += (dense_counts[cell >> 1] >> ((cell & 1) * 16)) & 0xffff;
+            }
+            output[idx] = sum;
+        }
+    );
+
+    if (first_bucket >= last_bucket) return;
+
+    // the spill tier is small next to the canvas, so a pass over every slot is cheaper than probing per pixel
+    parallel_for_each(keys.get_extent(),
+        [=, &keys, &values, &output](concurrency::index<1> slot) restrict(amp)
+        {
+            const auto cell = keys[slot];
+            if (cell == empty_key) return;
+
+            const auto b = cell % bucket_count;
+            if (b < first_bucket || b >= last_bucket) return;
+
+            const auto pixel = cell / bucket_count;
+            concurrency::atomic_fetch_add(&output[concurrency::index<2>(pixel / width, pixel % width)], values[slot] * SPILL_UNIT);
+        }
+    );
+}
+
+void BucketedHistogram::compose_bucket(unsigned bucket, concurrency::array<unsigned, 2>& output) const
+{
+    compose(buckets.range(bucket), output);
+}
@@ -0,0 +1,149 @@
+#ifndef _BUCKETED_HISTOGRAM_H_
+#define _BUCKETED_HISTOGRAM_H_
+
+#include <tuple>
+#include <intrin.h>
+
+#include <amp.h>
+
+namespace bucket_math
+{
+    inline unsigned high_bit(unsigned value) restrict(cpu)
+    {
+        unsigned long index = 0;
+        _BitScanReverse(&index, value);
+        return index;
+    }
+
+    inline unsigned high_bit(unsigned value) restrict(amp)
+    {
+        return unsigned(concurrency::direct3d::firstbithigh(int(value)));
+    }
+}
+
+// logarithmic buckets of escape iteration, 2^sub_bits buckets per octave. integer only, so the cpu side ranges
+//  agree exactly with what the kernels record
+struct EscapeBuckets
+{
+    EscapeBuckets(unsigned max_iterations, unsigned sub_bits) : max_iterations(max_iterations), sub_bits(sub_bits), count(bucket_of(max_iterations - 1) + 1)
+    {
+    }
+
+    unsigned bucket_of(unsigned iteration) const restrict(cpu, amp)
+    {
+        if (iteration < (1u << sub_bits)) return iteration;
+        const auto k = bucket_math::high_bit(iteration);
+        return ((k - sub_bits + 1) << sub_bits) + ((iteration >> (k - sub_bits)) & ((1u << sub_bits) - 1));
+    }
+
+    // [first, last) escape iterations that land in bucket
+    std::tuple<unsigned, unsigned> range(unsigned bucket) const
+    {
+        if (bucket < (1u << sub_bits)) return std::make_tuple(bucket, bucket + 1);
+        const auto k = (bucket >> sub_bits) + sub_bits - 1;
+        const auto first = ((1u << sub_bits) + (bucket & ((1u << sub_bits) - 1))) << (k - sub_bits);
+        return std::make_tuple(first, first + (1u << (k - sub_bits)));
+    }
+
+    // buckets [first, last) covering the escape iterations of iteration_range; a bucket belongs to the range its
+    //  first iteration falls in, so ranges on octave boundaries split buckets exactly
+    std::tuple<unsigned, unsigned> buckets_in(std::tuple<unsigned, unsigned> iteration_range) const
+    {
+        const auto first_iteration = std::get<0>(iteration_range);
+        const auto last_iteration = std::get<1>(iteration_range) < max_iterations ? std::get<1>(iteration_range) : max_iterations;
+        if (first_iteration >= last_iteration) return std::make_tuple(0u, 0u);
+
+        auto first = bucket_of(first_iteration);
+        if (std::get<0>(range(first)) < first_iteration) ++first;
+        return std::make_tuple(first, bucket_of(last_iteration - 1) + 1);
+    }
+
+    unsigned max_iterations;
+    unsigned sub_bits;
+    unsigned count;
+};
+
+// sub_bits above this split octaves finer than the escape iterations of short orbits resolve
+const unsigned MAX_BUCKET_SUB_BITS = 3;
+
+// the largest buffer D3D11 lets an accelerator allocate, which the dense tier is one of
+const unsigned long long MAX_DENSE_TIER_BYTES = 2048ull << 20;
+
+// counts per (row, column, escape bucket). a dense tier keeps two 16 bit counters per word; whenever a counter
+//  wraps, 65536 is carried into a sparse spill tier (an open addressed hash on the accelerator) so only the few
+//  bright cells that need 32 bits pay for them
+class BucketedHistogram
+{
+    public:
+        BucketedHistogram(concurrency::accelerator_view, concurrency::extent<2> dimensions, unsigned max_iterations, unsigned sub_bits, unsigned spill_capacity = 1 << 22);
+
+        const EscapeBuckets& get_buckets() const
+        {
+            return buckets;
+        }
+        concurrency::extent<2> get_extent() const
+        {
+            return dims;
+        }
+        // spill inserts that found no free slot; non zero means the spill tier should be bigger
+        unsigned get_spill_dropped() const;
+        // bytes of the dense tier for a histogram of dimensions with buckets, so a caller can check it ahead of
+        //  allocating
+        static unsigned long long dense_bytes(concurrency::extent<2> dimensions, const EscapeBuckets& buckets)
+        {
+            return (unsigned long long(dimensions.size()) * buckets.count + 1) / 2 * sizeof(unsigned);
+        }
+
+        // sums every bucket whose first iteration lies in iteration_range into output (which must match get_extent)
+        void compose(std::tuple<unsigned, unsigned> iteration_range, concurrency::array<unsigned, 2>& output) const;
+        void compose_bucket(unsigned bucket, concurrency::array<unsigned, 2>& output) const;
+
+        // kernel side; cell is (y * width + x) * bucket count + bucket
+        static void increment(concurrency::array<unsigned, 1>& dense, concurrency::array<unsigned, 1>& spill_keys, concurrency::array<unsigned, 1>& spill_values,
+            concurrency::array<unsigned, 1>& spill_dropped, unsigned spill_mask, unsigned cell) restrict(amp)
+        {
+            const auto word = cell >> 1;
+            const auto shift = (cell & 1) * 16;
+
+            // compare exchange rather than add so a wrapping counter never carries into its neighbour
+            auto expected = dense[word];
+            auto wrapped = false;
+            for (;;)
+            {
+                wrapped = ((expected >> shift) & 0xffff) == 0xffff;
+                const auto desired = wrapped ? expected & ~(0xffffu << shift) : expected + (1u << shift);
+                if (concurrency::atomic_compare_exchange(&dense[word], &expected, desired)) break;
+            }
+            if (!wrapped) return;
+
+            auto hash = cell * 2654435761u;
+            hash ^= hash >> 16;
+            for (unsigned probe = 0; probe < 64; ++probe)
+            {
+                const auto slot = (hash + probe) & spill_mask;
+                auto key = EMPTY_KEY;
+                if (concurrency::atomic_compare_exchange(&spill_keys[slot], &key, cell) || key == cell)
+                {
+                    concurrency::atomic_fetch_inc(&spill_values[slot]);
+                    return;
+                }
+            }
+            concurrency::atomic_fetch_inc(&spill_dropped[0]);
+        }
+
+        static const unsigned EMPTY_KEY = 0xffffffff;
+
+    private:
+        const concurrency::extent<2> dims;
+        const EscapeBuckets buckets;
+
+    public:
+        // captured by reference in the recording kernels
+        concurrency::array<unsigned, 1> dense;
+        concurrency::array<unsigned, 1> spill_keys;
+        concurrency::array<unsigned, 1> spill_values;
+        concurrency::array<unsigned, 1> spill_dropped;
+        const unsigned spill_mask;
+};
+
+#endif
@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <chrono>
 #include <vector>
 #include <sstream>
+#include <limits>
+#include <type_traits>
 #include <amp.h>
 #include "tinymt1.1.1/tinymt32.h"
 
@@ -11,76 +14,1399 @@
 
 #include "utilities.h"
 #include "buddhabrot_generator.h"
+#include "bucketed_histogram.h"
+#include "interleaved_histogram.h"
+#include "seed_log.h"
+#include "frontier_file.h"
+#include "parallel_primitives.h"
+#include "orbit_formulas.h"
 
 using namespace std;
 
-BuddhabrotGenerator::BuddhabrotGenerator(concurrency::accelerator_view accel_view, concurrency::extent<2> dims, unsigned points_per_iteration, std::tuple<unsigned, unsigned> iteration_range) :
+namespace
+{
+    // the first points of every orbit are not recorded
+    const unsigned FIRST_RECORDED_ITERATION = 400;
+
+    // number of iterations before c escapes; max_iterations when it does not
+    unsigned escape_iteration(const Complex<float>& c, unsigned max_iterations) restrict(amp)
+    {
+        auto z = Complex<float>(0, 0);
+        for (unsigned i = 0; i < max_iterations; ++i)
+        {
+            z = c + (z * z);
+            if (z.magnitude_squared() >= 4.0) return i;
+        }
+        return max_iterations;
+    }
+
+    // returned by continue_orbit for orbits that can never escape
+    const unsigned NEVER_ESCAPES = 0xffffffff;
+
+    // phases of a segmented orbit slot; a recording orbit stores ORBIT_RECORDING + its escape iteration
+    const unsigned ORBIT_EMPTY = 0xffffffff;
+    const unsigned ORBIT_TESTING = 0;
+    const unsigned ORBIT_RECORDING = 1;
+
+    // record work is ordered by octave of orbit length, longest first
+    const unsigned LENGTH_BUCKETS = 32;
+
+    unsigned length_bucket(unsigned escape_iteration) restrict(amp)
+    {
+        return LENGTH_BUCKETS - 1 - bucket_math::high_bit(escape_iteration);
+    }
+
+    // persistent record workers; enough to fill the accelerator, few enough that each takes several orbits
+    const unsigned RECORD_WORKERS = 1 << 14;
+
+    // bound on the c values streamed to the lanes per call, as a multiple of the lane count
+    const unsigned MAX_STREAM_FACTOR = 64;
+
+    // closed forms for the main cardioid & the period 2 bulb, which hold most of the set's area
+    bool in_cardioid_or_bulb(const Complex<float>& c) restrict(amp)
+    {
+        const auto x = c.r - 0.25f;
+        const auto q = x * x + c.i * c.i;
+        const auto bulb_x = c.r + 1.0f;
+        return q * (q + x) <= 0.25f * c.i * c.i || bulb_x * bulb_x + c.i * c.i <= 0.0625f;
+    }
+
+    // Brent's method: z after iteration i is compared against a point saved at every power of two. float iteration
+    //  is deterministic, so an orbit landing exactly on a saved point repeats forever & can never escape; a near miss
+    //  proves nothing, since orbits can linger by a cycle for a long time & still escape
+    bool revisits(const Complex<float>& z, Complex<float>& saved, unsigned i) restrict(amp)
+    {
+        if (z.r == saved.r && z.i == saved.i) return true;
+        if ((i & (i + 1)) == 0) saved = z;
+        return false;
+    }
+
+    // escape_iteration from z after first iterations, leaving z where the orbit stopped. NEVER_ESCAPES for an orbit
+    //  caught in a cycle, which escape_iteration would have run to max_iterations, so either agrees on what is recorded
+    unsigned continue_orbit(const Complex<float>& c, Complex<float>& z, unsigned first, unsigned max_iterations) restrict(amp)
+    {
+        auto saved = z;
+        for (unsigned i = first; i < max_iterations; ++i)
+        {
+            z = c + (z * z);
+            if (z.magnitude_squared() >= 4.0) return i;
+            if (revisits(z, saved, i)) return NEVER_ESCAPES;
+        }
+        return max_iterations;
+    }
+
+    // transforms are passed by value so the kernels can hold all of them in one capture
+    struct ViewportTransforms
+    {
+        ViewportTransform views[MAX_VIEWPORTS];
+    };
+
+    void park(concurrency::array<float, 2>& parked, concurrency::array<unsigned, 1>& parked_count, const Complex<float>& c, const Complex<float>& z) restrict(amp)
+    {
+        const auto slot = int(concurrency::atomic_fetch_inc(&parked_count[0]));
+        parked[concurrency::index<2>(slot, 0)] = c.r;
+        parked[concurrency::index<2>(slot, 1)] = c.i;
+        parked[concurrency::index<2>(slot, 2)] = z.r;
+        parked[concurrency::index<2>(slot, 3)] = z.i;
+    }
+
+    template<bool Mirror = true, typename T> void splat(concurrency::array<unsigned, 2>& canvas, const ViewportTransform& transform, const Complex<T>& z) restrict(amp)
+    {
+        // the sampled square is symmetric about the real axis, so every orbit's conjugate is an orbit too & gets
+        //  recorded for free
+        auto pixel = concurrency::index<2>();
+        if (transform.to_pixel(z, pixel)) concurrency::atomic_fetch_inc(&canvas[pixel]);
+        if (Mirror && transform.to_pixel(z.conjugate(), pixel)) concurrency::atomic_fetch_inc(&canvas[pixel]);
+    }
+
+    // unused views alias the first canvas; view_count keeps them from being recorded into twice
+    void record_orbit(const Complex<float>& c, unsigned escape_iteration, const ViewportTransforms& transforms, unsigned view_count,
+        concurrency::array<unsigned, 2>& canvas0, concurrency::array<unsigned, 2>& canvas1, concurrency::array<unsigned, 2>& canvas2, concurrency::array<unsigned, 2>& canvas3) restrict(amp)
+    {
+        auto z = Complex<float>(0, 0);
+        for (unsigned j = 0; j < escape_iteration; j++)
+        {
+            z = c + (z * z);
+            if (j >= FIRST_RECORDED_ITERATION)
+            {
+                splat(canvas0, transforms.views[0], z);
+                if (view_count > 1) splat(canvas1, transforms.views[1], z);
+                if (view_count > 2) splat(canvas2, transforms.views[2], z);
+                if (view_count > 3) splat(canvas3, transforms.views[3], z);
+            }
+        }
+    }
+    // the escape test & record passes of iterate(), compiled once per formula, precision, view count & symmetry so
+    //  none of them is decided inside the orbit loops. the iteration bounds stay arguments since they vary per
+    //  channel & run
+    struct EscapePass
+    {
+        const concurrency::array<float, 2>& randoms;
+        concurrency::array<unsigned, 1>& accepted;
+        concurrency::array<unsigned, 1>& escapes;
+        unsigned count;
+        unsigned min_iterations;
+        unsigned max_iterations;
+    };
+
+    struct RecordPass
+    {
+        const concurrency::array<float, 2>& randoms;
+        const concurrency::array<unsigned, 1>& ordered;
+        const concurrency::array<unsigned, 1>& escapes;
+        concurrency::array<unsigned, 1>& cursor;
+        concurrency::array<unsigned, 2>* canvases[MAX_VIEWPORTS];
+        concurrency::array<float, 2>& points;
+        concurrency::array<unsigned, 1>& iterations;
+        ViewportTransforms transforms;
+        unsigned queued;
+        // queued orbits escaping before this were only queued for the seed log
+        unsigned min_iterations;
+        bool record_seeds;
+    };
+
+    template<typename F, typename T> unsigned escape_time(const Complex<T>& c, unsigned max_iterations) restrict(amp)
+    {
+        auto z = Complex<T>(T(0), T(0));
+        for (unsigned i = 0; i < max_iterations; ++i)
+        {
+            z = F::step(z, c);
+            if (z.magnitude_squared() >= T(4)) return i;
+        }
+        return max_iterations;
+    }
+
+    template<typename F, typename T> void escape_kernel(const EscapePass& pass)
+    {
+        auto& randoms = pass.randoms;
+        auto& accepted = pass.accepted;
+        auto& escapes = pass.escapes;
+        const auto min_iterations = pass.min_iterations;
+        const auto max_iterations = pass.max_iterations;
+
+        parallel_for_each(concurrency::extent<1>(pass.count),
+            [=, &randoms, &accepted, &escapes](concurrency::index<1> idx) restrict(amp)
+            {
+                const auto c = Complex<T>(T(randoms[concurrency::index<2>(idx[0], 0)]), T(randoms[concurrency::index<2>(idx[0], 1)]));
+                const auto i = escape_time<F>(c, max_iterations);
+
+                // orbits too short to reach a recorded point are not worth queueing
+                accepted[idx] = i < max_iterations && i >= min_iterations && i > FIRST_RECORDED_ITERATION ? 1 : 0;
+                escapes[idx] = i;
+            }
+        );
+    }
+
+    // views past Views alias the first canvas & are never touched
+    template<typename F, typename T, unsigned Views, bool Mirror> void record_kernel(const RecordPass& pass)
+    {
+        auto& randoms = pass.randoms;
+        auto& ordered = pass.ordered;
+        auto& escapes = pass.escapes;
+        auto& cursor = pass.cursor;
+        auto& canvas0 = *pass.canvases[0];
+        auto& canvas1 = *pass.canvases[1];
+        auto& canvas2 = *pass.canvases[2];
+        auto& canvas3 = *pass.canvases[3];
+        auto& points = pass.points;
+        auto& iterations = pass.iterations;
+        const auto transforms = pass.transforms;
+        const auto queued = pass.queued;
+        const auto min_iterations = pass.min_iterations;
+        const auto record_seeds = pass.record_seeds;
+
+        parallel_for_each(concurrency::extent<1>(min(queued, RECORD_WORKERS)),
+            [=, &randoms, &ordered, &escapes, &cursor, &canvas0, &canvas1, &canvas2, &canvas3, &points, &iterations](concurrency::index<1>) restrict(amp)
+            {
+                for (auto next = concurrency::atomic_fetch_inc(&cursor[0]); next < queued; next = concurrency::atomic_fetch_inc(&cursor[0]))
+                {
+                    const auto sample = int(ordered[next]);
+                    const auto r = randoms[concurrency::index<2>(sample, 0)];
+                    const auto i = randoms[concurrency::index<2>(sample, 1)];
+                    const auto escape = escapes[sample];
+
+                    if (record_seeds)
+                    {
+                        points[concurrency::index<2>(next, 0)] = r;
+                        points[concurrency::index<2>(next, 1)] = i;
+                        iterations[next] = escape;
+                    }
+                    if (escape < min_iterations) continue;
+
+                    const auto c = Complex<T>(T(r), T(i));
+                    auto z = Complex<T>(T(0), T(0));
+                    for (unsigned j = 0; j < escape; ++j)
+                    {
+                        z = F::step(z, c);
+
+                        // a wider type than the escape test's can see the orbit escape sooner, after which there are
+                        //  only points racing off the canvas
+                        if (!std::is_same<T, float>::value && z.magnitude_squared() >= T(4)) break;
+                        if (j < FIRST_RECORDED_ITERATION) continue;
+
+                        splat<Mirror>(canvas0, transforms.views[0], z);
+                        if (Views > 1) splat<Mirror>(canvas1, transforms.views[1], z);
+                        if (Views > 2) splat<Mirror>(canvas2, transforms.views[2], z);
+                        if (Views > 3) splat<Mirror>(canvas3, transforms.views[3], z);
+                    }
+                }
+            }
+        );
+    }
+
+    typedef void (*EscapeKernel)(const EscapePass&);
+    typedef void (*RecordKernel)(const RecordPass&);
+
+    // mirroring is only instantiated for the formulas it is valid for
+    template<typename F, typename T> RecordKernel record_kernel_for(unsigned views, bool mirror)
+    {
+        static_assert(MAX_VIEWPORTS == 4, "one row of record kernels per view count");
+        static const RecordKernel records[MAX_VIEWPORTS][2] =
+        {
+            { record_kernel<F, T, 1, false>, record_kernel<F, T, 1, F::CONJUGATE_SYMMETRIC> },
+            { record_kernel<F, T, 2, false>, record_kernel<F, T, 2, F::CONJUGATE_SYMMETRIC> },
+            { record_kernel<F, T, 3, false>, record_kernel<F, T, 3, F::CONJUGATE_SYMMETRIC> },
+            { record_kernel<F, T, 4, false>, record_kernel<F, T, 4, F::CONJUGATE_SYMMETRIC> }
+        };
+        return records[views - 1][mirror ? 1 : 0];
+    }
+
+    // both indexed by Formula, then Precision; the two stages are picked separately so each can run in its own tier
+    const EscapeKernel ESCAPE_KERNELS[][3] =
+    {
+        { escape_kernel<Mandelbrot, float>, escape_kernel<Mandelbrot, double>, escape_kernel<Mandelbrot, DoubleFloat> },
+        { escape_kernel<Multibrot<3>, float>, escape_kernel<Multibrot<3>, double>, escape_kernel<Multibrot<3>, DoubleFloat> },
+        { escape_kernel<Multibrot<4>, float>, escape_kernel<Multibrot<4>, double>, escape_kernel<Multibrot<4>, DoubleFloat> },
+        { escape_kernel<BurningShip, float>, escape_kernel<BurningShip, double>, escape_kernel<BurningShip, DoubleFloat> }
+    };
+
+    RecordKernel (* const RECORD_KERNELS[][3])(unsigned, bool) =
+    {
+        { record_kernel_for<Mandelbrot, float>, record_kernel_for<Mandelbrot, double>, record_kernel_for<Mandelbrot, DoubleFloat> },
+        { record_kernel_for<Multibrot<3>, float>, record_kernel_for<Multibrot<3>, double>, record_kernel_for<Multibrot<3>, DoubleFloat> },
+        { record_kernel_for<Multibrot<4>, float>, record_kernel_for<Multibrot<4>, double>, record_kernel_for<Multibrot<4>, DoubleFloat> },
+        { record_kernel_for<BurningShip, float>, record_kernel_for<BurningShip, double>, record_kernel_for<BurningShip, DoubleFloat> }
+    };
+
+    // deep zoom: a region's reference orbit point, as float or in full
+    Complex<float> reference_point(const concurrency::array<float, 2>& reference, unsigned point) restrict(amp)
+    {
+        return Complex<float>(reference[concurrency::index<2>(point, 0)], reference[concurrency::index<2>(point, 2)]);
+    }
+
+    Complex<DoubleFloat> wide_reference_point(const concurrency::array<float, 2>& reference, unsigned point) restrict(amp)
+    {
+        return Complex<DoubleFloat>(DoubleFloat(reference[concurrency::index<2>(point, 0)], reference[concurrency::index<2>(point, 1)]),
+            DoubleFloat(reference[concurrency::index<2>(point, 2)], reference[concurrency::index<2>(point, 3)]));
+    }
+
+    // the reference point in the type deltas are iterated in, picked by the (unused) second argument
+    Complex<float> reference_point(const concurrency::array<float, 2>& reference, unsigned point, float) restrict(amp)
+    {
+        return reference_point(reference, point);
+    }
+
+    Complex<DoubleFloat> reference_point(const concurrency::array<float, 2>& reference, unsigned point, DoubleFloat) restrict(amp)
+    {
+        return wide_reference_point(reference, point);
+    }
+
+    Complex<double> reference_point(const concurrency::array<float, 2>& reference, unsigned point, double) restrict(amp)
+    {
+        return Complex<double>(double(reference[concurrency::index<2>(point, 0)]) + reference[concurrency::index<2>(point, 1)],
+            double(reference[concurrency::index<2>(point, 2)]) + reference[concurrency::index<2>(point, 3)]);
+    }
+
+    // one iteration of z^2 + c for z = Z[m] + d & c = C + dc, where Z is the reference orbit of C starting at first:
+    //  d becomes 2 Z[m] d + d^2 + dc, which stays small (& keeps T's relative precision) while the orbit tracks its
+    //  reference. returns the new z, against Z[m + 1]
+    template<typename T> Complex<T> perturb(const concurrency::array<float, 2>& reference, unsigned first, const Complex<T>& dc, Complex<T>& d, unsigned& m) restrict(amp)
+    {
+        const auto z = reference_point(reference, first + m, T(0.0f));
+        d = dc + ((z + z + d) * d);
+        ++m;
+        return reference_point(reference, first + m, T(0.0f)) + d;
+    }
+
+    // perturbation glitches once z passes nearer 0 than its delta is large: Z + d then cancels & the delta no longer
+    //  carries z's precision. z instead becomes the delta against the start of the reference (rebasing), as it does
+    //  when the reference ends (at its escape or the cap) before the orbit does. true when rebased
+    template<typename T> bool rebase(const Complex<T>& z, Complex<T>& d, unsigned& m, unsigned last) restrict(amp)
+    {
+        if (m != last && z.magnitude_squared() >= d.magnitude_squared()) return false;
+        d = z;
+        m = 0;
+        return true;
+    }
+
+    // escape_iteration for a perturbed orbit whose reference starts at first & ends last points later
+    unsigned perturbed_escape_time(const concurrency::array<float, 2>& reference, unsigned first, unsigned last, const Complex<float>& dc, unsigned max_iterations, unsigned& rebases) restrict(amp)
+    {
+        auto d = Complex<float>(0, 0);
+        auto m = 0u;
+        for (unsigned i = 0; i < max_iterations; ++i)
+        {
+            const auto z = perturb(reference, first, dc, d, m);
+            if (z.magnitude_squared() >= 4.0f) return i;
+            if (rebase(z, d, m, last)) ++rebases;
+        }
+        return max_iterations;
+    }
+
+    template<bool Mirror, typename T> void splat(concurrency::array<unsigned, 2>& canvas, const ViewportTransform& transform, const Complex<DoubleFloat>& reference, const Complex<T>& delta) restrict(amp)
+    {
+        auto pixel = concurrency::index<2>();
+        if (transform.to_pixel(reference, delta, pixel)) concurrency::atomic_fetch_inc(&canvas[pixel]);
+        if (Mirror && transform.to_pixel(reference.conjugate(), delta.conjugate(), pixel)) concurrency::atomic_fetch_inc(&canvas[pixel]);
+    }
+
+    // whether z lies in the view's canvas grown by scale about its center; the survey's test for orbits that may
+    //  reach the view
+    bool in_halo(const ViewportTransform& view, const Complex<DoubleFloat>& z, float scale) restrict(amp)
+    {
+        const auto dr = float(z.r - DoubleFloat(view.center_r, view.center_r_low));
+        const auto di = float(z.i - DoubleFloat(view.center_i, view.center_i_low));
+        const auto y = view.row_r * dr + view.row_i * di;
+        const auto x = view.col_r * dr + view.col_i * di;
+        const auto height = view.half_height * scale;
+        const auto width = view.half_width * scale;
+        return y > -height && y < height && x > -width && x < width;
+    }
+
+    // the record pass of deep zoom; reference_ranges holds each region's first reference point & the index of its
+    //  last relative to it
+    struct DeepRecordPass
+    {
+        const concurrency::array<float, 2>& deltas;
+        const concurrency::array<unsigned, 1>& regions;
+        const concurrency::array<unsigned, 2>& ranges;
+        const concurrency::array<float, 2>& reference;
+        const concurrency::array<unsigned, 1>& ordered;
+        const concurrency::array<unsigned, 1>& escapes;
+        concurrency::array<unsigned, 1>& cursor;
+        concurrency::array<unsigned, 2>* canvases[MAX_VIEWPORTS];
+        ViewportTransforms transforms;
+        unsigned queued;
+    };
+
+    // replays the escape test's perturbed iteration with the delta in T, splatting reference & delta rather than
+    //  their sum. the delta only stays small while an orbit tracks its reference; rebasing waits for z to pass
+    //  nearer 0 than the delta, so in between it can grow to the size of z itself, & a float delta that large
+    //  would place points no finer than float does
+    template<typename T, unsigned Views, bool Mirror> void deep_record_kernel(const DeepRecordPass& pass)
+    {
+        auto& deltas = pass.deltas;
+        auto& regions = pass.regions;
+        auto& ranges = pass.ranges;
+        auto& reference = pass.reference;
+        auto& ordered = pass.ordered;
+        auto& escapes = pass.escapes;
+        auto& cursor = pass.cursor;
+        auto& canvas0 = *pass.canvases[0];
+        auto& canvas1 = *pass.canvases[1];
+        auto& canvas2 = *pass.canvases[2];
+        auto& canvas3 = *pass.canvases[3];
+        const auto transforms = pass.transforms;
+        const auto queued = pass.queued;
+
+        parallel_for_each(concurrency::extent<1>(min(queued, RECORD_WORKERS)),
+            [=, &deltas, &regions, &ranges, &reference, &ordered, &escapes, &cursor, &canvas0, &canvas1, &canvas2, &canvas3](concurrency::index<1>) restrict(amp)
+            {
+                for (auto next = concurrency::atomic_fetch_inc(&cursor[0]); next < queued; next = concurrency::atomic_fetch_inc(&cursor[0]))
+                {
+                    const auto sample = int(ordered[next]);
+                    const auto region = int(regions[sample]);
+                    const auto first = ranges[concurrency::index<2>(region, 0)];
+                    const auto last = ranges[concurrency::index<2>(region, 1)];
+                    const auto dc = Complex<T>(T(deltas[concurrency::index<2>(sample, 0)]), T(deltas[concurrency::index<2>(sample, 1)]));
+                    const auto escape = escapes[sample];
+
+                    auto d = Complex<T>(T(0.0f), T(0.0f));
+                    auto m = 0u;
+                    for (unsigned j = 0; j < escape; ++j)
+                    {
+                        const auto z = perturb(reference, first, dc, d, m);
+
+                        // the escape test ran on a float delta, so a wider one can see the orbit leave a little sooner
+                        if (z.magnitude_squared() >= T(4.0f)) break;
+                        if (j >= FIRST_RECORDED_ITERATION)
+                        {
+                            const auto base = wide_reference_point(reference, first + m);
+                            splat<Mirror>(canvas0, transforms.views[0], base, d);
+                            if (Views > 1) splat<Mirror>(canvas1, transforms.views[1], base, d);
+                            if (Views > 2) splat<Mirror>(canvas2, transforms.views[2], base, d);
+                            if (Views > 3) splat<Mirror>(canvas3, transforms.views[3], base, d);
+                        }
+                        rebase(z, d, m, last);
+                    }
+                }
+            }
+        );
+    }
+
+    typedef void (*DeepRecordKernel)(const DeepRecordPass&);
+
+    // deep zoom only runs mandelbrot, which is symmetric; indexed by record Precision, view count & mirroring
+    const DeepRecordKernel DEEP_RECORD_KERNELS[3][MAX_VIEWPORTS][2] =
+    {
+        {
+            { deep_record_kernel<float, 1, false>, deep_record_kernel<float, 1, true> },
+            { deep_record_kernel<float, 2, false>, deep_record_kernel<float, 2, true> },
+            { deep_record_kernel<float, 3, false>, deep_record_kernel<float, 3, true> },
+            { deep_record_kernel<float, 4, false>, deep_record_kernel<float, 4, true> }
+        },
+        {
+            { deep_record_kernel<double, 1, false>, deep_record_kernel<double, 1, true> },
+            { deep_record_kernel<double, 2, false>, deep_record_kernel<double, 2, true> },
+            { deep_record_kernel<double, 3, false>, deep_record_kernel<double, 3, true> },
+            { deep_record_kernel<double, 4, false>, deep_record_kernel<double, 4, true> }
+        },
+        {
+            { deep_record_kernel<DoubleFloat, 1, false>, deep_record_kernel<DoubleFloat, 1, true> },
+            { deep_record_kernel<DoubleFloat, 2, false>, deep_record_kernel<DoubleFloat, 2, true> },
+            { deep_record_kernel<DoubleFloat, 3, false>, deep_record_kernel<DoubleFloat, 3, true> },
+            { deep_record_kernel<DoubleFloat, 4, false>, deep_record_kernel<DoubleFloat, 4, true> }
+        }
+    };
+
+    // the deep zoom survey starts from a grid of regions this many to a side, against a halo this wide around the
+    //  views (orbits leaving it have escaped), which halves at every level
+    const unsigned SURVEY_GRID = 16;
+    const double SURVEY_HALO_SPAN = 4.0;
+
+    // significand bits of each Precision, in declaration order
+    const int PRECISION_BITS[] = { 24, 53, 44 };
+
+    // promotion keeps at least this many representable values across a cell, so points still spread over it
+    //  rather than snapping to a few positions
+    const double MIN_STEPS_PER_CELL = 8.0;
+}
+
+BuddhabrotGenerator::BuddhabrotGenerator(concurrency::accelerator_view accel_view, concurrency::extent<2> dims, unsigned points_per_iteration, std::tuple<unsigned, unsigned> iteration_range,
+    const vector<Viewport>& viewports, float sample_radius) :
     accel_view(accel_view),
     dims(dims),
     points_per_iteration(points_per_iteration),
     iteration_range(iteration_range),
-    count_array(concurrency::array<unsigned, 2>(dims, accel_view))
+    viewports(viewports),
+    sample_radius(sample_radius),
+    seed_points(concurrency::array<float, 2>(concurrency::extent<2>(1, 2), accel_view)),
+    seed_iterations(concurrency::array<unsigned, 1>(1, accel_view)),
+    seed_count(concurrency::array<unsigned, 1>(1, accel_view)),
+    frontier_points(concurrency::array<float, 2>(concurrency::extent<2>(1, 4), accel_view)),
+    frontier_count(concurrency::array<unsigned, 1>(1, accel_view)),
+    orbit_points(concurrency::array<float, 2>(concurrency::extent<2>(1, 4), accel_view)),
+    orbit_counters(concurrency::array<unsigned, 2>(concurrency::extent<2>(1, 2), accel_view)),
+    lane_stats(concurrency::array<unsigned, 1>(3, accel_view)),
+    stream_length(points_per_iteration),
+    cell_corners(concurrency::array<float, 2>(concurrency::extent<2>(1, 2), accel_view)),
+    reference_orbits(concurrency::array<float, 2>(concurrency::extent<2>(1, 4), accel_view)),
+    reference_ranges(concurrency::array<unsigned, 2>(concurrency::extent<2>(1, 2), accel_view)),
+    sample_deltas(concurrency::array<float, 2>(concurrency::extent<2>(1, 2), accel_view)),
+    sample_regions(concurrency::array<unsigned, 1>(1, accel_view)),
+    region_hits(concurrency::array<unsigned, 1>(1, accel_view)),
+    rebase_counters(concurrency::array<unsigned, 1>(2, accel_view)),
+    accepted_flags(concurrency::array<unsigned, 1>(points_per_iteration, accel_view)),
+    escape_iterations(concurrency::array<unsigned, 1>(points_per_iteration, accel_view)),
+    orbit_queue(concurrency::array<unsigned, 1>(points_per_iteration, accel_view)),
+    ordered_queue(concurrency::array<unsigned, 1>(points_per_iteration, accel_view)),
+    length_buckets(concurrency::array<unsigned, 1>(LENGTH_BUCKETS, accel_view)),
+    length_offsets(concurrency::array<unsigned, 1>(LENGTH_BUCKETS, accel_view)),
+    queue_scan(points_per_iteration, accel_view),
+    bucket_scan(LENGTH_BUCKETS, accel_view),
+    record_cursor(concurrency::array<unsigned, 1>(1, accel_view))
 {
+    throw_hresult_on_failure(viewports.empty() || viewports.size() > MAX_VIEWPORTS ? E_INVALIDARG : S_OK);
+
+    for (size_t v = 0; v < viewports.size(); ++v)
+    {
+        viewport_transforms[v] = viewports[v].transform(dims);
+        count_arrays.emplace_back(dims, accel_view);
+    }
+    record_precision = resolve_record_precision();
 }
 
+// two passes: the escape test flags accepted orbits, which are compacted into a dense queue, & only the queue is
+//  recorded. lanes in the record pass all have an orbit to record instead of waiting on the few that do
 const concurrency::array<unsigned, 2>& BuddhabrotGenerator::iterate()
 {
+    if (deep_zoom) return iterate_deep();
+    if (segment_length != 0) return iterate_segments();
+
     auto randoms = generate_random_numbers();
-    auto& recording_array = count_array;
+
+    const auto max_iterations = std::get<1>(iteration_range);
+
+    // a seed log can take orbits from below the generator's own range, which are queued but not recorded
+    const auto min_iterations = seed_log != nullptr ? seed_min_iterations : std::get<0>(iteration_range);
+
+    auto& accepted = accepted_flags;
+    auto& escapes = escape_iterations;
+
+    const auto save_frontier = frontier != nullptr;
+    auto& parked = frontier_points;
+    auto& parked_count = frontier_count;
+    if (save_frontier)
+    {
+        const auto zero = 0u;
+        concurrency::copy(&zero, &zero + 1, parked_count);
+    }
+
+    if (save_frontier)
+    {
+        parallel_for_each(concurrency::extent<1>(points_per_iteration),
+            [=, &randoms, &accepted, &escapes, &parked, &parked_count](concurrency::index<1> idx) restrict(amp)
+            {
+                const auto c = Complex<float>(randoms[concurrency::index<2>(idx[0], 0)], randoms[concurrency::index<2>(idx[0], 1)]);
+
+                // the frontier only keeps orbits a higher cap could still see escape. the closed forms only decide
+                //  parking, so what is recorded matches a run without a frontier
+                auto z = Complex<float>(0, 0);
+                const auto i = continue_orbit(c, z, 0, max_iterations);
+                if (i == max_iterations && !in_cardioid_or_bulb(c)) park(parked, parked_count, c, z);
+
+                accepted[idx] = i < max_iterations && i >= min_iterations && i > FIRST_RECORDED_ITERATION ? 1 : 0;
+                escapes[idx] = i;
+            }
+        );
+    }
+    else
+    {
+        ESCAPE_KERNELS[int(orbit_settings.formula)][int(orbit_settings.escape_precision)]({ randoms, accepted, escapes, points_per_iteration, min_iterations, max_iterations });
+    }
+    precision_counts.tested[int(save_frontier ? Precision::float32 : orbit_settings.escape_precision)] += points_per_iteration;
+
+    const auto queued = queue_scan.compact(accepted_flags, orbit_queue);
+    if (seed_log != nullptr) concurrency::copy(&queued, &queued + 1, seed_count);
+    if (queued != 0) record_queue(randoms, queued);
+    precision_counts.recorded[int(record_precision)] += queued;
+
+    const auto samples = count_samples(points_per_iteration);
+    if (seed_log != nullptr) flush_seeds(samples);
+    if (save_frontier) flush_frontier();
+    return count_arrays[0];
+}
+
+// records the first queued orbits of orbit_queue, which index into randoms & escape_iterations. the queue doubles
+//  as the batch's seeds when a seed log is set
+//
+// record cost is proportional to orbit length, which varies by orders of magnitude, so the queue is first ordered
+//  longest first by octave of length (a counting sort through a prefix scan). a fixed set of workers then takes
+//  orbits from the front through a shared cursor: the longest orbits start first & whichever workers finish early
+//  pick up the short tail, rather than a few long orbits landing last & running alone
+void BuddhabrotGenerator::record_queue(const concurrency::array<float, 2>& randoms, unsigned queued)
+{
+    order_queue(queued);
+
+    const auto view_count = unsigned(viewports.size());
+    auto pass = RecordPass{ randoms, ordered_queue, escape_iterations, record_cursor, {}, seed_points, seed_iterations, ViewportTransforms(), queued, std::get<0>(iteration_range), seed_log != nullptr };
+    for (unsigned v = 0; v < MAX_VIEWPORTS; ++v) pass.canvases[v] = &count_arrays[min(v, view_count - 1)];
+    copy(begin(viewport_transforms), end(viewport_transforms), pass.transforms.views);
+    RECORD_KERNELS[int(orbit_settings.formula)][int(record_precision)](view_count, orbit_settings.symmetry == Symmetry::conjugate)(pass);
+}
+
+// sorts the first queued orbits of orbit_queue into ordered_queue longest first & resets the record cursor
+void BuddhabrotGenerator::order_queue(unsigned queued)
+{
+    auto& queue = orbit_queue;
+    auto& escapes = escape_iterations;
+    auto& ordered = ordered_queue;
+
+    auto& buckets = length_buckets;
+    const unsigned zeros[LENGTH_BUCKETS] = {};
+    concurrency::copy(zeros, zeros + LENGTH_BUCKETS, buckets);
+
+    const auto queue_extent = concurrency::extent<1>(queued);
+    parallel_for_each(queue_extent,
+        [&queue, &escapes, &buckets](concurrency::index<1> idx) restrict(amp)
+        {
+            concurrency::atomic_fetch_inc(&buckets[length_bucket(escapes[queue[idx]])]);
+        }
+    );
+
+    auto& offsets = length_offsets;
+    bucket_scan.scan(length_buckets, offsets);
+    parallel_for_each(queue_extent,
+        [&queue, &escapes, &offsets, &ordered](concurrency::index<1> idx) restrict(amp)
+        {
+            const auto sample = queue[idx];
+            ordered[concurrency::atomic_fetch_inc(&offsets[length_bucket(escapes[sample])])] = sample;
+        }
+    );
+
+    concurrency::copy(zeros, zeros + 1, record_cursor);
+}
+
+void BuddhabrotGenerator::set_orbit_settings(const OrbitSettings& settings)
+{
+    const auto doubles = accel_view.get_accelerator().get_supports_limited_double_precision();
+    throw_hresult_on_failure((settings.escape_precision == Precision::float64 || settings.record_precision == Precision::float64) && !doubles ? E_NOTIMPL : S_OK);
+    orbit_settings = settings;
+    record_precision = resolve_record_precision();
+}
+
+// the first tier, from float up through double_float to float64, that is no narrower than requested & spaces its
+//  values finely enough across the smallest cell of any view, at the magnitude of the points landing there. float64
+//  is skipped on accelerators without doubles; when nothing is fine enough the widest available wins
+Precision BuddhabrotGenerator::promoted_precision(Precision requested) const
+{
+    auto finest_cell = numeric_limits<double>::max();
+    auto magnitude = 0.0;
+    for (const auto& view : viewports)
+    {
+        finest_cell = min(finest_cell, view.span / dims[0]);
+        magnitude = max(magnitude, max(abs(view.center_r), abs(view.center_i)) + view.span);
+    }
+
+    const auto doubles = accel_view.get_accelerator().get_supports_limited_double_precision();
+    auto chosen = requested;
+    for (const auto tier : { Precision::float32, Precision::double_float, Precision::float64 })
+    {
+        if (PRECISION_BITS[int(tier)] < PRECISION_BITS[int(requested)] || (tier == Precision::float64 && !doubles)) continue;
+
+        chosen = tier;
+        if (finest_cell >= MIN_STEPS_PER_CELL * ldexp(magnitude, -PRECISION_BITS[int(tier)])) break;
+    }
+    return chosen;
+}
+
+Precision BuddhabrotGenerator::resolve_record_precision() const
+{
+    return orbit_settings.promote ? promoted_precision(orbit_settings.record_precision) : orbit_settings.record_precision;
+}
+
+// the survey refines the regions level by level. samples spread uniformly over the surviving regions are escape
+//  tested & their orbits followed (in DoubleFloat, so halos finer than float still resolve) to see whether they pass
+//  through a halo about any view. regions none of whose samples did are dropped, the rest are split in four while
+//  they still fit in max_regions, & the halo is halved, until it is the views themselves; a level where no region
+//  is hit ends the refinement with the previous level's regions. regions reaching the views too rarely for the
+//  survey to see are lost, so more survey batches trade setup time for completeness
+void BuddhabrotGenerator::set_deep_zoom(const DeepZoomSettings& settings)
+{
+    throw_hresult_on_failure(orbit_settings.formula != Formula::mandelbrot ? E_NOTIMPL : S_OK);
+    throw_hresult_on_failure(settings.max_regions == 0 || settings.survey_batches == 0 ? E_INVALIDARG : S_OK);
+
+    // sized for whole runs per generator thread, as generate_random_numbers does
+    const auto threads = unsigned(sqrt(points_per_iteration));
+    const auto rows = threads * ((points_per_iteration + threads - 1) / threads);
+    sample_deltas = concurrency::array<float, 2>(concurrency::extent<2>(rows, 2), accel_view);
+    sample_regions = concurrency::array<unsigned, 1>(rows, accel_view);
+    region_hits = concurrency::array<unsigned, 1>(settings.max_regions, accel_view);
+
+    const auto grid = max(1u, min(SURVEY_GRID, unsigned(sqrt(settings.max_regions))));
+    auto size = 2.0 * sample_radius / grid;
+    auto centers = vector<double>();
+    for (unsigned y = 0; y < grid; ++y)
+    {
+        for (unsigned x = 0; x < grid; ++x)
+        {
+            centers.push_back(-sample_radius + (x + 0.5) * size);
+            centers.push_back(-sample_radius + (y + 0.5) * size);
+        }
+    }
+
+    auto finest_span = numeric_limits<double>::max();
+    for (const auto& view : viewports) finest_span = min(finest_span, view.span);
+    auto halo_scale = max(1.0, SURVEY_HALO_SPAN / finest_span);
+
+    while (true)
+    {
+        const auto hits = survey(centers, float(size), float(halo_scale), settings.survey_batches);
+        auto kept = vector<double>();
+        for (size_t region = 0; region < hits.size(); ++region)
+        {
+            if (hits[region] == 0) continue;
+            kept.push_back(centers[region * 2]);
+            kept.push_back(centers[region * 2 + 1]);
+        }
+        if (kept.empty()) break;
+
+        centers.swap(kept);
+        if (halo_scale == 1.0) break;
+
+        halo_scale = max(1.0, halo_scale / 2.0);
+        const auto regions = centers.size() / 2;
+        if (regions * 4 > settings.max_regions) continue;
+
+        auto quarters = vector<double>();
+        quarters.reserve(centers.size() * 4);
+        for (size_t region = 0; region < regions; ++region)
+        {
+            for (unsigned quarter = 0; quarter < 4; ++quarter)
+            {
+                quarters.push_back(centers[region * 2] + ((quarter & 1) ? 0.25 : -0.25) * size);
+                quarters.push_back(centers[region * 2 + 1] + ((quarter & 2) ? 0.25 : -0.25) * size);
+            }
+        }
+        centers.swap(quarters);
+        size /= 2.0;
+    }
+
+    region_centers.swap(centers);
+    region_size = size;
+    sampled_fraction = get_deep_zoom_regions() * region_size * region_size / (4.0 * sample_radius * sample_radius);
+    build_reference_orbits();
+    deep_zoom = true;
+}
+
+void BuddhabrotGenerator::set_sample_culling(const SampleCullingSettings& settings)
+{
+    // orbits escaping before this are never recorded
+    const auto first_recorded = max(std::get<0>(iteration_range), FIRST_RECORDED_ITERATION + 1);
+    const auto& cells = cull_sample_square(sample_radius, first_recorded, std::get<1>(iteration_range), settings);
+
+    // nothing can be recorded at all; sampling is left alone
+    if (cells.cells.empty()) return;
+
+    cell_size = 2.0f * sample_radius / float(1u << cells.depth);
+    auto corners = vector<float>(cells.cells.size() * 2);
+    for (size_t k = 0; k < cells.cells.size(); ++k)
+    {
+        const auto cell = cells.cells[k];
+        corners[k * 2] = -sample_radius + float(cell & ((1u << cells.depth) - 1)) * cell_size;
+        corners[k * 2 + 1] = -sample_radius + float(cell >> cells.depth) * cell_size;
+    }
+    cell_corners = concurrency::array<float, 2>(concurrency::extent<2>(int(cells.cells.size()), 2), corners.begin(), corners.end(), accel_view);
+    sample_cells = &cells;
+    sampled_fraction = cells.kept_fraction();
+}
+
+// samples per region whose orbits, escaping in range, passed through the halo of some view grown by halo_scale
+vector<unsigned> BuddhabrotGenerator::survey(const vector<double>& centers, float size, float halo_scale, unsigned batches)
+{
+    const auto regions = unsigned(centers.size() / 2);
+    auto wide_centers = vector<float>(centers.size() * 2);
+    for (size_t k = 0; k < centers.size(); ++k)
+    {
+        wide_centers[k * 2] = float(centers[k]);
+        wide_centers[k * 2 + 1] = float(centers[k] - wide_centers[k * 2]);
+    }
+    auto origins = concurrency::array<float, 2>(concurrency::extent<2>(regions, 4), wide_centers.begin(), wide_centers.end(), accel_view);
+
+    auto& hits = region_hits;
+    const auto zeros = vector<unsigned>(regions);
+    concurrency::copy(zeros.begin(), zeros.end(), hits.section(0, int(regions)));
+
+    const auto view_count = unsigned(viewports.size());
+    const auto mirror = orbit_settings.symmetry == Symmetry::conjugate;
+    const auto min_iterations = std::get<0>(iteration_range);
+    const auto max_iterations = std::get<1>(iteration_range);
+    auto transforms = ViewportTransforms();
+    copy(begin(viewport_transforms), end(viewport_transforms), transforms.views);
+
+    auto& deltas = sample_deltas;
+    auto& owners = sample_regions;
+    for (unsigned batch = 0; batch < batches; ++batch)
+    {
+        generate_region_samples(regions, size);
+        parallel_for_each(concurrency::extent<1>(points_per_iteration),
+            [=, &deltas, &owners, &origins, &hits](concurrency::index<1> idx) restrict(amp)
+            {
+                const auto region = int(owners[idx]);
+                const auto c = Complex<DoubleFloat>(
+                    DoubleFloat(origins[concurrency::index<2>(region, 0)], origins[concurrency::index<2>(region, 1)]) + DoubleFloat(deltas[concurrency::index<2>(idx[0], 0)]),
+                    DoubleFloat(origins[concurrency::index<2>(region, 2)], origins[concurrency::index<2>(region, 3)]) + DoubleFloat(deltas[concurrency::index<2>(idx[0], 1)]));
+
+                const auto i = escape_time<Mandelbrot>(c, max_iterations);
+                if (i >= max_iterations || i < min_iterations || i <= FIRST_RECORDED_ITERATION) return;
+
+                auto z = Complex<DoubleFloat>(DoubleFloat(0.0f), DoubleFloat(0.0f));
+                for (unsigned j = 0; j < i; ++j)
+                {
+                    z = Mandelbrot::step(z, c);
+                    if (j < FIRST_RECORDED_ITERATION) continue;
+
+                    for (unsigned v = 0; v < view_count; ++v)
+                    {
+                        if (in_halo(transforms.views[v], z, halo_scale) || (mirror && in_halo(transforms.views[v], z.conjugate(), halo_scale)))
+                        {
+                            concurrency::atomic_fetch_inc(&hits[region]);
+                            return;
+                        }
+                    }
+                }
+            }
+        );
+    }
+
+    auto counts = vector<unsigned>(regions);
+    concurrency::copy(hits.section(0, int(regions)), counts.begin());
+    return counts;
+}
+
+// a reference orbit through every region's center, iterated in double on the cpu up to the cap or the first point
+//  past escaping, & stored as DoubleFloat pairs
+void BuddhabrotGenerator::build_reference_orbits()
+{
+    const auto max_iterations = std::get<1>(iteration_range);
+    const auto regions = unsigned(region_centers.size() / 2);
+
+    auto points = vector<float>();
+    auto ranges = vector<unsigned>();
+    auto store = [&points](double r, double i)
+    {
+        const auto r_hi = float(r);
+        const auto i_hi = float(i);
+        points.insert(points.end(), { r_hi, float(r - r_hi), i_hi, float(i - i_hi) });
+    };
+
+    for (unsigned region = 0; region < regions; ++region)
+    {
+        const auto first = unsigned(points.size() / 4);
+        const auto cr = region_centers[region * 2];
+        const auto ci = region_centers[region * 2 + 1];
+
+        auto zr = 0.0;
+        auto zi = 0.0;
+        store(zr, zi);
+        for (unsigned n = 0; n < max_iterations && zr * zr + zi * zi < 4.0; ++n)
+        {
+            const auto r = zr * zr - zi * zi + cr;
+            zi = 2.0 * zr * zi + ci;
+            zr = r;
+            store(zr, zi);
+        }
+
+        ranges.push_back(first);
+        ranges.push_back(unsigned(points.size() / 4) - 1 - first);
+    }
+
+    reference_orbits = concurrency::array<float, 2>(concurrency::extent<2>(int(points.size() / 4), 4), points.begin(), points.end(), accel_view);
+    reference_ranges = concurrency::array<unsigned, 2>(concurrency::extent<2>(int(regions), 2), ranges.begin(), ranges.end(), accel_view);
+}
+
+// every call samples points_per_iteration initial points spread uniformly over the surveyed regions. each is
+//  c = C + dc for its region's center C, & its orbit is iterated as the delta from C's reference orbit: in float
+//  for the escape test & in the record tier (promoted for the views' scale, as in iterate()) for the record pass,
+//  so recorded points keep that tier's precision however far the delta has grown. accepted orbits go through the
+//  same queue & longest first ordering as iterate()
+const concurrency::array<unsigned, 2>& BuddhabrotGenerator::iterate_deep()
+{
+    generate_region_samples(get_deep_zoom_regions(), float(region_size));
+
+    const auto min_iterations = std::get<0>(iteration_range);
+    const auto max_iterations = std::get<1>(iteration_range);
+
+    auto& deltas = sample_deltas;
+    auto& owners = sample_regions;
+    auto& ranges = reference_ranges;
+    auto& reference = reference_orbits;
+    auto& accepted = accepted_flags;
+    auto& escapes = escape_iterations;
+
+    // low & high words of the rebases, as with the lane counters
+    auto& rebases = rebase_counters;
+    const unsigned zeros[2] = {};
+    concurrency::copy(zeros, zeros + 2, rebases);
+
+    parallel_for_each(concurrency::extent<1>(points_per_iteration),
+        [=, &deltas, &owners, &ranges, &reference, &accepted, &escapes, &rebases](concurrency::index<1> idx) restrict(amp)
+        {
+            const auto region = int(owners[idx]);
+            const auto dc = Complex<float>(deltas[concurrency::index<2>(idx[0], 0)], deltas[concurrency::index<2>(idx[0], 1)]);
+
+            auto rebased = 0u;
+            const auto i = perturbed_escape_time(reference, ranges[concurrency::index<2>(region, 0)], ranges[concurrency::index<2>(region, 1)], dc, max_iterations, rebased);
+
+            accepted[idx] = i < max_iterations && i >= min_iterations && i > FIRST_RECORDED_ITERATION ? 1 : 0;
+            escapes[idx] = i;
+
+            if (rebased == 0) return;
+            const auto low = concurrency::atomic_fetch_add(&rebases[0], rebased);
+            if (low + rebased < low) concurrency::atomic_fetch_inc(&rebases[1]);
+        }
+    );
+
+    unsigned counts[2] = {};
+    concurrency::copy(rebases, counts);
+    rebase_count += (unsigned long long(counts[1]) << 32) | counts[0];
+
+    const auto queued = queue_scan.compact(accepted_flags, orbit_queue);
+    if (queued != 0)
+    {
+        order_queue(queued);
+
+        const auto view_count = unsigned(viewports.size());
+        auto pass = DeepRecordPass{ deltas, owners, ranges, reference, ordered_queue, escapes, record_cursor, {}, ViewportTransforms(), queued };
+        for (unsigned v = 0; v < MAX_VIEWPORTS; ++v) pass.canvases[v] = &count_arrays[min(v, view_count - 1)];
+        copy(begin(viewport_transforms), end(viewport_transforms), pass.transforms.views);
+        DEEP_RECORD_KERNELS[int(record_precision)][view_count - 1][orbit_settings.symmetry == Symmetry::conjugate ? 1 : 0](pass);
+    }
+    precision_counts.recorded[int(record_precision)] += queued;
+
+    count_samples(points_per_iteration);
+    return count_arrays[0];
+}
+
+void BuddhabrotGenerator::set_segment_length(unsigned length)
+{
+    segment_length = length;
+    if (segment_length == 0 || orbit_counters.get_extent()[0] >= int(points_per_iteration)) return;
+
+    orbit_points = concurrency::array<float, 2>(concurrency::extent<2>(points_per_iteration, 6), accel_view);
+    orbit_counters = concurrency::array<unsigned, 2>(concurrency::extent<2>(points_per_iteration, 2), accel_view);
+
+    auto& counters = orbit_counters;
+    parallel_for_each(concurrency::extent<1>(points_per_iteration),
+        [&counters](concurrency::index<1> idx) restrict(amp)
+        {
+            counters[concurrency::index<2>(idx[0], 0)] = 0;
+            counters[concurrency::index<2>(idx[0], 1)] = ORBIT_EMPTY;
+        }
+    );
+}
+
+// each slot (a lane) holds one orbit: c, z & the point its cycle test saved last in orbit_points, the iterations done in its current phase & its phase
+//  in orbit_counters. a lane spends at most segment_length iterations per call, escape testing & then (for orbits
+//  escaping in range) recording, & picks up where it stopped on the next call. a lane whose orbit finishes or is
+//  rejected pulls the next c from a shared stream straight away rather than idling for the rest of the segment
+const concurrency::array<unsigned, 2>& BuddhabrotGenerator::iterate_segments()
+{
+    auto stream = generate_random_numbers(stream_length);
+    const auto stream_size = unsigned(stream.get_extent()[0]);
+
+    // the orbits in flight from earlier calls & every one started from the stream can each finish in this call
+    reserve_slots(points_per_iteration + stream_size);
+
+    const auto view_count = unsigned(viewports.size());
+    auto& canvas0 = count_arrays[0];
+    auto& canvas1 = count_arrays[min(1u, view_count - 1)];
+    auto& canvas2 = count_arrays[min(2u, view_count - 1)];
+    auto& canvas3 = count_arrays[min(3u, view_count - 1)];
 
     const auto min_iterations = std::get<0>(iteration_range);
     const auto max_iterations = std::get<1>(iteration_range);
+    const auto budget = segment_length;
+    auto transforms = ViewportTransforms();
+    copy(begin(viewport_transforms), end(viewport_transforms), transforms.views);
+
+    // [0] is the stream cursor, [1] & [2] the low & high words of the busy lane iterations
+    auto& orbits = orbit_points;
+    auto& counters = orbit_counters;
+    auto& lane_counters = lane_stats;
+    const unsigned zeros[3] = {};
+    concurrency::copy(zeros, zeros + 3, lane_counters);
+
+    const auto zero = 0u;
+    const auto record_seeds = seed_log != nullptr;
+    const auto seed_min = seed_min_iterations;
+    auto& points = seed_points;
+    auto& iterations = seed_iterations;
+    auto& count = seed_count;
+    if (record_seeds) concurrency::copy(&zero, &zero + 1, count);
+
+    const auto save_frontier = frontier != nullptr;
+    auto& parked = frontier_points;
+    auto& parked_count = frontier_count;
+    if (save_frontier) concurrency::copy(&zero, &zero + 1, parked_count);
 
     parallel_for_each(concurrency::extent<1>(points_per_iteration),
-        [=, &randoms, &recording_array](concurrency::index<1> idx) restrict(amp)
+        [=, &stream, &orbits, &counters, &lane_counters, &canvas0, &canvas1, &canvas2, &canvas3, &points, &iterations, &count, &parked, &parked_count](concurrency::index<1> idx) restrict(amp)
+        {
+            const auto slot = idx[0];
+            auto phase = counters[concurrency::index<2>(slot, 1)];
+            auto done = counters[concurrency::index<2>(slot, 0)];
+            auto c = Complex<float>(orbits[concurrency::index<2>(slot, 0)], orbits[concurrency::index<2>(slot, 1)]);
+            auto z = Complex<float>(orbits[concurrency::index<2>(slot, 2)], orbits[concurrency::index<2>(slot, 3)]);
+            auto saved = Complex<float>(orbits[concurrency::index<2>(slot, 4)], orbits[concurrency::index<2>(slot, 5)]);
+
+            auto remaining = budget;
+            while (remaining != 0)
+            {
+                if (phase == ORBIT_EMPTY)
+                {
+                    // an exhausted stream leaves the lane idle for the rest of the call
+                    const auto next = concurrency::atomic_fetch_inc(&lane_counters[0]);
+                    if (next >= stream_size) break;
+
+                    c = Complex<float>(stream[concurrency::index<2>(next, 0)], stream[concurrency::index<2>(next, 1)]);
+                    z = Complex<float>(0, 0);
+                    saved = z;
+                    done = 0;
+                    phase = ORBIT_TESTING;
+                }
+
+                --remaining;
+                z = c + (z * z);
+                if (phase == ORBIT_TESTING)
+                {
+                    if (z.magnitude_squared() >= 4.0)
+                    {
+                        // done is the escape iteration; only orbits long enough to reach a recorded point go on to
+                        //  replay from the start & splat, the rest free the lane at once. the seed log's window can
+                        //  start below the generator's range
+                        const auto splats = done >= min_iterations && done > FIRST_RECORDED_ITERATION;
+                        phase = splats ? ORBIT_RECORDING + done : ORBIT_EMPTY;
+                        if (record_seeds && done >= seed_min && done > FIRST_RECORDED_ITERATION)
+                        {
+                            const auto seed = int(concurrency::atomic_fetch_inc(&count[0]));
+                            points[concurrency::index<2>(seed, 0)] = c.r;
+                            points[concurrency::index<2>(seed, 1)] = c.i;
+                            iterations[seed] = done;
+                        }
+                        done = 0;
+                        z = Complex<float>(0, 0);
+                    }
+                    else if (revisits(z, saved, done))
+                    {
+                        // caught in a cycle, as continue_orbit would find; never recorded or parked
+                        phase = ORBIT_EMPTY;
+                    }
+                    else if (++done == max_iterations)
+                    {
+                        if (save_frontier && !in_cardioid_or_bulb(c)) park(parked, parked_count, c, z);
+                        phase = ORBIT_EMPTY;
+                    }
+                }
+                else
+                {
+                    if (done >= FIRST_RECORDED_ITERATION)
+                    {
+                        splat(canvas0, transforms.views[0], z);
+                        if (view_count > 1) splat(canvas1, transforms.views[1], z);
+                        if (view_count > 2) splat(canvas2, transforms.views[2], z);
+                        if (view_count > 3) splat(canvas3, transforms.views[3], z);
+                    }
+                    if (++done == phase - ORBIT_RECORDING) phase = ORBIT_EMPTY;
+                }
+            }
+
+            // a 64 bit sum from 32 bit atomics; only the add that wraps the low word carries
+            const auto busy = budget - remaining;
+            const auto low = concurrency::atomic_fetch_add(&lane_counters[1], busy);
+            if (low + busy < low) concurrency::atomic_fetch_inc(&lane_counters[2]);
+
+            counters[concurrency::index<2>(slot, 0)] = done;
+            counters[concurrency::index<2>(slot, 1)] = phase;
+            orbits[concurrency::index<2>(slot, 0)] = c.r;
+            orbits[concurrency::index<2>(slot, 1)] = c.i;
+            orbits[concurrency::index<2>(slot, 2)] = z.r;
+            orbits[concurrency::index<2>(slot, 3)] = z.i;
+            orbits[concurrency::index<2>(slot, 4)] = saved.r;
+            orbits[concurrency::index<2>(slot, 5)] = saved.i;
+        }
+    );
+
+    unsigned stats[3] = {};
+    concurrency::copy(lane_counters, stats);
+
+    // a sample counts from the call that starts its orbit
+    const auto started = min(stats[0], stream_size);
+    const auto samples = count_samples(started);
+    busy_lane_iterations += (unsigned long long(stats[2]) << 32) | stats[1];
+    lane_iterations += unsigned long long(points_per_iteration) * budget;
+
+    // size the next stream from this one's use: grow quickly when lanes went idle, shrink slowly when it was mostly
+    //  left over
+    if (stats[0] >= stream_size) stream_length = min(stream_length * 2, points_per_iteration * MAX_STREAM_FACTOR);
+    else if (started < stream_size / 2) stream_length = max(points_per_iteration, stream_length - stream_length / 4);
+
+    if (record_seeds) flush_seeds(samples);
+    if (save_frontier) flush_frontier();
+    return count_arrays[0];
+}
+
+void BuddhabrotGenerator::set_seed_log(SeedLogWriter* log, unsigned min_iterations)
+{
+    throw_hresult_on_failure(log != nullptr && min_iterations > std::get<0>(iteration_range) ? E_INVALIDARG : S_OK);
+    seed_log = log;
+    seed_min_iterations = min_iterations;
+    reserve_slots(points_per_iteration);
+}
+
+// grows the seed & frontier buffers that are in use to hold slots entries. a call writes at most one of each per
+//  orbit it finishes, which is points_per_iteration for iterate() & deepen() but also every orbit pulled from the
+//  stream for iterate_segments()
+void BuddhabrotGenerator::reserve_slots(unsigned slots)
+{
+    if (seed_log != nullptr && seed_iterations.get_extent()[0] < int(slots))
+    {
+        seed_points = concurrency::array<float, 2>(concurrency::extent<2>(slots, 2), accel_view);
+        seed_iterations = concurrency::array<unsigned, 1>(slots, accel_view);
+    }
+    if (frontier != nullptr && frontier_points.get_extent()[0] < int(slots))
+    {
+        frontier_points = concurrency::array<float, 2>(concurrency::extent<2>(slots, 4), accel_view);
+    }
+}
+
+// adds drawn initial points to samples_taken as whole square equivalents & returns how many that added. the
+//  fractions left over are carried to the next call so they add up over a render
+unsigned long long BuddhabrotGenerator::count_samples(unsigned long long drawn)
+{
+    const auto equivalent = double(drawn) / sampled_fraction + sample_remainder;
+    const auto whole = floor(equivalent);
+    sample_remainder = equivalent - whole;
+    samples_taken += unsigned long long(whole);
+    return unsigned long long(whole);
+}
+
+void BuddhabrotGenerator::flush_seeds(unsigned long long samples)
+{
+    auto count = 0u;
+    concurrency::copy(seed_count, &count);
+
+    auto seeds = vector<OrbitSeed>(count);
+    if (count != 0)
+    {
+        auto points = vector<float>(size_t(count) * 2);
+        auto iterations = vector<unsigned>(count);
+        concurrency::copy(seed_points.section(concurrency::index<2>(0, 0), concurrency::extent<2>(count, 2)), points.begin());
+        concurrency::copy(seed_iterations.section(0, count), iterations.begin());
+        for (unsigned s = 0; s < count; ++s)
+        {
+            seeds[s] = { points[s * 2], points[s * 2 + 1], iterations[s] };
+        }
+    }
+
+    // every drawn sample counts, even in a batch where nothing was kept
+    seed_log->append(seeds, samples);
+}
+
+void BuddhabrotGenerator::set_frontier(FrontierWriter* writer)
+{
+    frontier = writer;
+    reserve_slots(points_per_iteration);
+}
+
+void BuddhabrotGenerator::flush_frontier()
+{
+    auto count = 0u;
+    concurrency::copy(frontier_count, &count);
+    if (count == 0) return;
+
+    auto points = vector<FrontierPoint>(count);
+    concurrency::copy(frontier_points.section(concurrency::index<2>(0, 0), concurrency::extent<2>(count, 4)), reinterpret_cast<float*>(points.data()));
+    frontier->append(points);
+}
+
+void BuddhabrotGenerator::load_counts(const vector<unsigned>& counts, unsigned long long samples)
+{
+    throw_hresult_on_failure(counts.size() != dims.size() ? E_INVALIDARG : S_OK);
+
+    concurrency::copy(counts.begin(), counts.end(), count_arrays[0]);
+    samples_taken = samples;
+}
+
+void BuddhabrotGenerator::deepen(const FrontierPoint* points, size_t count, unsigned parked_iterations)
+{
+    if (count == 0) return;
+    throw_hresult_on_failure(count > points_per_iteration ? E_INVALIDARG : S_OK);
+
+    const auto point_extent = concurrency::extent<1>(int(count));
+    const auto* first = reinterpret_cast<const float*>(points);
+    auto orbits = concurrency::array<float, 2>(concurrency::extent<2>(point_extent[0], 4), first, first + count * 4, accel_view);
+
+    const auto view_count = unsigned(viewports.size());
+    auto& canvas0 = count_arrays[0];
+    auto& canvas1 = count_arrays[min(1u, view_count - 1)];
+    auto& canvas2 = count_arrays[min(2u, view_count - 1)];
+    auto& canvas3 = count_arrays[min(3u, view_count - 1)];
+
+    const auto min_iterations = std::get<0>(iteration_range);
+    const auto max_iterations = std::get<1>(iteration_range);
+    auto transforms = ViewportTransforms();
+    copy(begin(viewport_transforms), end(viewport_transforms), transforms.views);
+
+    // orbits still bounded at the new cap are parked again, so deepening can be repeated
+    const auto save_frontier = frontier != nullptr;
+    auto& parked = frontier_points;
+    auto& parked_count = frontier_count;
+    if (save_frontier)
+    {
+        const auto zero = 0u;
+        concurrency::copy(&zero, &zero + 1, parked_count);
+    }
+
+    parallel_for_each(point_extent,
+        [=, &orbits, &canvas0, &canvas1, &canvas2, &canvas3, &parked, &parked_count](concurrency::index<1> idx) restrict(amp)
+        {
+            const auto c = Complex<float>(orbits[concurrency::index<2>(idx[0], 0)], orbits[concurrency::index<2>(idx[0], 1)]);
+            auto z = Complex<float>(orbits[concurrency::index<2>(idx[0], 2)], orbits[concurrency::index<2>(idx[0], 3)]);
+
+            const auto i = continue_orbit(c, z, parked_iterations, max_iterations);
+            if (i < max_iterations)
+            {
+                if (i >= min_iterations) record_orbit(c, i, transforms, view_count, canvas0, canvas1, canvas2, canvas3);
+            }
+            else if (i == max_iterations && save_frontier)
+            {
+                park(parked, parked_count, c, z);
+            }
+        }
+    );
+
+    if (save_frontier) flush_frontier();
+}
+
+void BuddhabrotGenerator::replay(const vector<OrbitSeed>& seeds, unsigned long long samples)
+{
+    samples_taken += samples;
+    if (seeds.empty()) return;
+
+    auto coordinates = vector<float>(seeds.size() * 2);
+    auto escapes = vector<unsigned>(seeds.size());
+    for (size_t s = 0; s < seeds.size(); ++s)
+    {
+        coordinates[s * 2] = seeds[s].r;
+        coordinates[s * 2 + 1] = seeds[s].i;
+        escapes[s] = seeds[s].escape_iteration;
+    }
+
+    const auto seed_extent = concurrency::extent<1>(int(seeds.size()));
+    auto points = concurrency::array<float, 2>(concurrency::extent<2>(seed_extent[0], 2), coordinates.begin(), coordinates.end(), accel_view);
+    auto iterations = concurrency::array<unsigned, 1>(seed_extent, escapes.begin(), escapes.end(), accel_view);
+
+    const auto view_count = unsigned(viewports.size());
+    auto& canvas0 = count_arrays[0];
+    auto& canvas1 = count_arrays[min(1u, view_count - 1)];
+    auto& canvas2 = count_arrays[min(2u, view_count - 1)];
+    auto& canvas3 = count_arrays[min(3u, view_count - 1)];
+
+    const auto min_iterations = std::get<0>(iteration_range);
+    const auto max_iterations = std::get<1>(iteration_range);
+    auto transforms = ViewportTransforms();
+    copy(begin(viewport_transforms), end(viewport_transforms), transforms.views);
+
+    parallel_for_each(seed_extent,
+        [=, &points, &iterations, &canvas0, &canvas1, &canvas2, &canvas3](concurrency::index<1> idx) restrict(amp)
+        {
+            const auto i = iterations[idx];
+            if (i < min_iterations || i >= max_iterations) return;
+
+            const auto c = Complex<float>(points[concurrency::index<2>(idx[0], 0)], points[concurrency::index<2>(idx[0], 1)]);
+            record_orbit(c, i, transforms, view_count, canvas0, canvas1, canvas2, canvas3);
+        }
+    );
+}
+
+void BuddhabrotGenerator::iterate(BucketedHistogram& histogram)
+{
+    auto randoms = generate_random_numbers();
+    auto& dense = histogram.dense;
+    auto& spill_keys = histogram.spill_keys;
+    auto& spill_values = histogram.spill_values;
+    auto& spill_dropped = histogram.spill_dropped;
+
+    const auto spill_mask = histogram.spill_mask;
+    const auto buckets = histogram.get_buckets();
+    const auto transform = viewport_transforms[0];
+    const auto width = unsigned(dims[1]);
+
+    parallel_for_each(concurrency::extent<1>(points_per_iteration),
+        [=, &randoms, &dense, &spill_keys, &spill_values, &spill_dropped](concurrency::index<1> idx) restrict(amp)
         {
             const auto c = Complex<float>(randoms[concurrency::index<2>(idx[0], 0)], randoms[concurrency::index<2>(idx[0], 1)]);
 
-            auto z = Complex<float>(0, 0);
+            // every escaping orbit is kept; which ones make up a channel is decided when composing
+            const auto i = escape_iteration(c, buckets.max_iterations);
+            if (i >= buckets.max_iterations) return;
 
-            bool iterate_again_and_record = false;
-            unsigned i;
-            for (i = 0; i < max_iterations; ++i)
+            const auto bucket = buckets.bucket_of(i);
+            auto z = Complex<float>(0, 0);
+            for (unsigned j = 0; j < i; j++)
             {
                 z = c + (z * z);
-                if (z.magnitude_squared() >= 4.0)
+                if (j >= FIRST_RECORDED_ITERATION)
                 {
-                    if (i >= min_iterations)
+                    auto pixel = concurrency::index<2>();
+                    if (transform.to_pixel(z, pixel))
+                    {
+                        const auto cell = (unsigned(pixel[0]) * width + unsigned(pixel[1])) * buckets.count + bucket;
+                        BucketedHistogram::increment(dense, spill_keys, spill_values, spill_dropped, spill_mask, cell);
+                    }
+                    if (transform.to_pixel(z.conjugate(), pixel))
                     {
-                        iterate_again_and_record = true;
+                        const auto cell = (unsigned(pixel[0]) * width + unsigned(pixel[1])) * buckets.count + bucket;
+                        BucketedHistogram::increment(dense, spill_keys, spill_values, spill_dropped, spill_mask, cell);
                     }
-                    break;
                 }
             }
-            if (iterate_again_and_record)
+        }
+    );
+
+    count_samples(points_per_iteration);
+}
+
+void BuddhabrotGenerator::iterate(InterleavedHistogram& histogram)
+{
+    auto randoms = generate_random_numbers();
+    auto& cells = histogram.counts;
+
+    const auto ranges = histogram.get_ranges();
+    const auto transform = viewport_transforms[0];
+
+    parallel_for_each(concurrency::extent<1>(points_per_iteration),
+        [=, &randoms, &cells](concurrency::index<1> idx) restrict(amp)
+        {
+            const auto c = Complex<float>(randoms[concurrency::index<2>(idx[0], 0)], randoms[concurrency::index<2>(idx[0], 1)]);
+
+            const auto i = escape_iteration(c, ranges.max_iterations);
+            const auto channels = i < ranges.max_iterations ? ranges.mask(i) : 0u;
+            if (channels == 0 || i <= FIRST_RECORDED_ITERATION) return;
+
+            auto z = Complex<float>(0, 0);
+            for (unsigned j = 0; j < i; j++)
             {
-                z = Complex<float>(0, 0);
-                for (unsigned j = 0; j < i; j++)
+                z = c + (z * z);
+                if (j < FIRST_RECORDED_ITERATION) continue;
+
+                // every channel of a cell shares its 16 bytes, so the increments below stay on one cache line
+                auto pixel = concurrency::index<2>();
+                for (unsigned mirrored = 0; mirrored < 2; ++mirrored)
                 {
-                    z = c + (z * z);
-                    if (j >= 400)
+                    if (!transform.to_pixel(mirrored ? z.conjugate() : z, pixel)) continue;
+                    for (unsigned channel = 0; channel < 3; ++channel)
                     {
-                        const auto dims = recording_array.get_extent();
-                        const auto y = unsigned(((z.r + 1.8) / 3.6) * dims[0]);
-                        const auto x = unsigned(((z.i + 1.8) / 3.6) * dims[1]);
-                        concurrency::atomic_fetch_inc(&recording_array[concurrency::index<2>(y, x)]);
-                        concurrency::atomic_fetch_inc(&recording_array[concurrency::index<2>(y, dims[1] - x - 1)]);
+                        if (channels & (1u << channel)) concurrency::atomic_fetch_inc(&cells[concurrency::index<3>(pixel[0], pixel[1], int(channel))]);
                     }
                 }
             }
         }
     );
 
-    return recording_array;
+    count_samples(points_per_iteration);
 }
 
 concurrency::array<float, 2> BuddhabrotGenerator::generate_random_numbers()
 {
-    auto rand_array = concurrency::array<float, 2>(concurrency::extent<2>(points_per_iteration, 2), accel_view);
+    return generate_random_numbers(points_per_iteration);
+}
+
+// at least count points; the generator threads stay at sqrt(points_per_iteration) & each fills a whole run
+concurrency::array<float, 2> BuddhabrotGenerator::generate_random_numbers(unsigned count)
+{
     const auto seed = static_cast<unsigned>(chrono::system_clock::now().time_since_epoch().count());
 
     const auto threads = unsigned(sqrt(points_per_iteration));
-    const auto per_thread = threads;
+    const auto per_thread = (count + threads - 1) / threads;
+    const auto radius = sample_radius;
+    auto rand_array = concurrency::array<float, 2>(concurrency::extent<2>(max(count, threads * per_thread), 2), accel_view);
+
+    // culled: uniform over the cells kept, each picked uniformly & then a point within it
+    if (sample_cells != nullptr)
+    {
+        const auto cells = unsigned(sample_cells->cells.size());
+        const auto size = cell_size;
+        auto& corners = cell_corners;
+        parallel_for_each(concurrency::extent<1>(threads),
+            [=, &rand_array, &corners](concurrency::index<1> thread_idx) restrict(amp)
+            {
+                auto tinymt = tinymt32_t();
+                tinymt32_init(&tinymt, seed * thread_idx[0]);
+
+                const auto start_idx = thread_idx[0] * per_thread;
+                for (unsigned i = 0; i < per_thread; ++i)
+                {
+                    const auto current_idx = start_idx + i;
+                    const auto cell = int(tinymt32_generate_uint32(&tinymt) % cells);
+                    rand_array[concurrency::index<2>(current_idx, 0)] = corners[concurrency::index<2>(cell, 0)] + tinymt32_generate_float(&tinymt) * size;
+                    rand_array[concurrency::index<2>(current_idx, 1)] = corners[concurrency::index<2>(cell, 1)] + tinymt32_generate_float(&tinymt) * size;
+                }
+            }
+        );
+        return rand_array;
+    }
 
     parallel_for_each(concurrency::extent<1>(threads),
         [=, &rand_array](concurrency::index<1> thread_idx) restrict(amp)
@@ -92,11 +1418,41 @@ concurrency::array<float, 2> BuddhabrotGenerator::generate_random_numbers()
             for (unsigned i = 0; i < per_thread; ++i)
             {
                 const auto current_idx = start_idx + i;
-                rand_array[concurrency::index<2>(current_idx, 0)] = tinymt32_generate_float(&tinymt) * 3.6f - 1.8f;
-                rand_array[concurrency::index<2>(current_idx, 1)] = tinymt32_generate_float(&tinymt) * 3.6f - 1.8f;
+                rand_array[concurrency::index<2>(current_idx, 0)] = (tinymt32_generate_float(&tinymt) * 2.0f - 1.0f) * radius;
+                rand_array[concurrency::index<2>(current_idx, 1)] = (tinymt32_generate_float(&tinymt) * 2.0f - 1.0f) * radius;
             }
         }
     );
 
     return rand_array;
+}
+
+// points_per_iteration initial points, each in sample_regions (picked uniformly from the first regions) & offset
+//  from that region's center by up to half of size on both axes in sample_deltas
+void BuddhabrotGenerator::generate_region_samples(unsigned regions, float size)
+{
+    const auto seed = static_cast<unsigned>(chrono::system_clock::now().time_since_epoch().count());
+
+    const auto threads = unsigned(sqrt(points_per_iteration));
+    const auto per_thread = (points_per_iteration + threads - 1) / threads;
+    const auto half_size = size / 2.0f;
+    auto& deltas = sample_deltas;
+    auto& owners = sample_regions;
+
+    parallel_for_each(concurrency::extent<1>(threads),
+        [=, &deltas, &owners](concurrency::index<1> thread_idx) restrict(amp)
+        {
+            auto tinymt = tinymt32_t();
+            tinymt32_init(&tinymt, seed * (thread_idx[0] + 1));
+
+            const auto start_idx = thread_idx[0] * per_thread;
+            for (unsigned i = 0; i < per_thread; ++i)
+            {
+                const auto current_idx = start_idx + i;
+                owners[current_idx] = tinymt32_generate_uint32(&tinymt) % regions;
+                deltas[concurrency::index<2>(current_idx, 0)] = (tinymt32_generate_float(&tinymt) * 2.0f - 1.0f) * half_size;
+                deltas[concurrency::index<2>(current_idx, 1)] = (tinymt32_generate_float(&tinymt) * 2.0f - 1.0f) * half_size;
+            }
+        }
+    );
 }
\ No newline at end of file
@@ -1,6 +1,40 @@
 #ifndef _BUDDHABROT_GENERATOR_H_
 #define _BUDDHABROT_GENERATOR_H_
 
+#include <vector>
+
+#include "viewport.h"
+#include "orbit_formulas.h"
+#include "sample_culling.h"
+#include "parallel_primitives.h"
+
+// views a single generator can record into; each extra view costs a canvas & a splat per orbit point
+const unsigned MAX_VIEWPORTS = 4;
+
+class BucketedHistogram;
+class InterleavedHistogram;
+class SeedLogWriter;
+struct OrbitSeed;
+class FrontierWriter;
+struct FrontierPoint;
+
+// initial points escape tested & orbits recorded in each Precision (indexed by its value) by iterate()
+struct PrecisionCounts
+{
+    unsigned long long tested[3];
+    unsigned long long recorded[3];
+};
+
+// deep zoom sampling: initial points are drawn only from square regions of the sample square whose orbits a survey
+//  saw reaching the viewports, & iterated as float deltas from a reference orbit through each region's center
+struct DeepZoomSettings
+{
+    // most regions kept at once; each region's reference orbit holds up to max iterations + 1 points of 16 bytes
+    unsigned max_regions{ 1024 };
+    // batches of points_per_iteration samples surveyed at every level of refinement
+    unsigned survey_batches{ 4 };
+};
+
 class BuddhabrotGenerator
 {
     public:
@@ -8,21 +42,192 @@ class BuddhabrotGenerator
         // points_per_iteration should be a square
         // we will record the path taken by an initial point if it escapes in iterations that fall in the iteration_range;
         //  if the initial point does not escape within std::get<1>(iteration_range) we will consider it "non-escaping" the manderbrot set
-        BuddhabrotGenerator(concurrency::accelerator_view, concurrency::extent<2> dimensions, unsigned points_per_iteration, std::tuple<unsigned, unsigned> iteration_range);
+        // each viewport gets its own canvas & decides which part of the plane lands on it; every orbit is computed
+        //  once & recorded into all of them. initial points are drawn from the square [-sample_radius, sample_radius]^2
+        //  regardless of the viewports
+        BuddhabrotGenerator(concurrency::accelerator_view, concurrency::extent<2> dimensions, unsigned points_per_iteration, std::tuple<unsigned, unsigned> iteration_range,
+            const std::vector<Viewport>& viewports = { Viewport() }, float sample_radius = 1.8f);
+        // returns the canvas of the first viewport
         const concurrency::array<unsigned, 2>& iterate();
-        const concurrency::array<unsigned, 2>& get_record_array()
+        // records every orbit escaping below the histogram's max iterations into histogram instead of the record
+        //  arrays, through the first viewport only; histogram must have the same dimensions as this generator
+        void iterate(BucketedHistogram& histogram);
+        // records every orbit escaping in any of the histogram's channel ranges into each channel it belongs to,
+        //  through the first viewport only; this generator's iteration range should cover all of them
+        void iterate(InterleavedHistogram& histogram);
+        // picks the compiled escape test & record kernels that iterate() uses; segments, frontiers, replay, deepening &
+        //  the histogram overloads always iterate z^2 + c in float. E_NOTIMPL for float64 in either stage on an
+        //  accelerator without double support
+        void set_orbit_settings(const OrbitSettings& settings);
+        // the tier iterate() records in, after any promotion for the viewports' scale
+        Precision get_record_precision() const
+        {
+            return record_precision;
+        }
+        // the tier iterate() would promote requested to for the viewports' scale. only iterate() promotes, so the
+        //  other paths place points coarser than the cells whenever this is wider than float
+        Precision promoted_precision(Precision requested) const;
+        const PrecisionCounts& get_precision_counts() const
+        {
+            return precision_counts;
+        }
+        // surveys for the regions whose orbits reach the viewports, narrowing a halo around them level by level, &
+        //  switches iterate() to sampling those regions only & perturbing their reference orbits, so points are
+        //  placed finer than float can alone. escape tests then run in float & recording in the (promoted) record
+        //  tier; E_NOTIMPL for formulas other than mandelbrot
+        void set_deep_zoom(const DeepZoomSettings& settings);
+        unsigned get_deep_zoom_regions() const
+        {
+            return unsigned(region_centers.size() / 2);
+        }
+        // cuts the squares of the sample square proven to hold no orbit this generator records (see
+        //  cull_sample_square) & draws initial points uniformly from what is left, on every path that samples. not
+        //  for frontiers or deepening, since the cut includes squares bounded only up to this generator's cap
+        void set_sample_culling(const SampleCullingSettings& settings);
+        // the cells sampled from, when culling
+        const SampleCells* get_sample_cells() const
+        {
+            return sample_cells;
+        }
+        // fraction of the sample square's area initial points are drawn from
+        double get_sampled_fraction() const
+        {
+            return sampled_fraction;
+        }
+        // times a perturbed orbit was moved back to the start of its reference, over every deep zoom call so far
+        unsigned long long get_rebase_count() const
         {
-            return count_array;
+            return rebase_count;
+        }
+        // with a non zero length, iterate() advances every orbit by at most length iterations & parks the rest of
+        //  the work for the next call, so one call's cost no longer depends on the longest orbit in it. orbits still
+        //  in flight when rendering stops are dropped
+        void set_segment_length(unsigned length);
+        // while set, iterate() appends the initial point of every orbit escaping from min_iterations up to this
+        //  generator's cap to log. min_iterations may lie below the generator's own range (so the log covers the
+        //  other channels as well); those orbits are logged without being recorded
+        void set_seed_log(SeedLogWriter* log, unsigned min_iterations);
+        // records previously logged orbits that escape in this generator's iteration range, without sampling or
+        //  escape testing; samples is the number of initial points the seeds were drawn from
+        void replay(const std::vector<OrbitSeed>& seeds, unsigned long long samples);
+        // while set, orbits that reach the iteration cap without escaping (& are not provably bounded) are parked
+        //  in writer so a later run with a higher cap can continue them
+        void set_frontier(FrontierWriter* writer);
+        // replaces the first viewport's canvas with counts from an earlier run of samples initial points
+        void load_counts(const std::vector<unsigned>& counts, unsigned long long samples);
+        // continues orbits parked at parked_iterations up to this generator's cap & records those escaping in its
+        //  iteration range; at most points_per_iteration points per call
+        void deepen(const FrontierPoint* points, size_t count, unsigned parked_iterations);
+        const concurrency::array<unsigned, 2>& get_record_array(unsigned viewport = 0)
+        {
+            return count_arrays[viewport];
+        }
+        std::tuple<unsigned, unsigned> get_iteration_range() const
+        {
+            return iteration_range;
+        }
+        // number of initial points sampled into the canvas so far, counted as the points a draw over the whole sample
+        //  square would have taken for the same density when culling or deep zoom narrows it, so counts normalise the
+        //  same way with or without them
+        unsigned long long get_samples_taken() const
+        {
+            return samples_taken;
+        }
+        const Viewport& get_viewport(unsigned viewport = 0) const
+        {
+            return viewports[viewport];
+        }
+        unsigned get_viewport_count() const
+        {
+            return unsigned(viewports.size());
+        }
+        // fraction of lane iterations spent on orbits rather than idling on an exhausted stream, over every
+        //  segmented call so far (0 when segments are off)
+        double get_lane_occupancy() const
+        {
+            return lane_iterations == 0 ? 0.0 : double(busy_lane_iterations) / lane_iterations;
         }
 
     private:
         concurrency::array<float, 2> generate_random_numbers();
+        concurrency::array<float, 2> generate_random_numbers(unsigned count);
+        const concurrency::array<unsigned, 2>& iterate_segments();
+        const concurrency::array<unsigned, 2>& iterate_deep();
+        void generate_region_samples(unsigned regions, float size);
+        std::vector<unsigned> survey(const std::vector<double>& centers, float size, float halo_scale, unsigned batches);
+        void build_reference_orbits();
+        void order_queue(unsigned queued);
+        void record_queue(const concurrency::array<float, 2>& randoms, unsigned queued);
+        void reserve_slots(unsigned slots);
+        unsigned long long count_samples(unsigned long long drawn);
+        void flush_seeds(unsigned long long samples);
+        void flush_frontier();
+        Precision resolve_record_precision() const;
 
         concurrency::accelerator_view accel_view;
         const concurrency::extent<2> dims;
         const unsigned points_per_iteration;
         const std::tuple<unsigned, unsigned> iteration_range;
-        concurrency::array<unsigned, 2> count_array;
+        const std::vector<Viewport> viewports;
+        ViewportTransform viewport_transforms[MAX_VIEWPORTS]{};
+        const float sample_radius;
+        std::vector<concurrency::array<unsigned, 2>> count_arrays;
+        unsigned long long samples_taken{ 0 };
+        OrbitSettings orbit_settings;
+        Precision record_precision{ Precision::float32 };
+        PrecisionCounts precision_counts{};
+
+        SeedLogWriter* seed_log{ nullptr };
+        unsigned seed_min_iterations{ 0 };
+        concurrency::array<float, 2> seed_points;
+        concurrency::array<unsigned, 1> seed_iterations;
+        concurrency::array<unsigned, 1> seed_count;
+
+        FrontierWriter* frontier{ nullptr };
+        concurrency::array<float, 2> frontier_points;
+        concurrency::array<unsigned, 1> frontier_count;
+
+        unsigned segment_length{ 0 };
+        concurrency::array<float, 2> orbit_points;
+        concurrency::array<unsigned, 2> orbit_counters;
+        concurrency::array<unsigned, 1> lane_stats;
+        unsigned stream_length;
+        unsigned long long busy_lane_iterations{ 0 };
+        unsigned long long lane_iterations{ 0 };
+
+        // the share of the sample square sampled from, whether narrowed by deep zoom or culling
+        double sampled_fraction{ 1.0 };
+        // the part of a whole square equivalent sample not yet counted in samples_taken
+        double sample_remainder{ 0.0 };
+
+        // culled sampling: the corner of every cell kept, all of side cell_size
+        const SampleCells* sample_cells{ nullptr };
+        concurrency::array<float, 2> cell_corners;
+        float cell_size{ 0.0f };
+
+        // deep zoom regions as real & imaginary center pairs, sharing one size. reference orbits are stored as
+        //  DoubleFloat pairs (real hi, lo, imaginary hi, lo) & each region's first & last point indexed by
+        //  reference_ranges
+        bool deep_zoom{ false };
+        std::vector<double> region_centers;
+        double region_size{ 0.0 };
+        concurrency::array<float, 2> reference_orbits;
+        concurrency::array<unsigned, 2> reference_ranges;
+        concurrency::array<float, 2> sample_deltas;
+        concurrency::array<unsigned, 1> sample_regions;
+        concurrency::array<unsigned, 1> region_hits;
+        concurrency::array<unsigned, 1> rebase_counters;
+        unsigned long long rebase_count{ 0 };
+
+        concurrency::array<unsigned, 1> accepted_flags;
+        concurrency::array<unsigned, 1> escape_iterations;
+        concurrency::array<unsigned, 1> orbit_queue;
+        concurrency::array<unsigned, 1> ordered_queue;
+        concurrency::array<unsigned, 1> length_buckets;
+        concurrency::array<unsigned, 1> length_offsets;
+        PrefixScan queue_scan;
+        PrefixScan bucket_scan;
+        concurrency::array<unsigned, 1> record_cursor;
 };
 
 #endif
\ No newline at end of file
@@ -1,12 +1,51 @@
 #include <amp.h>
 #include <amp_graphics.h>
-#include <amp_math.h>
 
 #include "utilities.h"
 #include "buddhabrot_presenter.h"
 #include "full_quad_vertex_shader.h"
 #include "textured_quad_pixel_shader.h"
 
+namespace
+{
+    // the largest texture side D3D11 allows; canvases past it are shown reduced by a whole factor
+    const unsigned MAX_TEXTURE_DIMENSION = D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION;
+
+    // mean of the counts in the factor x factor block of the canvas behind a texel, so the canvas' tone map still
+    //  applies; one channel of a planar canvas, or of interleaved (row, column, channel) cells
+    unsigned block_mean(const concurrency::array<unsigned, 2>& counts, concurrency::index<2> texel, unsigned factor) restrict(amp)
+    {
+        const auto canvas = counts.get_extent();
+        const auto top = texel[0] * int(factor);
+        const auto left = texel[1] * int(factor);
+        const auto bottom = top + int(factor) < canvas[0] ? top + int(factor) : canvas[0];
+        const auto right = left + int(factor) < canvas[1] ? left + int(factor) : canvas[1];
+
+        auto sum = 0.0f;
+        for (auto y = top; y < bottom; ++y)
+        {
+            for (auto x = left; x < right; ++x) sum += float(counts[concurrency::index<2>(y, x)]);
+        }
+        return unsigned(sum / float((bottom - top) * (right - left)) + 0.5f);
+    }
+
+    unsigned block_mean(const concurrency::array<unsigned, 3>& cells, int channel, concurrency::index<2> texel, unsigned factor) restrict(amp)
+    {
+        const auto canvas = cells.get_extent();
+        const auto top = texel[0] * int(factor);
+        const auto left = texel[1] * int(factor);
+        const auto bottom = top + int(factor) < canvas[0] ? top + int(factor) : canvas[0];
+        const auto right = left + int(factor) < canvas[1] ? left + int(factor) : canvas[1];
+
+        auto sum = 0.0f;
+        for (auto y = top; y < bottom; ++y)
+        {
+            for (auto x = left; x < right; ++x) sum += float(cells[concurrency::index<3>(y, x, channel)]);
+        }
+        return unsigned(sum / float((bottom - top) * (right - left)) + 0.5f);
+    }
+}
+
 CComPtr<ID3D11DeviceContext3> immediate_context(ID3D11Device5* device)
 {
     CComPtr<ID3D11DeviceContext3> context;
@@ -14,10 +53,11 @@ CComPtr<ID3D11DeviceContext3> immediate_context(ID3D11Device5* device)
     return context;
 }
 
-BuddhabrotPresenter::BuddhabrotPresenter(HWND hwnd, CComPtr<ID3D11Device5> device) :
+BuddhabrotPresenter::BuddhabrotPresenter(HWND hwnd, CComPtr<ID3D11Device5> device, const ToneMapSettings& tone_map_settings) :
     device(device),
     context(query_interface<ID3D11DeviceContext4>(immediate_context(device))),
     swapchain(BaseSwapChain(hwnd, device)),
+    tone_map_settings(tone_map_settings),
     intermediate_texture(concurrency::extent<2>(1, 1), 8)
 {
     create_shaders();
@@ -86,30 +126,67 @@ void BuddhabrotPresenter::resize()
 
 void BuddhabrotPresenter::render_and_present(const concurrency::array<unsigned, 2>& r, const concurrency::array<unsigned, 2>& g, const concurrency::array<unsigned, 2>& b)
 {
-    if (intermediate_texture.get_extent() != r.get_extent())
-    {
-        intermediate_texture = concurrency::graphics::texture<concurrency::graphics::unorm_4, 2>(r.get_extent(), 8, r.accelerator_view);
-    }
+    const auto factor = prepare_texture(r.get_extent(), r.accelerator_view);
+    auto intermediate_view = concurrency::graphics::texture_view<concurrency::graphics::unorm_4, 2>(intermediate_texture);
 
+    const auto map = make_rgb_tone_map(
+        rgb_statistics(concurrency::array_view<const unsigned, 2>(r), concurrency::array_view<const unsigned, 2>(g), concurrency::array_view<const unsigned, 2>(b)),
+        tone_map_settings);
+
+    parallel_for_each(intermediate_texture.get_extent(),
+        [=, &r, &g, &b](concurrency::index<2> idx) restrict(amp)
+        {
+            const auto red = factor == 1 ? r[idx] : block_mean(r, idx, factor);
+            const auto green = factor == 1 ? g[idx] : block_mean(g, idx, factor);
+            const auto blue = factor == 1 ? b[idx] : block_mean(b, idx, factor);
+            concurrency::graphics::unorm_4 value(map.red.apply(red), map.green.apply(green), map.blue.apply(blue), 1.0f);
+
+            intermediate_view.set(idx, value);
+        }
+    );
+
+    present_texture();
+}
+
+void BuddhabrotPresenter::render_and_present(const concurrency::array<unsigned, 3>& cells)
+{
+    const auto cells_extent = cells.get_extent();
+    const auto factor = prepare_texture(concurrency::extent<2>(cells_extent[0], cells_extent[1]), cells.accelerator_view);
     auto intermediate_view = concurrency::graphics::texture_view<concurrency::graphics::unorm_4, 2>(intermediate_texture);
 
-    const auto red_max_array = max_element_in_concurrency_array(r);
-    const auto green_max_array = max_element_in_concurrency_array(g);
-    const auto blue_max_array = max_element_in_concurrency_array(b);
+    const auto map = make_rgb_tone_map(rgb_statistics(concurrency::array_view<const unsigned, 3>(cells)), tone_map_settings);
 
     parallel_for_each(intermediate_texture.get_extent(),
-        [&, intermediate_view](concurrency::index<2> idx) restrict(amp)
+        [=, &cells](concurrency::index<2> idx) restrict(amp)
         {
             concurrency::graphics::unorm_4 value(
-                concurrency::fast_math::sqrt(r[idx] / static_cast<float>(red_max_array[0])),
-                concurrency::fast_math::sqrt(g[idx] / static_cast<float>(green_max_array[0])),
-                concurrency::fast_math::sqrt(b[idx] / static_cast<float>(blue_max_array[0])),
-                1.0);
+                map.red.apply(block_mean(cells, 0, idx, factor)),
+                map.green.apply(block_mean(cells, 1, idx, factor)),
+                map.blue.apply(block_mean(cells, 2, idx, factor)),
+                1.0f);
 
             intermediate_view.set(idx, value);
         }
     );
 
+    present_texture();
+}
+
+// sizes the texture for a canvas of extent & returns the factor the canvas is reduced by to fit it
+unsigned BuddhabrotPresenter::prepare_texture(concurrency::extent<2> extent, concurrency::accelerator_view accel_view)
+{
+    const auto longest = unsigned(extent[0] > extent[1] ? extent[0] : extent[1]);
+    const auto factor = (longest + MAX_TEXTURE_DIMENSION - 1) / MAX_TEXTURE_DIMENSION;
+    const auto texture_extent = concurrency::extent<2>((extent[0] + factor - 1) / factor, (extent[1] + factor - 1) / factor);
+    if (intermediate_texture.get_extent() != texture_extent)
+    {
+        intermediate_texture = concurrency::graphics::texture<concurrency::graphics::unorm_4, 2>(texture_extent, 8, accel_view);
+    }
+    return factor;
+}
+
+void BuddhabrotPresenter::present_texture()
+{
     auto d3d_texture = query_interface<ID3D11Texture2D>(CComPtr<IUnknown>(concurrency::graphics::direct3d::get_texture(intermediate_texture)));
     CComPtr<ID3D11ShaderResourceView> srv;
     {
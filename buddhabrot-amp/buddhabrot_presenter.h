@@ -4,16 +4,21 @@
 #include <amp.h>
 
 #include "base_swapchain.h"
+#include "tone_mapping.h"
 
 class BuddhabrotPresenter
 {
     public:
-        BuddhabrotPresenter(HWND, CComPtr<ID3D11Device5>);
+        BuddhabrotPresenter(HWND, CComPtr<ID3D11Device5>, const ToneMapSettings&);
         void resize();
         void render_and_present(const concurrency::array<unsigned, 2>& r, const concurrency::array<unsigned, 2>& g, const concurrency::array<unsigned, 2>& b);
+        // interleaved (row, column, channel) counts, tone mapped in place
+        void render_and_present(const concurrency::array<unsigned, 3>& cells);
 
     private:
         void present();
+        unsigned prepare_texture(concurrency::extent<2>, concurrency::accelerator_view);
+        void present_texture();
         void create_shaders();
         void create_pipeline_objects();
         void create_backbuffer_render_target();
@@ -23,6 +28,7 @@ class BuddhabrotPresenter
         CComPtr<ID3D11Device5> device;
         CComPtr<ID3D11DeviceContext4> context;
         BaseSwapChain swapchain;
+        const ToneMapSettings tone_map_settings;
 
         // pipeline state
         CComPtr<ID3D11VertexShader> vertex_shader;
@@ -0,0 +1,445 @@
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "cpu_generator.h"
+#include "task_scheduler.h"
+#include "scatter_increment.h"
+
+using namespace std;
+
+namespace
+{
+    // matches the accelerator generator so both engines render the same image
+    const unsigned FIRST_RECORDED_ITERATION = 400;
+
+    // initial points per escape test task; each task seeds its own generator so no state is shared
+    const size_t SAMPLES_PER_TASK = 1 << 12;
+
+    // canvas cells constructed per task, 64KB of them
+    const size_t CANVAS_GRAIN = 1 << 14;
+
+    // bands of canvas rows per NUMA node. the pipeline keeps a ring for every worker & band, so bands are held to a
+    //  few per node rather than one per worker, which would grow the rings with the square of the core count
+    const unsigned BANDS_PER_NODE = 8;
+
+    const unsigned TILE_SIZE = 1 << MORTON_TILE_BITS;
+
+    size_t canvas_cells(concurrency::extent<2> dims, CanvasLayout layout)
+    {
+        if (layout == CanvasLayout::row_major) return dims.size();
+
+        // partial tiles at the edges are stored whole so every tile starts on a tile boundary
+        const auto tiles_down = (size_t(dims[0]) + TILE_SIZE - 1) / TILE_SIZE;
+        const auto tiles_across = (size_t(dims[1]) + TILE_SIZE - 1) / TILE_SIZE;
+        return tiles_down * tiles_across * TILE_SIZE * TILE_SIZE;
+    }
+
+    // constructs count objects in place across the scheduler's pinned workers, which is also where the pages of a
+    //  first touch buffer are placed
+    template <typename T>
+    T* construct_in(HostBuffer& buffer, size_t count, size_t grain, TaskScheduler& scheduler)
+    {
+        auto* objects = static_cast<T*>(buffer.data());
+        scheduler.parallel_for(0, count, grain,
+            [=](size_t first, size_t last)
+            {
+                for (auto i = first; i < last; ++i) new (objects + i) T();
+            }
+        );
+        return objects;
+    }
+
+    bool in_cardioid_or_bulb(const Complex<float>& c)
+    {
+        const auto x = c.r - 0.25f;
+        const auto q = x * x + c.i * c.i;
+        const auto bulb_x = c.r + 1.0f;
+        return q * (q + x) <= 0.25f * c.i * c.i || bulb_x * bulb_x + c.i * c.i <= 0.0625f;
+    }
+
+    unsigned escape_iteration(const Complex<float>& c, unsigned max_iterations)
+    {
+        auto z = Complex<float>(0, 0);
+        for (unsigned i = 0; i < max_iterations; ++i)
+        {
+            z = c + (z * z);
+            if (z.magnitude_squared() >= 4.0f) return i;
+        }
+        return max_iterations;
+    }
+}
+
+CpuBuddhabrotGenerator::CpuBuddhabrotGenerator(concurrency::extent<2> dims, unsigned points_per_iteration, tuple<unsigned, unsigned> iteration_range,
+    const Viewport& viewport, float sample_radius, TaskScheduler& scheduler, CanvasLayout layout, const HostMemorySettings& memory) :
+    dims(dims),
+    points_per_iteration(points_per_iteration),
+    iteration_range(iteration_range),
+    viewport(viewport),
+    transform(viewport.transform(dims)),
+    sample_radius(sample_radius),
+    scheduler(scheduler),
+    layout(layout),
+    tiles_across((unsigned(dims[1]) + TILE_SIZE - 1) / TILE_SIZE),
+    memory(memory),
+    band_count(min(min(scheduler.get_worker_count(), BANDS_PER_NODE * numa_node_count()), unsigned(dims[0]))),
+    band_rows((unsigned(dims[0]) + band_count - 1) / band_count),
+    bands(new Band[band_count])
+{
+    const auto cells = canvas_cells(dims, layout);
+    const auto replicate = memory.placement == MemoryPlacement::replicate;
+    for (unsigned node = 0; node < (replicate ? numa_node_count() : 1); ++node)
+    {
+        canvas_memory.emplace_back(cells * sizeof(atomic<unsigned>), memory.pages, replicate ? int(node) : -1, memory.placement == MemoryPlacement::interleave);
+        canvases.push_back(construct_in<atomic<unsigned>>(canvas_memory.back(), cells, CANVAS_GRAIN, scheduler));
+    }
+}
+
+// escape tests run first & only the orbits worth recording are kept, longest first, so the record pass can hand
+//  them out one at a time: the scheduler's thieves then spread the long orbits while the owners work through the
+//  short tail
+void CpuBuddhabrotGenerator::iterate()
+{
+    const auto min_iterations = get<0>(iteration_range);
+    const auto max_iterations = get<1>(iteration_range);
+    const auto seed = static_cast<unsigned>(chrono::system_clock::now().time_since_epoch().count()) ^ ++batches;
+    if (pipelined)
+    {
+        iterate_pipelined(seed);
+        samples_taken += points_per_iteration;
+        return;
+    }
+
+    const auto tasks = (size_t(points_per_iteration) + SAMPLES_PER_TASK - 1) / SAMPLES_PER_TASK;
+    auto accepted = vector<vector<QueuedOrbit>>(tasks);
+    scheduler.parallel_for(0, tasks, 1,
+        [&](size_t first, size_t last)
+        {
+            for (auto t = first; t < last; ++t)
+            {
+                auto engine = mt19937(seed + unsigned(t) * 0x9e3779b9u);
+                auto uniform = uniform_real_distribution<float>(-sample_radius, sample_radius);
+
+                const auto count = min(SAMPLES_PER_TASK, points_per_iteration - t * SAMPLES_PER_TASK);
+                for (size_t s = 0; s < count; ++s)
+                {
+                    const auto c = Complex<float>(uniform(engine), uniform(engine));
+                    if (in_cardioid_or_bulb(c)) continue;
+
+                    const auto i = escape_iteration(c, max_iterations);
+                    if (i < max_iterations && i >= min_iterations && i > FIRST_RECORDED_ITERATION) accepted[t].push_back({ c, i });
+                }
+            }
+        }
+    );
+
+    auto queue = vector<QueuedOrbit>();
+    for (const auto& orbits : accepted) queue.insert(queue.end(), orbits.begin(), orbits.end());
+    sort(queue.begin(), queue.end(),
+        [](const QueuedOrbit& a, const QueuedOrbit& b)
+        {
+            return a.escape_iteration > b.escape_iteration;
+        }
+    );
+
+    if (banded)
+    {
+        scheduler.parallel_for(0, queue.size(), 1,
+            [&](size_t first, size_t last)
+            {
+                auto outgoing = vector<SplatBatch*>(band_count, nullptr);
+                for (auto o = first; o < last; ++o) record_banded(queue[o], outgoing);
+                for (unsigned b = 0; b < band_count; ++b)
+                {
+                    if (outgoing[b] != nullptr) post(b, outgoing[b]);
+                }
+            }
+        );
+    }
+    else
+    {
+        scheduler.parallel_for(0, queue.size(), 1,
+            [&](size_t first, size_t last)
+            {
+                for (auto o = first; o < last; ++o) record(queue[o]);
+            }
+        );
+    }
+
+    samples_taken += points_per_iteration;
+}
+
+void CpuBuddhabrotGenerator::record(const QueuedOrbit& orbit)
+{
+    auto* canvas = node_canvas();
+    auto z = Complex<float>(0, 0);
+    auto pixel = concurrency::index<2>();
+    for (unsigned j = 0; j < orbit.escape_iteration; ++j)
+    {
+        z = orbit.c + (z * z);
+        if (j < FIRST_RECORDED_ITERATION) continue;
+
+        // as on the accelerator, each point's conjugate is recorded too
+        if (transform.to_pixel(z, pixel)) canvas[cell_index(pixel)].fetch_add(1, memory_order_relaxed);
+        if (transform.to_pixel(z.conjugate(), pixel)) canvas[cell_index(pixel)].fetch_add(1, memory_order_relaxed);
+    }
+}
+
+void CpuBuddhabrotGenerator::set_banded(bool banded)
+{
+    this->banded = banded;
+}
+
+// points are gathered per band in batches local to the producing task & only the full batches cross threads
+void CpuBuddhabrotGenerator::record_banded(const QueuedOrbit& orbit, vector<SplatBatch*>& outgoing)
+{
+    auto route = [&](const concurrency::index<2>& pixel)
+    {
+        const auto band = unsigned(pixel[0]) / band_rows;
+        auto*& batch = outgoing[band];
+        if (batch == nullptr)
+        {
+            batch = new SplatBatch;
+            batch->count = 0;
+        }
+
+        batch->cells[batch->count++] = cell_index(pixel);
+        if (batch->count == BATCH_CELLS)
+        {
+            post(band, batch);
+            batch = nullptr;
+        }
+    };
+
+    auto z = Complex<float>(0, 0);
+    auto pixel = concurrency::index<2>();
+    for (unsigned j = 0; j < orbit.escape_iteration; ++j)
+    {
+        z = orbit.c + (z * z);
+        if (j < FIRST_RECORDED_ITERATION) continue;
+
+        if (transform.to_pixel(z, pixel)) route(pixel);
+        if (transform.to_pixel(z.conjugate(), pixel)) route(pixel);
+    }
+}
+
+void CpuBuddhabrotGenerator::post(unsigned band, SplatBatch* batch)
+{
+    auto& target = bands[band];
+    batch->next = target.inbox.load();
+    while (!target.inbox.compare_exchange_weak(batch->next, batch))
+    {
+    }
+
+    drain(target);
+}
+
+// whoever posts to a band nobody owns becomes its owner until the inbox is empty. the inbox is checked again after
+//  giving up ownership, since a batch pushed while the owner was finishing would otherwise sit there unapplied
+void CpuBuddhabrotGenerator::drain(Band& band)
+{
+    for (;;)
+    {
+        if (band.owned.exchange(true)) return;
+
+        for (auto* batch = band.inbox.exchange(nullptr); batch != nullptr; )
+        {
+            scatter_increment(owned_counts(), batch->cells, batch->count);
+
+            auto* next = batch->next;
+            delete batch;
+            batch = next;
+        }
+
+        band.owned.store(false);
+        if (band.inbox.load() == nullptr) return;
+    }
+}
+
+void CpuBuddhabrotGenerator::set_pipelined(bool pipelined, unsigned producers)
+{
+    this->pipelined = pipelined;
+    max_producers = producers == 0 ? scheduler.get_worker_count() : min(producers, scheduler.get_worker_count());
+    if (pipelined && rings == nullptr)
+    {
+        const auto count = size_t(scheduler.get_worker_count()) * band_count;
+        ring_memory = HostBuffer(count * sizeof(CellRing), memory.pages, -1, memory.placement == MemoryPlacement::interleave);
+        rings = construct_in<CellRing>(ring_memory, count, 1, scheduler);
+    }
+}
+
+// one task per worker, each of which produces while its rings have room & consumes otherwise. any one of them can
+//  finish the whole batch alone, so nothing waits on a task the scheduler hasn't started
+void CpuBuddhabrotGenerator::iterate_pipelined(unsigned seed)
+{
+    const auto chunks = (size_t(points_per_iteration) + SAMPLES_PER_TASK - 1) / SAMPLES_PER_TASK;
+    const auto workers = scheduler.get_worker_count();
+    next_chunk = 0;
+
+    scheduler.parallel_for(0, workers, 1,
+        [&](size_t first, size_t last)
+        {
+            for (auto worker = unsigned(first); worker < last; ++worker)
+            {
+                for (;;)
+                {
+                    // queued cells waiting on this worker's rings, the signal to stop producing for a while
+                    auto backlog = size_t();
+                    for (unsigned b = 0; b < band_count; ++b)
+                    {
+                        const auto& ring = rings[size_t(worker) * band_count + b];
+                        backlog += ring.tail.load(memory_order_relaxed) - ring.head.load(memory_order_relaxed);
+                    }
+
+                    if (backlog < size_t(RING_CELLS) * band_count / 2 && next_chunk.load() < chunks)
+                    {
+                        if (active_producers.fetch_add(1) < max_producers)
+                        {
+                            const auto chunk = next_chunk++;
+                            if (chunk < chunks) produce(chunk, seed, worker);
+                            --active_producers;
+                            continue;
+                        }
+                        --active_producers;
+                    }
+
+                    auto consumed = false;
+                    for (unsigned b = 0; b < band_count; ++b) consumed |= consume((worker + b) % band_count);
+
+                    // done once sampling is over, no producer can still push & a full pass found every ring empty
+                    if (!consumed && next_chunk.load() >= chunks && active_producers.load() == 0)
+                    {
+                        auto empty = true;
+                        for (unsigned b = 0; b < band_count; ++b) empty = !consume(b) && empty;
+                        if (empty) break;
+                    }
+                    else if (!consumed)
+                    {
+                        this_thread::yield();
+                    }
+                }
+            }
+        }
+    );
+}
+
+void CpuBuddhabrotGenerator::produce(size_t chunk, unsigned seed, unsigned producer)
+{
+    const auto min_iterations = get<0>(iteration_range);
+    const auto max_iterations = get<1>(iteration_range);
+    auto* producer_rings = &rings[size_t(producer) * band_count];
+
+    auto push = [&](const concurrency::index<2>& pixel)
+    {
+        const auto band = unsigned(pixel[0]) / band_rows;
+        auto& ring = producer_rings[band];
+        const auto tail = ring.tail.load(memory_order_relaxed);
+        while (tail - ring.head.load(memory_order_acquire) == RING_CELLS)
+        {
+            // full: empty it ourselves if the band is free, otherwise its owner is already on the way
+            if (!consume(band)) this_thread::yield();
+        }
+
+        ring.cells[tail % RING_CELLS] = cell_index(pixel);
+        ring.tail.store(tail + 1, memory_order_release);
+    };
+
+    auto engine = mt19937(seed + unsigned(chunk) * 0x9e3779b9u);
+    auto uniform = uniform_real_distribution<float>(-sample_radius, sample_radius);
+    const auto count = min(SAMPLES_PER_TASK, points_per_iteration - chunk * SAMPLES_PER_TASK);
+    for (size_t s = 0; s < count; ++s)
+    {
+        const auto c = Complex<float>(uniform(engine), uniform(engine));
+        if (in_cardioid_or_bulb(c)) continue;
+
+        const auto i = escape_iteration(c, max_iterations);
+        if (i >= max_iterations || i < min_iterations || i <= FIRST_RECORDED_ITERATION) continue;
+
+        auto z = Complex<float>(0, 0);
+        auto pixel = concurrency::index<2>();
+        for (unsigned j = 0; j < i; ++j)
+        {
+            z = c + (z * z);
+            if (j < FIRST_RECORDED_ITERATION) continue;
+
+            if (transform.to_pixel(z, pixel)) push(pixel);
+            if (transform.to_pixel(z.conjugate(), pixel)) push(pixel);
+        }
+    }
+}
+
+// applies every ring feeding band if the band can be taken; false when it was owned or had nothing queued
+bool CpuBuddhabrotGenerator::consume(unsigned band)
+{
+    auto& owner = bands[band];
+    if (owner.owned.exchange(true)) return false;
+
+    auto consumed = false;
+    for (unsigned p = 0; p < scheduler.get_worker_count(); ++p)
+    {
+        auto& ring = rings[size_t(p) * band_count + band];
+        const auto head = ring.head.load(memory_order_relaxed);
+        const auto tail = ring.tail.load(memory_order_acquire);
+
+        // the queued cells are at most two runs, either side of the ring's wrap
+        const auto start = head % RING_CELLS;
+        const auto to_wrap = RING_CELLS - start;
+        const auto first_run = min(tail - head, to_wrap);
+        scatter_increment(owned_counts(), ring.cells + start, first_run);
+        scatter_increment(owned_counts(), ring.cells, tail - head - first_run);
+        ring.head.store(tail, memory_order_release);
+        consumed |= head != tail;
+    }
+
+    owner.owned.store(false);
+    return consumed;
+}
+
+// workers are pinned, so each keeps to one replica; a thread that isn't (the caller helping out in parallel_for)
+//  may switch between them, which is harmless as every replica is only summed in the end
+atomic<unsigned>* CpuBuddhabrotGenerator::node_canvas() const
+{
+    return canvases.size() == 1 ? canvases[0] : canvases[current_numa_node() % canvases.size()];
+}
+
+// the owner of a band is its only writer (across every replica), so it increments through plain pointers rather
+//  than atomics
+unsigned* CpuBuddhabrotGenerator::owned_counts()
+{
+    static_assert(sizeof(atomic<unsigned>) == sizeof(unsigned), "atomic<unsigned> is expected to be a bare unsigned");
+    return reinterpret_cast<unsigned*>(node_canvas());
+}
+
+unsigned CpuBuddhabrotGenerator::cell_index(const concurrency::index<2>& pixel) const
+{
+    const auto y = unsigned(pixel[0]);
+    const auto x = unsigned(pixel[1]);
+    return layout == CanvasLayout::row_major ? y * unsigned(dims[1]) + x : morton_tile_cell(y, x, tiles_across);
+}
+
+// converts back to row major on the way out, summing the replicas, so nothing downstream knows about the layout or
+//  placement
+void CpuBuddhabrotGenerator::copy_to(concurrency::array<unsigned, 2>& destination) const
+{
+    const auto width = unsigned(dims[1]);
+    auto counts = vector<unsigned>(dims.size());
+    scheduler.parallel_for(0, dims[0], 16,
+        [&](size_t first, size_t last)
+        {
+            for (auto y = first; y < last; ++y)
+            {
+                auto* row = counts.data() + y * width;
+                for (unsigned x = 0; x < width; ++x)
+                {
+                    const auto cell = cell_index(concurrency::index<2>(int(y), int(x)));
+                    row[x] = 0;
+                    for (const auto* canvas : canvases) row[x] += canvas[cell].load(memory_order_relaxed);
+                }
+            }
+        }
+    );
+    concurrency::copy(counts.begin(), counts.end(), destination);
+}
@@ -0,0 +1,162 @@
+#ifndef _CPU_GENERATOR_H_
+#define _CPU_GENERATOR_H_
+
+#include <atomic>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include <amp.h>
+
+#include "viewport.h"
+#include "host_memory.h"
+
+class TaskScheduler;
+
+// how canvas cells are ordered in host memory; copy_to always produces row major counts
+enum class CanvasLayout
+{
+    row_major,
+    // 64x64 tiles one after another, with the cells of a tile in Morton (Z) order. successive orbit points mostly
+    //  land within a few tiles of each other, & a tile is 16KB, so they share pages & often cache lines where row
+    //  major storage puts every row change a full canvas width away
+    morton_tiles
+};
+
+const unsigned MORTON_TILE_BITS = 6;
+
+// where cell (y, x) of a canvas tiles_across tiles wide is stored under CanvasLayout::morton_tiles: the tile's
+//  position in row major order of tiles, then y & x interleaved within it (y in the odd bits)
+inline unsigned morton_tile_cell(unsigned y, unsigned x, unsigned tiles_across)
+{
+    // spreads the low MORTON_TILE_BITS bits of v to the even bit positions
+    const auto spread_bits = [](unsigned v)
+    {
+        v = (v | v << 4) & 0x0f0f0f0f;
+        v = (v | v << 2) & 0x33333333;
+        v = (v | v << 1) & 0x55555555;
+        return v;
+    };
+
+    const auto mask = (1u << MORTON_TILE_BITS) - 1;
+    const auto tile = (y >> MORTON_TILE_BITS) * tiles_across + (x >> MORTON_TILE_BITS);
+    return tile << (2 * MORTON_TILE_BITS) | spread_bits(y & mask) << 1 | spread_bits(x & mask);
+}
+
+// the same sampling & recording as BuddhabrotGenerator (one viewport, none of the optional stages) with the canvas
+//  in host memory & the work spread over a TaskScheduler, for machines where the accelerator is a poor fit or is
+//  busy with something else
+class CpuBuddhabrotGenerator
+{
+    public:
+        CpuBuddhabrotGenerator(concurrency::extent<2> dimensions, unsigned points_per_iteration, std::tuple<unsigned, unsigned> iteration_range,
+            const Viewport& viewport, float sample_radius, TaskScheduler& scheduler, CanvasLayout layout = CanvasLayout::row_major,
+            const HostMemorySettings& memory = HostMemorySettings());
+
+        void iterate();
+        // routes orbit points to the owner of their band of canvas rows rather than incrementing shared atomics,
+        //  which stops scaling once enough workers contend for the bright cells along the real axis
+        void set_banded(bool banded);
+        // runs sampling & recording as a pipeline instead of one pass after the other: producers escape test &
+        //  iterate orbits, streaming cell indices through ring buffers to consumers that own bands of the canvas.
+        //  producers caps how many workers produce at once; 0 lets each worker switch roles on its rings' depth
+        void set_pipelined(bool pipelined, unsigned producers = 0);
+        // uploads the canvas so the accelerator side stages (display, previews, outputs) can consume it unchanged
+        void copy_to(concurrency::array<unsigned, 2>& destination) const;
+
+        std::tuple<unsigned, unsigned> get_iteration_range() const
+        {
+            return iteration_range;
+        }
+        unsigned long long get_samples_taken() const
+        {
+            return samples_taken;
+        }
+        const Viewport& get_viewport() const
+        {
+            return viewport;
+        }
+        // what backs the canvas, which may be smaller than asked for (see HostBuffer)
+        PageSize get_page_size() const
+        {
+            return canvas_memory[0].get_page_size();
+        }
+
+    private:
+        struct QueuedOrbit
+        {
+            Complex<float> c;
+            unsigned escape_iteration;
+        };
+
+        // cell indices bound for one band, filled by a single producer & handed over whole
+        static const unsigned BATCH_CELLS = 1024;
+        struct SplatBatch
+        {
+            SplatBatch* next;
+            unsigned count;
+            unsigned cells[BATCH_CELLS];
+        };
+
+        // a band is owned by whichever worker holds owned; everyone else pushes batches onto its inbox for the
+        //  owner to apply, so its cells are only ever written by one thread at a time. padded to a cache line so
+        //  neighbouring bands don't contend
+        struct Band
+        {
+            std::atomic<SplatBatch*> inbox{ nullptr };
+            std::atomic<bool> owned{ false };
+            char padding[64 - sizeof(std::atomic<SplatBatch*>) - sizeof(std::atomic<bool>)];
+        };
+
+        // cell indices from one producer to one band, emptied by whoever owns the band
+        static const unsigned RING_CELLS = 1 << 12;
+        struct CellRing
+        {
+            std::atomic<unsigned> head{ 0 };
+            char head_padding[64 - sizeof(std::atomic<unsigned>)];
+            std::atomic<unsigned> tail{ 0 };
+            char tail_padding[64 - sizeof(std::atomic<unsigned>)];
+            unsigned cells[RING_CELLS];
+        };
+
+        void record(const QueuedOrbit& orbit);
+        void record_banded(const QueuedOrbit& orbit, std::vector<SplatBatch*>& outgoing);
+        void post(unsigned band, SplatBatch* batch);
+        void drain(Band& band);
+        void iterate_pipelined(unsigned seed);
+        void produce(size_t chunk, unsigned seed, unsigned producer);
+        bool consume(unsigned band);
+        // the canvas the calling thread records into: its node's replica under MemoryPlacement::replicate
+        std::atomic<unsigned>* node_canvas() const;
+        unsigned* owned_counts();
+        unsigned cell_index(const concurrency::index<2>& pixel) const;
+
+        const concurrency::extent<2> dims;
+        const unsigned points_per_iteration;
+        const std::tuple<unsigned, unsigned> iteration_range;
+        const Viewport viewport;
+        const ViewportTransform transform;
+        const float sample_radius;
+        TaskScheduler& scheduler;
+        const CanvasLayout layout;
+        const unsigned tiles_across;
+        const HostMemorySettings memory;
+        std::vector<HostBuffer> canvas_memory;
+        std::vector<std::atomic<unsigned>*> canvases;
+        unsigned long long samples_taken{ 0 };
+        unsigned batches{ 0 };
+
+        unsigned band_count;
+        unsigned band_rows;
+        std::unique_ptr<Band[]> bands;
+        bool banded{ false };
+
+        bool pipelined{ false };
+        unsigned max_producers{ 0 };
+        HostBuffer ring_memory;
+        CellRing* rings{ nullptr };
+        std::atomic<size_t> next_chunk{ 0 };
+        std::atomic<unsigned> active_producers{ 0 };
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _DOUBLE_FLOAT_H_
+#define _DOUBLE_FLOAT_H_
+
+#include <amp.h>
+
+// an unevaluated sum hi + lo of two floats with |lo| at most half an ulp of hi, good for about 44 bits of
+//  significand from float arithmetic alone: for accelerators without doubles, or where doubles run at a small
+//  fraction of float rate. the error terms come from Knuth's two-sum & Dekker's product splitting, which rely on
+//  every float operation being rounded as written (the project builds with /fp:precise)
+struct DoubleFloat
+{
+    DoubleFloat(float value) restrict(cpu, amp) : hi(value), lo(0.0f)
+    {
+    }
+
+    DoubleFloat(float hi, float lo) restrict(cpu, amp) : hi(hi), lo(lo)
+    {
+    }
+
+    explicit operator float() const restrict(cpu, amp)
+    {
+        return hi + lo;
+    }
+
+    DoubleFloat operator-() const restrict(cpu, amp)
+    {
+        return DoubleFloat(-hi, -lo);
+    }
+
+    DoubleFloat operator+(const DoubleFloat& other) const restrict(cpu, amp)
+    {
+        auto sum = two_sum(hi, other.hi);
+        sum.lo += lo + other.lo;
+        return normalise(sum.hi, sum.lo);
+    }
+
+    DoubleFloat operator-(const DoubleFloat& other) const restrict(cpu, amp)
+    {
+        return *this + -other;
+    }
+
+    DoubleFloat operator*(const DoubleFloat& other) const restrict(cpu, amp)
+    {
+        auto product = two_product(hi, other.hi);
+        product.lo += hi * other.lo + lo * other.hi;
+        return normalise(product.hi, product.lo);
+    }
+
+    bool operator<(const DoubleFloat& other) const restrict(cpu, amp)
+    {
+        return hi < other.hi || (hi == other.hi && lo < other.lo);
+    }
+
+    bool operator>=(const DoubleFloat& other) const restrict(cpu, amp)
+    {
+        return !(*this < other);
+    }
+
+    // a + b exactly, for any a & b
+    static DoubleFloat two_sum(float a, float b) restrict(cpu, amp)
+    {
+        const auto sum = a + b;
+        const auto b_part = sum - a;
+        return DoubleFloat(sum, (a - (sum - b_part)) + (b - b_part));
+    }
+
+    // a + b exactly when |a| >= |b|
+    static DoubleFloat normalise(float a, float b) restrict(cpu, amp)
+    {
+        const auto sum = a + b;
+        return DoubleFloat(sum, b - (sum - a));
+    }
+
+    // a * b exactly, splitting both into 12 bit halves whose products are exact in float
+    static DoubleFloat two_product(float a, float b) restrict(cpu, amp)
+    {
+        const auto split = 4097.0f;
+        const auto a_scaled = split * a;
+        const auto a_hi = a_scaled - (a_scaled - a);
+        const auto a_lo = a - a_hi;
+        const auto b_scaled = split * b;
+        const auto b_hi = b_scaled - (b_scaled - b);
+        const auto b_lo = b - b_hi;
+
+        const auto product = a * b;
+        return DoubleFloat(product, ((a_hi * b_hi - product) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo);
+    }
+
+    float hi;
+    float lo;
+};
+
+#endif
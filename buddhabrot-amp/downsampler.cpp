@@ -0,0 +1,127 @@
+#include <algorithm>
+
+#include <amp.h>
+#include <amp_math.h>
+
+#include "downsampler.h"
+
+using namespace std;
+
+namespace
+{
+    const int TILE = 16;
+    const int LANCZOS_LOBES = 3;
+
+    float lanczos(float x) restrict(amp)
+    {
+        const auto lobes = float(LANCZOS_LOBES);
+        if (x == 0.0f) return 1.0f;
+        if (x <= -lobes || x >= lobes) return 0.0f;
+
+        const auto pi_x = 3.14159265f * x;
+        return lobes * concurrency::fast_math::sin(pi_x) * concurrency::fast_math::sin(pi_x / lobes) / (pi_x * pi_x);
+    }
+
+    // launched in 16x16 tiles so each tile's source footprint is a compact block that stays in cache
+    concurrency::array<unsigned, 2> reduce_box(const concurrency::array<unsigned, 2>& source, concurrency::extent<2> target)
+    {
+        const auto source_extent = source.get_extent();
+        auto result = concurrency::array<unsigned, 2>(target, source.accelerator_view);
+
+        parallel_for_each(target.tile<TILE, TILE>().pad(),
+            [=, &source, &result](concurrency::tiled_index<TILE, TILE> tidx) restrict(amp)
+            {
+                const auto idx = tidx.global;
+                if (!target.contains(idx)) return;
+
+                const auto y0 = idx[0] * source_extent[0] / target[0];
+                const auto y1 = (idx[0] + 1) * source_extent[0] / target[0];
+                const auto x0 = idx[1] * source_extent[1] / target[1];
+                const auto x1 = (idx[1] + 1) * source_extent[1] / target[1];
+
+                auto sum = 0u;
+                for (auto y = y0; y < y1; ++y)
+                {
+                    for (auto x = x0; x < x1; ++x)
+                    {
+                        sum += source[concurrency::index<2>(y, x)];
+                    }
+                }
+                result[idx] = sum;
+            }
+        );
+
+        return result;
+    }
+
+    // one separable pass along dimension axis. weights are normalised & then scaled by the reduction ratio so the
+    //  pass sums counts rather than averaging them
+    template<int axis, typename Source> concurrency::array<float, 2> lanczos_pass(const Source& source, concurrency::extent<2> target)
+    {
+        const auto source_extent = source.get_extent();
+        const auto ratio = float(source_extent[axis]) / target[axis];
+        const auto filter_scale = ratio > 1.0f ? ratio : 1.0f;
+        const auto support = LANCZOS_LOBES * filter_scale;
+
+        auto result = concurrency::array<float, 2>(target, source.accelerator_view);
+
+        parallel_for_each(target.tile<TILE, TILE>().pad(),
+            [=, &source, &result](concurrency::tiled_index<TILE, TILE> tidx) restrict(amp)
+            {
+                const auto idx = tidx.global;
+                if (!target.contains(idx)) return;
+
+                const auto center = (idx[axis] + 0.5f) * ratio - 0.5f;
+                auto first = int(concurrency::fast_math::ceil(center - support));
+                auto last = int(concurrency::fast_math::floor(center + support));
+                first = first < 0 ? 0 : first;
+                last = last >= source_extent[axis] ? source_extent[axis] - 1 : last;
+
+                auto weighted = 0.0f;
+                auto weight_sum = 0.0f;
+                auto source_idx = idx;
+                for (auto s = first; s <= last; ++s)
+                {
+                    source_idx[axis] = s;
+                    const auto weight = lanczos((s - center) / filter_scale);
+                    weighted += weight * static_cast<float>(source[source_idx]);
+                    weight_sum += weight;
+                }
+                result[idx] = weight_sum > 0.0f ? weighted / weight_sum * ratio : 0.0f;
+            }
+        );
+
+        return result;
+    }
+
+    concurrency::array<unsigned, 2> reduce_lanczos(const concurrency::array<unsigned, 2>& source, concurrency::extent<2> target)
+    {
+        // horizontal first so the wide intermediate is only target width across
+        const auto horizontal = lanczos_pass<1>(source, concurrency::extent<2>(source.get_extent()[0], target[1]));
+        const auto vertical = lanczos_pass<0>(horizontal, target);
+
+        auto result = concurrency::array<unsigned, 2>(target, source.accelerator_view);
+        parallel_for_each(target,
+            [&](concurrency::index<2> idx) restrict(amp)
+            {
+                // negative lobes can undershoot next to bright edges
+                const auto value = vertical[idx];
+                result[idx] = value > 0.0f ? static_cast<unsigned>(value + 0.5f) : 0u;
+            }
+        );
+
+        return result;
+    }
+}
+
+concurrency::array<unsigned, 2> reduce_counts(const concurrency::array<unsigned, 2>& source, concurrency::extent<2> target, ReductionFilter filter)
+{
+    return filter == ReductionFilter::lanczos ? reduce_lanczos(source, target) : reduce_box(source, target);
+}
+
+concurrency::extent<2> reduced_extent(concurrency::extent<2> source, unsigned longest_side)
+{
+    const auto longest = unsigned(max(source[0], source[1]));
+    const auto scale = min(1.0, double(longest_side) / longest);
+    return concurrency::extent<2>(max(1, int(source[0] * scale)), max(1, int(source[1] * scale)));
+}
@@ -0,0 +1,19 @@
+#ifndef _DOWNSAMPLER_H_
+#define _DOWNSAMPLER_H_
+
+#include <amp.h>
+
+enum class ReductionFilter
+{
+    box,
+    lanczos
+};
+
+// reduces a canvas of counts to target on the canvas' accelerator. both filters preserve the total count, so a
+//  supersampled canvas tone maps the same as one rendered at the target size with the same number of samples
+concurrency::array<unsigned, 2> reduce_counts(const concurrency::array<unsigned, 2>& source, concurrency::extent<2> target, ReductionFilter);
+
+// target with the longer side of source scaled down to longest_side; never larger than source
+concurrency::extent<2> reduced_extent(concurrency::extent<2> source, unsigned longest_side);
+
+#endif
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cstring>
+
+#define NOMINMAX
+#include <windows.h>
+
+#include "frontier_file.h"
+
+using namespace std;
+
+namespace
+{
+    const char FRONTIER_FILE_MAGIC[8] = { 'B', 'B', 'F', 'R', 'O', 'N', 'T', '\0' };
+    const uint32_t FRONTIER_FILE_VERSION = 1;
+
+    struct FrontierFileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t iterations;
+        uint64_t count;
+    };
+}
+
+FrontierWriter::FrontierWriter(const wstring& filename, uint32_t iterations) :
+    file(CreateFileW(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr)),
+    iterations(iterations)
+{
+    write_header();
+}
+
+void FrontierWriter::append(const vector<FrontierPoint>& points)
+{
+    if (points.empty()) return;
+
+    write_file_at(file.handle, sizeof(FrontierFileHeader) + count * sizeof(FrontierPoint), points.data(), points.size() * sizeof(FrontierPoint));
+    count += points.size();
+    write_header();
+}
+
+void FrontierWriter::write_header()
+{
+    auto header = FrontierFileHeader();
+    copy(begin(FRONTIER_FILE_MAGIC), end(FRONTIER_FILE_MAGIC), header.magic);
+    header.version = FRONTIER_FILE_VERSION;
+    header.iterations = iterations;
+    header.count = count;
+    write_file_at(file.handle, 0, &header, sizeof(header));
+}
+
+FrontierReader::FrontierReader(const wstring& filename) :
+    file(CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr)),
+    mapping(CreateFileMappingW(file.handle, nullptr, PAGE_READONLY, 0, 0, nullptr), nullptr),
+    data(static_cast<const uint8_t*>(MapViewOfFile(mapping.handle, FILE_MAP_READ, 0, 0, 0)))
+{
+    throw_hresult_on_failure(data == nullptr ? last_win32_error() : S_OK);
+
+    auto file_size = LARGE_INTEGER();
+    throw_hresult_on_failure(GetFileSizeEx(file.handle, &file_size) ? S_OK : last_win32_error());
+
+    const auto bad_format = HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    auto header = FrontierFileHeader();
+    throw_hresult_on_failure(uint64_t(file_size.QuadPart) < sizeof(header) ? bad_format : S_OK);
+    memcpy(&header, data, sizeof(header));
+    throw_hresult_on_failure(memcmp(header.magic, FRONTIER_FILE_MAGIC, sizeof(FRONTIER_FILE_MAGIC)) != 0 || header.version != FRONTIER_FILE_VERSION ? bad_format : S_OK);
+    throw_hresult_on_failure(sizeof(header) + header.count * sizeof(FrontierPoint) > uint64_t(file_size.QuadPart) ? bad_format : S_OK);
+
+    iterations = header.iterations;
+    count = header.count;
+}
+
+FrontierReader::~FrontierReader()
+{
+    UnmapViewOfFile(data);
+}
+
+void FrontierReader::for_each_batch(size_t batch_size, const function<void(const FrontierPoint*, size_t)>& consume) const
+{
+    const auto* points = reinterpret_cast<const FrontierPoint*>(data + sizeof(FrontierFileHeader));
+    for (uint64_t first = 0; first < count; first += batch_size)
+    {
+        consume(points + first, static_cast<size_t>(min<uint64_t>(batch_size, count - first)));
+    }
+}
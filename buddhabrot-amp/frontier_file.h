@@ -0,0 +1,63 @@
+#ifndef _FRONTIER_FILE_H_
+#define _FRONTIER_FILE_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "utilities.h"
+
+// an orbit parked at the iteration cap: its initial point & where it had got to
+struct FrontierPoint
+{
+    float c_r;
+    float c_i;
+    float z_r;
+    float z_i;
+};
+
+// frontier files are a header (the iteration every point is parked at & the point count) followed by packed
+//  FrontierPoints. the header is rewritten after every append so an interrupted run still leaves a usable file
+class FrontierWriter
+{
+    public:
+        FrontierWriter(const std::wstring& filename, uint32_t iterations);
+
+        void append(const std::vector<FrontierPoint>& points);
+
+    private:
+        void write_header();
+
+        FileHandle file;
+        const uint32_t iterations;
+        uint64_t count{ 0 };
+};
+
+class FrontierReader
+{
+    public:
+        FrontierReader(const std::wstring& filename);
+        ~FrontierReader();
+
+        uint32_t get_iterations() const
+        {
+            return iterations;
+        }
+        uint64_t get_count() const
+        {
+            return count;
+        }
+
+        // hands out the mapped points batch_size at a time
+        void for_each_batch(size_t batch_size, const std::function<void(const FrontierPoint*, size_t)>& consume) const;
+
+    private:
+        FileHandle file;
+        FileHandle mapping;
+        const uint8_t* data;
+        uint32_t iterations;
+        uint64_t count;
+};
+
+#endif
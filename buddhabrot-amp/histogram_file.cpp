@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <climits>
+
+#define NOMINMAX
+#include <windows.h>
+
+#include "utilities.h"
+#include "histogram_file.h"
+#include "bucketed_histogram.h"
+
+using namespace std;
+
+namespace
+{
+    const char HISTOGRAM_FILE_MAGIC[8] = { 'B', 'B', 'H', 'I', 'S', 'T', '\0', '\0' };
+
+    uint64_t align_up(uint64_t value)
+    {
+        return (value + HISTOGRAM_FILE_ALIGNMENT - 1) / HISTOGRAM_FILE_ALIGNMENT * HISTOGRAM_FILE_ALIGNMENT;
+    }
+
+    struct MappedView
+    {
+        MappedView(HANDLE mapping) : data(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0))
+        {
+            throw_hresult_on_failure(data == nullptr ? last_win32_error() : S_OK);
+        }
+
+        ~MappedView()
+        {
+            UnmapViewOfFile(data);
+        }
+
+        const BYTE* bytes() const
+        {
+            return static_cast<const BYTE*>(data);
+        }
+
+        void* data;
+    };
+
+    bool known_data_type(HistogramDataType data_type)
+    {
+        return data_type == HistogramDataType::uint32 || data_type == HistogramDataType::float32;
+    }
+
+    HistogramFileHeader make_header(concurrency::extent<2> extent, const Viewport& viewport, size_t channel_count, uint32_t flags, HistogramDataType data_type)
+    {
+        throw_hresult_on_failure(channel_count == 0 || channel_count > HISTOGRAM_FILE_MAX_CHANNELS || !known_data_type(data_type) ? E_INVALIDARG : S_OK);
+
+        auto header = HistogramFileHeader();
+        copy(begin(HISTOGRAM_FILE_MAGIC), end(HISTOGRAM_FILE_MAGIC), header.magic);
+        header.version = HISTOGRAM_FILE_VERSION;
+        header.header_size = sizeof(HistogramFileHeader);
+        header.width = extent[1];
+        header.height = extent[0];
+        header.channel_count = static_cast<uint32_t>(channel_count);
+        header.data_type = data_type;
+        header.flags = flags;
+        header.viewport = viewport;
+
+        const auto channel_bytes = uint64_t(extent[0]) * extent[1] * sizeof(unsigned);
+        auto offset = align_up(sizeof(HistogramFileHeader));
+        for (size_t c = 0; c < channel_count; ++c)
+        {
+            header.channels[c].data_offset = offset;
+            offset = align_up(offset + channel_bytes);
+        }
+        return header;
+    }
+
+    // fetch(c) returns the counts of channel c; the ranges & samples must already be in header
+    template<typename Fetch> void write_file(const wstring& filename, const HistogramFileHeader& header, Fetch fetch)
+    {
+        auto file = FileHandle(CreateFileW(filename.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+        write_file_at(file.handle, 0, &header, sizeof(header));
+
+        // one staging buffer reused for every channel, & one for its conversion when writing floats
+        auto staging = vector<unsigned>(size_t(header.width) * header.height);
+        auto converted = vector<float>(header.data_type == HistogramDataType::float32 ? staging.size() : 0);
+        for (uint32_t c = 0; c < header.channel_count; ++c)
+        {
+            concurrency::copy(fetch(c), staging.begin());
+            if (header.data_type == HistogramDataType::float32)
+            {
+                transform(staging.begin(), staging.end(), converted.begin(),
+                    [](unsigned count)
+                    {
+                        return static_cast<float>(count);
+                    }
+                );
+                write_file_at(file.handle, header.channels[c].data_offset, converted.data(), converted.size() * sizeof(float));
+            }
+            else
+            {
+                write_file_at(file.handle, header.channels[c].data_offset, staging.data(), staging.size() * sizeof(unsigned));
+            }
+        }
+
+        // pad the tail so the last channel can be mapped in whole pages as well
+        auto end_position = LARGE_INTEGER();
+        end_position.QuadPart = static_cast<LONGLONG>(align_up(header.channels[header.channel_count - 1].data_offset + staging.size() * sizeof(unsigned)));
+        throw_hresult_on_failure(SetFilePointerEx(file.handle, end_position, nullptr, FILE_BEGIN) ? S_OK : last_win32_error());
+        throw_hresult_on_failure(SetEndOfFile(file.handle) ? S_OK : last_win32_error());
+    }
+}
+
+void write_histogram_file(const wstring& filename, const vector<HistogramChannelSource>& channels, const Viewport& viewport, HistogramDataType data_type)
+{
+    throw_hresult_on_failure(channels.empty() ? E_INVALIDARG : S_OK);
+
+    const auto extent = channels[0].counts->get_extent();
+    auto header = make_header(extent, viewport, channels.size(), 0, data_type);
+    for (size_t c = 0; c < channels.size(); ++c)
+    {
+        throw_hresult_on_failure(channels[c].counts->get_extent() != extent ? E_INVALIDARG : S_OK);
+
+        header.channels[c].min_iterations = get<0>(channels[c].iteration_range);
+        header.channels[c].max_iterations = get<1>(channels[c].iteration_range);
+        header.channels[c].samples = channels[c].samples;
+    }
+
+    write_file(filename, header,
+        [&](uint32_t c) -> const concurrency::array<unsigned, 2>&
+        {
+            return *channels[c].counts;
+        }
+    );
+}
+
+void write_histogram_file(const wstring& filename, const BucketedHistogram& histogram, unsigned long long samples, const Viewport& viewport, HistogramDataType data_type)
+{
+    const auto& buckets = histogram.get_buckets();
+    auto header = make_header(histogram.get_extent(), viewport, buckets.count, HISTOGRAM_FILE_ESCAPE_BUCKETS, data_type);
+    for (unsigned b = 0; b < buckets.count; ++b)
+    {
+        const auto range = buckets.range(b);
+        header.channels[b].min_iterations = get<0>(range);
+        header.channels[b].max_iterations = get<1>(range);
+        header.channels[b].samples = samples;
+    }
+
+    auto composed = concurrency::array<unsigned, 2>(histogram.get_extent(), histogram.dense.accelerator_view);
+    write_file(filename, header,
+        [&](uint32_t b) -> const concurrency::array<unsigned, 2>&
+        {
+            histogram.compose_bucket(b, composed);
+            return composed;
+        }
+    );
+}
+
+vector<unsigned> compose_channel(const Histogram& histogram, tuple<unsigned, unsigned> iteration_range)
+{
+    auto result = vector<unsigned>(size_t(histogram.width) * histogram.height);
+    for (const auto& channel : histogram.channels)
+    {
+        const auto first = get<0>(channel.iteration_range);
+        if (first < get<0>(iteration_range) || first >= get<1>(iteration_range)) continue;
+
+        transform(result.begin(), result.end(), channel.counts.begin(), result.begin(), plus<unsigned>());
+    }
+    return result;
+}
+
+Histogram read_histogram_file(const wstring& filename)
+{
+    auto file = FileHandle(CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+
+    auto file_size = LARGE_INTEGER();
+    throw_hresult_on_failure(GetFileSizeEx(file.handle, &file_size) ? S_OK : last_win32_error());
+    throw_hresult_on_failure(uint64_t(file_size.QuadPart) < sizeof(HistogramFileHeader) ? HRESULT_FROM_WIN32(ERROR_BAD_FORMAT) : S_OK);
+
+    auto mapping = FileHandle(CreateFileMappingW(file.handle, nullptr, PAGE_READONLY, 0, 0, nullptr), nullptr);
+    const auto view = MappedView(mapping.handle);
+
+    auto header = HistogramFileHeader();
+    memcpy(&header, view.bytes(), sizeof(header));
+
+    const auto bad_format = HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    throw_hresult_on_failure(memcmp(header.magic, HISTOGRAM_FILE_MAGIC, sizeof(HISTOGRAM_FILE_MAGIC)) != 0 ? bad_format : S_OK);
+    throw_hresult_on_failure(header.version != HISTOGRAM_FILE_VERSION || header.header_size != sizeof(HistogramFileHeader) ? bad_format : S_OK);
+    throw_hresult_on_failure(header.channel_count == 0 || header.channel_count > HISTOGRAM_FILE_MAX_CHANNELS ? bad_format : S_OK);
+    throw_hresult_on_failure(!known_data_type(header.data_type) || header.width == 0 || header.height == 0 ? bad_format : S_OK);
+
+    // a channel can't be larger than the file, which also keeps the byte count below from overflowing
+    const auto size = uint64_t(file_size.QuadPart);
+    const auto element_count = uint64_t(header.width) * header.height;
+    throw_hresult_on_failure(element_count > size / 4 ? bad_format : S_OK);
+    const auto channel_bytes = element_count * 4;
+
+    auto histogram = Histogram();
+    histogram.width = header.width;
+    histogram.height = header.height;
+    histogram.flags = header.flags;
+    histogram.viewport = header.viewport;
+
+    for (uint32_t c = 0; c < header.channel_count; ++c)
+    {
+        const auto& info = header.channels[c];
+        throw_hresult_on_failure(info.data_offset > size || channel_bytes > size - info.data_offset ? bad_format : S_OK);
+
+        auto channel = HistogramChannel();
+        channel.iteration_range = make_tuple(info.min_iterations, info.max_iterations);
+        channel.samples = info.samples;
+        channel.counts.resize(static_cast<size_t>(element_count));
+
+        const auto* data = view.bytes() + info.data_offset;
+        if (header.data_type == HistogramDataType::float32)
+        {
+            const auto* values = reinterpret_cast<const float*>(data);
+            transform(values, values + element_count, channel.counts.begin(),
+                [](float v)
+                {
+                    // written so NaN fails the first test; 2^32 is the first float past UINT_MAX
+                    if (!(v > 0.0f)) return 0u;
+                    if (v >= 4294967296.0f) return UINT_MAX;
+                    return static_cast<unsigned>(v + 0.5f);
+                }
+            );
+        }
+        else
+        {
+            memcpy(channel.counts.data(), data, static_cast<size_t>(channel_bytes));
+        }
+
+        histogram.channels.push_back(move(channel));
+    }
+
+    return histogram;
+}
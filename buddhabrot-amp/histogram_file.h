@@ -0,0 +1,90 @@
+#ifndef _HISTOGRAM_FILE_H_
+#define _HISTOGRAM_FILE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <tuple>
+
+#include <amp.h>
+
+#include "viewport.h"
+
+// raw histogram files are a fixed size header followed by planar channel data; every channel starts on a
+//  HISTOGRAM_FILE_ALIGNMENT boundary so other tools can map a channel straight out of the file without copying
+const unsigned HISTOGRAM_FILE_ALIGNMENT = 4096;
+const unsigned HISTOGRAM_FILE_MAX_CHANNELS = 128;
+const unsigned HISTOGRAM_FILE_VERSION = 2;
+
+// set when the channels are disjoint escape iteration buckets rather than independently rendered ranges
+const uint32_t HISTOGRAM_FILE_ESCAPE_BUCKETS = 1;
+
+enum class HistogramDataType : uint32_t
+{
+    uint32 = 0,
+    float32 = 1
+};
+
+struct HistogramFileChannel
+{
+    uint32_t min_iterations;
+    uint32_t max_iterations;
+    uint64_t samples;
+    uint64_t data_offset;
+};
+
+struct HistogramFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channel_count;
+    HistogramDataType data_type;
+    uint32_t flags;
+    uint32_t reserved;
+    Viewport viewport;
+    HistogramFileChannel channels[HISTOGRAM_FILE_MAX_CHANNELS];
+};
+
+// what gets written for one channel; counts is expected to be height x width
+struct HistogramChannelSource
+{
+    const concurrency::array<unsigned, 2>* counts;
+    std::tuple<unsigned, unsigned> iteration_range;
+    unsigned long long samples;
+};
+
+struct HistogramChannel
+{
+    std::vector<unsigned> counts;
+    std::tuple<unsigned, unsigned> iteration_range;
+    unsigned long long samples;
+};
+
+struct Histogram
+{
+    unsigned width;
+    unsigned height;
+    uint32_t flags;
+    Viewport viewport;
+    std::vector<HistogramChannel> channels;
+};
+
+class BucketedHistogram;
+
+// float32 channels hold the counts converted to float, which are exact up to 2^24
+void write_histogram_file(const std::wstring& filename, const std::vector<HistogramChannelSource>& channels, const Viewport& viewport, HistogramDataType data_type);
+
+// one channel per escape iteration bucket, composed one at a time so only a single canvas is ever staged
+void write_histogram_file(const std::wstring& filename, const BucketedHistogram& histogram, unsigned long long samples, const Viewport& viewport, HistogramDataType data_type);
+
+// for files written from a BucketedHistogram; sums every bucket whose first iteration lies in iteration_range
+std::vector<unsigned> compose_channel(const Histogram& histogram, std::tuple<unsigned, unsigned> iteration_range);
+
+// float32 channels are rounded to the nearest count (negatives & NaN to 0, anything past the largest count clamped
+//  to it) so the result can go down the normal output path
+Histogram read_histogram_file(const std::wstring& filename);
+
+#endif
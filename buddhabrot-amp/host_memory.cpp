@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <utility>
+
+#define NOMINMAX
+#include <windows.h>
+
+#include "utilities.h"
+#include "host_memory.h"
+
+using namespace std;
+
+namespace
+{
+    // pages dealt to one node at a time when interleaving
+    const size_t INTERLEAVE_RUN = size_t(2) << 20;
+    const size_t HUGE_PAGE = size_t(1) << 30;
+    // 1GB pages are only used when rounding up to them wastes at most this share of the buffer; anything further from
+    //  a whole number of them takes 2MB pages instead
+    const size_t HUGE_PAGE_MAX_WASTE = 8;
+
+    // VirtualAlloc2 & its parameters, declared here since it is looked up at run time rather than linked
+    struct AllocationParameter
+    {
+        DWORD64 type;
+        DWORD64 value;
+    };
+    const DWORD64 PARAMETER_NUMA_NODE = 2;
+    const DWORD64 PARAMETER_ATTRIBUTE_FLAGS = 5;
+    const DWORD64 ATTRIBUTE_NONPAGED_HUGE = 0x10;
+    typedef PVOID (WINAPI *VirtualAlloc2Function)(HANDLE, PVOID, SIZE_T, ULONG, ULONG, AllocationParameter*, ULONG);
+
+    // large & huge pages need SeLockMemoryPrivilege enabled in the process token, which is only possible when the
+    //  account holds it; tried once
+    bool enable_lock_memory_privilege()
+    {
+        static const auto enabled = []()
+        {
+            HANDLE token = nullptr;
+            if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return false;
+
+            auto privileges = TOKEN_PRIVILEGES();
+            privileges.PrivilegeCount = 1;
+            privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+            auto result = LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+                AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+                GetLastError() == ERROR_SUCCESS;
+            CloseHandle(token);
+            return bool(result);
+        }();
+        return enabled;
+    }
+
+    size_t round_up(size_t value, size_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    void* allocate_huge(size_t bytes, int node)
+    {
+        static const auto virtual_alloc2 = reinterpret_cast<VirtualAlloc2Function>(GetProcAddress(GetModuleHandleW(L"kernelbase.dll"), "VirtualAlloc2"));
+        if (virtual_alloc2 == nullptr) return nullptr;
+
+        AllocationParameter parameters[2] = { { PARAMETER_ATTRIBUTE_FLAGS, ATTRIBUTE_NONPAGED_HUGE }, { PARAMETER_NUMA_NODE, DWORD64(max(node, 0)) } };
+        return virtual_alloc2(GetCurrentProcess(), nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE, parameters, node >= 0 ? 2 : 1);
+    }
+
+    void* allocate_large(size_t bytes, int node)
+    {
+        const auto type = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+        return node >= 0 ? VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, type, PAGE_READWRITE, DWORD(node)) : VirtualAlloc(nullptr, bytes, type, PAGE_READWRITE);
+    }
+
+    // the node given to a commit is where its pages go when first touched, so committing a reserved range in runs
+    //  gives each run its own node
+    void* allocate_normal(size_t bytes, int node, bool interleave)
+    {
+        if (node >= 0) return VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, DWORD(node));
+        if (!interleave || numa_node_count() < 2) return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+        auto* base = static_cast<char*>(VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_READWRITE));
+        if (base == nullptr) return nullptr;
+
+        const auto nodes = numa_node_count();
+        for (size_t offset = 0, run = 0; offset < bytes; offset += INTERLEAVE_RUN, ++run)
+        {
+            const auto length = min(INTERLEAVE_RUN, bytes - offset);
+            if (VirtualAllocExNuma(GetCurrentProcess(), base + offset, length, MEM_COMMIT, PAGE_READWRITE, DWORD(run % nodes)) == nullptr)
+            {
+                VirtualFree(base, 0, MEM_RELEASE);
+                return nullptr;
+            }
+        }
+        return base;
+    }
+}
+
+HostBuffer::HostBuffer(size_t bytes, PageSize pages, int node, bool interleave)
+{
+    // large pages only come whole & are placed when committed rather than on first touch, so interleaving keeps
+    //  normal pages & without a node they all land on the allocating thread's node
+    if (pages == PageSize::huge && !interleave && round_up(bytes, HUGE_PAGE) - bytes <= bytes / HUGE_PAGE_MAX_WASTE && enable_lock_memory_privilege())
+    {
+        this->bytes = round_up(bytes, HUGE_PAGE);
+        memory = allocate_huge(this->bytes, node);
+        this->pages = PageSize::huge;
+    }
+    if (memory == nullptr && pages != PageSize::normal && !interleave && enable_lock_memory_privilege() && GetLargePageMinimum() != 0)
+    {
+        this->bytes = round_up(bytes, GetLargePageMinimum());
+        memory = allocate_large(this->bytes, node);
+        this->pages = PageSize::large;
+    }
+    if (memory == nullptr)
+    {
+        this->bytes = bytes;
+        memory = allocate_normal(bytes, node, interleave);
+        this->pages = PageSize::normal;
+    }
+
+    throw_hresult_on_failure(memory == nullptr ? last_win32_error() : S_OK);
+}
+
+HostBuffer::HostBuffer(HostBuffer&& other) :
+    memory(other.memory),
+    bytes(other.bytes),
+    pages(other.pages)
+{
+    other.memory = nullptr;
+    other.bytes = 0;
+}
+
+HostBuffer& HostBuffer::operator=(HostBuffer&& other)
+{
+    swap(memory, other.memory);
+    swap(bytes, other.bytes);
+    swap(pages, other.pages);
+    return *this;
+}
+
+HostBuffer::~HostBuffer()
+{
+    if (memory != nullptr) VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+unsigned numa_node_count()
+{
+    auto highest = ULONG();
+    return GetNumaHighestNodeNumber(&highest) ? unsigned(highest) + 1 : 1;
+}
+
+unsigned current_numa_node()
+{
+    auto processor = PROCESSOR_NUMBER();
+    GetCurrentProcessorNumberEx(&processor);
+    auto node = USHORT();
+    return GetNumaProcessorNodeEx(&processor, &node) ? node : 0;
+}
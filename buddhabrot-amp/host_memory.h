@@ -0,0 +1,74 @@
+#ifndef _HOST_MEMORY_H_
+#define _HOST_MEMORY_H_
+
+#include <cstddef>
+
+// where the pages of a big host buffer go on a machine with several numa nodes
+enum class MemoryPlacement
+{
+    // on the node of whichever thread touches a page first; buffers are zeroed by the scheduler's pinned workers so
+    //  that is spread over every node they run on
+    first_touch,
+    // runs of pages dealt round robin across the nodes, so no node serves every access
+    interleave,
+    // like first_touch, plus a private copy of each histogram per node that the node's workers record into & that
+    //  is summed when the counts are read back
+    replicate
+};
+
+enum class PageSize
+{
+    normal,
+    // 2MB pages; need the "lock pages in memory" privilege. they are placed when allocated, not on first touch
+    large,
+    // 1GB pages; need the same privilege & windows 10 1803 or later, & are only used for buffers within an eighth
+    //  of a whole number of them
+    huge
+};
+
+struct HostMemorySettings
+{
+    MemoryPlacement placement{ MemoryPlacement::first_touch };
+    PageSize pages{ PageSize::normal };
+};
+
+// page aligned host memory straight from VirtualAlloc, committed but not yet touched. falls back to smaller pages
+//  when the requested size isn't available or would waste too much (get_page_size says what was used); node < 0
+//  leaves placement of normal pages to first touch unless interleave is set, while large pages go wherever the
+//  allocating thread's node has them
+class HostBuffer
+{
+    public:
+        HostBuffer() = default;
+        HostBuffer(size_t bytes, PageSize pages, int node = -1, bool interleave = false);
+        HostBuffer(HostBuffer&& other);
+        HostBuffer& operator=(HostBuffer&& other);
+        ~HostBuffer();
+
+        void* data() const
+        {
+            return memory;
+        }
+        size_t size() const
+        {
+            return bytes;
+        }
+        PageSize get_page_size() const
+        {
+            return pages;
+        }
+
+    private:
+        HostBuffer(const HostBuffer&) = delete;
+        HostBuffer& operator=(const HostBuffer&) = delete;
+
+        void* memory{ nullptr };
+        size_t bytes{ 0 };
+        PageSize pages{ PageSize::normal };
+};
+
+unsigned numa_node_count();
+// node of the processor the calling thread is running on; stable for the scheduler's pinned workers
+unsigned current_numa_node();
+
+#endif
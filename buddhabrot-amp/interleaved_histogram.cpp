@@ -0,0 +1,42 @@
+#include <amp.h>
+
+#include "utilities.h"
+#include "interleaved_histogram.h"
+
+using namespace std;
+
+namespace
+{
+    concurrency::array<unsigned, 3> zeroed_cells(concurrency::extent<2> dims, concurrency::accelerator_view accel_view)
+    {
+        auto result = concurrency::array<unsigned, 3>(dims[0], dims[1], InterleavedHistogram::CELL_STRIDE, accel_view);
+        parallel_for_each(result.get_extent(),
+            [&result](concurrency::index<3> idx) restrict(amp)
+            {
+                result[idx] = 0;
+            }
+        );
+        return result;
+    }
+}
+
+InterleavedHistogram::InterleavedHistogram(concurrency::accelerator_view accel_view, concurrency::extent<2> dims, const tuple<unsigned, unsigned> (&ranges)[3]) :
+    dims(dims),
+    ranges(ranges),
+    counts(zeroed_cells(dims, accel_view))
+{
+}
+
+void InterleavedHistogram::split(unsigned channel, concurrency::array<unsigned, 2>& output) const
+{
+    throw_hresult_on_failure(output.get_extent() != dims || channel >= 3 ? E_INVALIDARG : S_OK);
+
+    const auto& cells = counts;
+    const auto c = int(channel);
+    parallel_for_each(dims,
+        [=, &cells, &output](concurrency::index<2> idx) restrict(amp)
+        {
+            output[idx] = cells[concurrency::index<3>(idx[0], idx[1], c)];
+        }
+    );
+}
@@ -0,0 +1,70 @@
+#ifndef _INTERLEAVED_HISTOGRAM_H_
+#define _INTERLEAVED_HISTOGRAM_H_
+
+#include <tuple>
+
+#include <amp.h>
+
+// the escape iteration ranges of the three channels in a form the kernels can capture
+struct ChannelRanges
+{
+    ChannelRanges(const std::tuple<unsigned, unsigned> (&ranges)[3])
+    {
+        max_iterations = 1;
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            first[c] = std::get<0>(ranges[c]);
+            last[c] = std::get<1>(ranges[c]);
+            max_iterations = max_iterations > last[c] ? max_iterations : last[c];
+        }
+    }
+
+    // bit c set for every channel whose [first, last) holds escape_iteration
+    unsigned mask(unsigned escape_iteration) const restrict(cpu, amp)
+    {
+        auto result = 0u;
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            if (escape_iteration >= first[c] && escape_iteration < last[c]) result |= 1u << c;
+        }
+        return result;
+    }
+
+    unsigned first[3];
+    unsigned last[3];
+    unsigned max_iterations;
+};
+
+// all three channels in one array, a 16 byte RGBx cell per pixel, for a single generator recording every channel
+//  from the same orbits: the channels an orbit point lands in are updated within one cache line rather than in
+//  three separate canvases
+class InterleavedHistogram
+{
+    public:
+        static const int CELL_STRIDE = 4;
+
+        InterleavedHistogram(concurrency::accelerator_view, concurrency::extent<2> dimensions, const std::tuple<unsigned, unsigned> (&ranges)[3]);
+
+        concurrency::extent<2> get_extent() const
+        {
+            return dims;
+        }
+        const ChannelRanges& get_ranges() const
+        {
+            return ranges;
+        }
+
+        // copies one channel out for the stages that take planar counts; output must match get_extent
+        void split(unsigned channel, concurrency::array<unsigned, 2>& output) const;
+
+    private:
+        const concurrency::extent<2> dims;
+        const ChannelRanges ranges;
+
+    public:
+        // (row, column, channel); captured by reference in the recording kernel & read in place by the presenter
+        //  & png writer
+        concurrency::array<unsigned, 3> counts;
+};
+
+#endif
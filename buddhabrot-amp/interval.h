@@ -0,0 +1,52 @@
+#ifndef _INTERVAL_H_
+#define _INTERVAL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// a closed interval, rounded outwards after every operation so it always holds the exact result
+struct Interval
+{
+    static Interval outward(double lo, double hi)
+    {
+        return { std::nextafter(lo, -std::numeric_limits<double>::infinity()), std::nextafter(hi, std::numeric_limits<double>::infinity()) };
+    }
+
+    static Interval point(double value)
+    {
+        return { value, value };
+    }
+
+    Interval operator+(const Interval& other) const
+    {
+        return outward(lo + other.lo, hi + other.hi);
+    }
+
+    Interval operator-(const Interval& other) const
+    {
+        return outward(lo - other.hi, hi - other.lo);
+    }
+
+    Interval operator*(const Interval& other) const
+    {
+        const auto a = lo * other.lo;
+        const auto b = lo * other.hi;
+        const auto c = hi * other.lo;
+        const auto d = hi * other.hi;
+        return outward(std::min(std::min(a, b), std::min(c, d)), std::max(std::max(a, b), std::max(c, d)));
+    }
+
+    // tighter than *this * *this, which doesn't know both factors are the same value
+    Interval square() const
+    {
+        if (lo >= 0.0) return outward(lo * lo, hi * hi);
+        if (hi <= 0.0) return outward(hi * hi, lo * lo);
+        return { 0.0, std::nextafter(std::max(lo * lo, hi * hi), std::numeric_limits<double>::infinity()) };
+    }
+
+    double lo;
+    double hi;
+};
+
+#endif
@@ -3,6 +3,8 @@
 #include <algorithm>
 #include <random>
 #include <limits>
+#include <memory>
+#include <chrono>
 
 #define NOMINMAX
 #include <windows.h>
@@ -16,6 +18,19 @@
 #include "basic_window.h"
 #include "buddhabrot_presenter.h"
 #include "buddhabrot_generator.h"
+#include "histogram_file.h"
+#include "tone_mapping.h"
+#include "tiff_writer.h"
+#include "preview_writer.h"
+#include "downsampler.h"
+#include "viewport.h"
+#include "bucketed_histogram.h"
+#include "interleaved_histogram.h"
+#include "seed_log.h"
+#include "frontier_file.h"
+#include "cpu_generator.h"
+#include "task_scheduler.h"
+#include "scatter_increment.h"
 
 using namespace std;
 using concurrency::accelerator;
@@ -43,24 +58,296 @@ struct CommandLineArguments
         parser.ParseCLI(argc, argv);
         if (dimension_flag) dimension = args::get(dimension_flag);
         if (points_flag) points_per_iteration = args::get(points_flag);
-        if (filename_flag)
+        if (filename_flag) filename = widen(args::get(filename_flag));
+        if (raw_flag) raw_filename = widen(args::get(raw_flag));
+        if (load_raw_flag) load_raw_filename = widen(args::get(load_raw_flag));
+        raw_type = args::get(raw_type_flag);
+        interleaved = interleaved_flag;
+        if (escape_buckets_flag)
         {
-            wstringstream ss;
-            ss << args::get(filename_flag).c_str();
-            filename = ss.str();
+            escape_buckets = true;
+            bucket_sub_bits = args::get(escape_buckets_flag);
+            if (bucket_sub_bits > MAX_BUCKET_SUB_BITS) throw args::ParseError("--escape-buckets takes at most " + to_string(MAX_BUCKET_SUB_BITS) + " bits");
+        }
+        if (segment_flag) segment_length = args::get(segment_flag);
+        cpu = cpu_flag;
+        cpu_bands = cpu_bands_flag;
+        cpu_layout = args::get(cpu_layout_flag);
+        cpu_memory.placement = args::get(cpu_placement_flag);
+        cpu_memory.pages = args::get(cpu_pages_flag);
+        avx512_scatter = avx512_scatter_flag;
+        benchmark_scatter = benchmark_scatter_flag;
+        if (cpu_pipeline_flag)
+        {
+            cpu_pipeline = true;
+            cpu_producers = args::get(cpu_pipeline_flag);
+        }
+        save_frontier = save_frontier_flag;
+        if (deepen_flag) deepen_filename = widen(args::get(deepen_flag));
+        if (record_seeds_flag) record_seeds_filename = widen(args::get(record_seeds_flag));
+        if (replay_seeds_flag) replay_seeds_filename = widen(args::get(replay_seeds_flag));
+        if (tiff_flag) tiff_filename = widen(args::get(tiff_flag));
+        if (tile_size_flag) tiff.tile_size = args::get(tile_size_flag);
+        if (pyramid_flag) tiff.pyramid_levels = args::get(pyramid_flag);
+        if (preview_flag) preview_filename = widen(args::get(preview_flag));
+        if (preview_interval_flag) preview_interval = args::get(preview_interval_flag);
+        if (preview_size_flag) preview_size = args::get(preview_size_flag);
+        if (center_flag)
+        {
+            viewport.center_r = args::get(center_flag)[0];
+            viewport.center_i = args::get(center_flag)[1];
+        }
+        if (span_flag) viewport.span = args::get(span_flag);
+        if (rotation_flag) viewport.rotation = args::get(rotation_flag) * 3.14159265358979323846 / 180.0;
+        if (args::get(inset_flag).size() > MAX_VIEWPORTS - 1) throw args::ParseError("--inset can be given at most " + to_string(MAX_VIEWPORTS - 1) + " times");
+        for (const auto& inset : args::get(inset_flag))
+        {
+            // center real, center imaginary & span, comma separated
+            auto view = Viewport();
+            auto separator = ',';
+            auto stream = istringstream(inset);
+            stream >> view.center_r >> separator >> view.center_i >> separator >> view.span;
+            if (!stream || separator != ',') throw args::ParseError("--inset expects r,i,span but got " + inset);
+
+            view.rotation = viewport.rotation;
+            insets.push_back(view);
+        }
+        if (sample_radius_flag) sample_radius = args::get(sample_radius_flag);
+        if (supersample_flag) supersample = max(1u, args::get(supersample_flag));
+        filter = args::get(filter_flag);
+        thumbnails = args::get(thumbnail_flag);
+        tone_map.curve = args::get(tone_curve_flag);
+        if (gamma_flag) tone_map.gamma = args::get(gamma_flag);
+        if (clip_flag) tone_map.clip_percentile = args::get(clip_flag);
+        if (exposure_flag)
+        {
+            const auto& exposure = args::get(exposure_flag);
+            copy(exposure.begin(), exposure.end(), tone_map.exposure);
+        }
+        args::NargsValueFlag<unsigned>* range_flags[3] = { &red_range_flag, &green_range_flag, &blue_range_flag };
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            if (*range_flags[c]) ranges[c] = make_tuple(args::get(*range_flags[c])[0], args::get(*range_flags[c])[1]);
+        }
+        orbit.formula = args::get(formula_flag);
+        orbit.escape_precision = args::get(escape_precision_flag);
+        orbit.record_precision = args::get(record_precision_flag);
+        orbit.promote = !no_promote_flag;
+        orbit.symmetry = args::get(symmetry_flag);
+        deep_zoom = deep_zoom_flag;
+        if (deep_zoom_regions_flag) deep_zoom_settings.max_regions = max(1u, args::get(deep_zoom_regions_flag));
+        if (deep_zoom_survey_flag) deep_zoom_settings.survey_batches = max(1u, args::get(deep_zoom_survey_flag));
+        if (cull_flag)
+        {
+            cull = true;
+            culling.depth = min(12u, max(1u, args::get(cull_flag)));
+        }
+        if (cull_cache_flag) culling.cache_directory = widen(args::get(cull_cache_flag));
+
+        // the other generator paths only iterate z^2 + c in float, & seed logs don't record the formula
+        if (!orbit.is_default() && (cpu || escape_buckets || interleaved || segment_length != 0 || save_frontier || !deepen_filename.empty() || !record_seeds_filename.empty() || !replay_seeds_filename.empty()))
+        {
+            throw args::ParseError("--formula, --escape-precision, --record-precision & --symmetry can't be combined with --cpu, --escape-buckets, --interleaved, --segment-length, --save-frontier, --deepen or the seed logs");
+        }
+
+        // deep zoom draws its own initial points (which seed logs can't hold in float) & perturbs z^2 + c only
+        if (deep_zoom && (orbit.formula != Formula::mandelbrot || cpu || escape_buckets || interleaved || segment_length != 0 || save_frontier || !deepen_filename.empty() || !record_seeds_filename.empty() || !replay_seeds_filename.empty()))
+        {
+            throw args::ParseError("--deep-zoom only records mandelbrot & can't be combined with --cpu, --escape-buckets, --interleaved, --segment-length, --save-frontier, --deepen or the seed logs");
+        }
+
+        // frontiers are written next to the raw histogram, & parked & continued by the per channel accelerator
+        //  generators only
+        if (save_frontier && raw_filename.empty()) throw args::ParseError("--save-frontier writes next to the raw histogram & needs --raw");
+        if ((cpu || escape_buckets || interleaved) && (save_frontier || !deepen_filename.empty()))
+        {
+            throw args::ParseError("--save-frontier & --deepen can't be combined with --cpu, --escape-buckets or --interleaved");
+        }
+
+        // interleaved counters are filled by one generator recording the main viewport with orbits run to completion
+        if (interleaved && (!insets.empty() || segment_length != 0))
+        {
+            throw args::ParseError("--interleaved records the main viewport only & can't be combined with --inset or --segment-length");
+        }
+
+        // seeds are logged & replayed by the per channel accelerator generators only
+        if ((cpu || escape_buckets || interleaved) && (!record_seeds_filename.empty() || !replay_seeds_filename.empty()))
+        {
+            throw args::ParseError("--record-seeds & --replay-seeds can't be combined with --cpu, --escape-buckets or --interleaved");
+        }
+
+        // a log holds the orbits escaping in the window it was recorded with, so every channel has to lie inside it
+        if (!replay_seeds_filename.empty())
+        {
+            auto logged = tuple<uint32_t, uint32_t>();
+            try
+            {
+                logged = read_seed_log_range(replay_seeds_filename);
+            }
+            catch (HRESULT hr)
+            {
+                auto message = ostringstream();
+                message << "--replay-seeds can't read a seed log from " << args::get(replay_seeds_flag) << " (0x" << hex << unsigned(hr) << ")";
+                throw args::ParseError(message.str());
+            }
+            for (const auto& range : ranges)
+            {
+                if (get<0>(range) < get<0>(logged) || get<1>(range) > get<1>(logged))
+                {
+                    throw args::ParseError("--replay-seeds log holds orbits escaping in " + to_string(get<0>(logged)) + "-" + to_string(get<1>(logged)) + " iterations; channel ranges can't reach outside it");
+                }
+            }
+        }
+
+        // the bucketed histogram is sized by the widest range; a raw file holds every bucket as a channel
+        if (escape_buckets)
+        {
+            auto max_iterations = 1u;
+            for (const auto& range : ranges) max_iterations = max(max_iterations, get<1>(range));
+            const auto buckets = EscapeBuckets(max_iterations, bucket_sub_bits);
+
+            const auto side = dimension * supersample;
+            const auto bytes = BucketedHistogram::dense_bytes(concurrency::extent<2>(int(side), int(side)), buckets);
+            if (bytes > MAX_DENSE_TIER_BYTES)
+            {
+                throw args::ParseError("--escape-buckets needs " + to_string(bytes >> 20) + "MB of 16 bit counters at this dimension & these ranges, over the " + to_string(MAX_DENSE_TIER_BYTES >> 20) + "MB an accelerator buffer can hold");
+            }
+            if (!raw_filename.empty() && buckets.count > HISTOGRAM_FILE_MAX_CHANNELS)
+            {
+                throw args::ParseError("--escape-buckets makes " + to_string(buckets.count) + " buckets, more than the " + to_string(HISTOGRAM_FILE_MAX_CHANNELS) + " channels a --raw file holds");
+            }
+        }
+
+        // the cut is made for z^2 + c & includes squares bounded only up to the current caps, which a frontier
+        //  would want to continue
+        if (cull && (orbit.formula != Formula::mandelbrot || cpu || deep_zoom || save_frontier || !deepen_filename.empty()))
+        {
+            throw args::ParseError("--cull only samples for mandelbrot & can't be combined with --cpu, --deep-zoom, --save-frontier or --deepen");
         }
     }
 
+    static wstring widen(const string& s)
+    {
+        wstringstream ss;
+        ss << s.c_str();
+        return ss.str();
+    }
+
     unsigned dimension{ 4096 };
     unsigned points_per_iteration{ 512 * 512 };
     wstring filename{ L"buddhabrot-amp.png" };
+    wstring raw_filename;
+    wstring load_raw_filename;
+    HistogramDataType raw_type{ HistogramDataType::uint32 };
+    wstring tiff_filename;
+    wstring record_seeds_filename;
+    unsigned segment_length{ 0 };
+    bool cpu{ false };
+    bool cpu_bands{ false };
+    CanvasLayout cpu_layout{ CanvasLayout::row_major };
+    HostMemorySettings cpu_memory;
+    OrbitSettings orbit;
+    bool deep_zoom{ false };
+    DeepZoomSettings deep_zoom_settings;
+    bool cull{ false };
+    SampleCullingSettings culling;
+    bool avx512_scatter{ false };
+    bool benchmark_scatter{ false };
+    bool cpu_pipeline{ false };
+    unsigned cpu_producers{ 0 };
+    bool save_frontier{ false };
+    wstring deepen_filename;
+    wstring replay_seeds_filename;
+    TiffSettings tiff;
+    Viewport viewport;
+    vector<Viewport> insets;
+    float sample_radius{ 1.8f };
+    unsigned supersample{ 1 };
+    ReductionFilter filter{ ReductionFilter::box };
+    vector<unsigned> thumbnails;
+    wstring preview_filename;
+    double preview_interval{ 10.0 };
+    unsigned preview_size{ 512 };
+    ToneMapSettings tone_map;
+    tuple<unsigned, unsigned> ranges[3]{ make_tuple(0u, 1024u), make_tuple(0u, 2048u), make_tuple(0u, 4096u) };
+    bool escape_buckets{ false };
+    bool interleaved{ false };
+    unsigned bucket_sub_bits{ 1 };
     args::ArgumentParser parser{ "Usage: buddhabrot-amp.exe {OPTIONS}...", "Source & help at: <https://github.com/anirbanmu/buddhabrot-amp>" };
     args::HelpFlag help{ parser, "help", "Display this help menu", { 'h', "help" } };
     args::ValueFlag<unsigned> dimension_flag{ parser, "dimension", "Dimension in pixels of the buddhabrot generated", { 'd', "dimension" } };
     args::ValueFlag<unsigned> points_flag{ parser, "points", "Number of points iterated on each frame", { 'p', "points" } };
     args::ValueFlag<string> filename_flag{ parser, "filename", "Path of output PNG file", { 'f', "file" } };
+    args::ValueFlag<string> raw_flag{ parser, "raw", "Path of raw histogram file to write alongside the PNG", { 'r', "raw" } };
+    args::MapFlag<string, HistogramDataType> raw_type_flag{ parser, "type", "Element type of --raw files: uint32 (exact counts) or float32 (exact up to 2^24 counts a cell)", { "raw-type" },
+        { { "uint32", HistogramDataType::uint32 }, { "float32", HistogramDataType::float32 } }, HistogramDataType::uint32 };
+    args::ValueFlag<string> load_raw_flag{ parser, "load-raw", "Skip rendering; tone map a previously written raw histogram file into the PNG", { "load-raw" } };
+    args::ValueFlag<unsigned> segment_flag{ parser, "iterations", "Advance each orbit by at most this many iterations per frame, resuming it on the next (0 runs orbits to completion)", { "segment-length" } };
+    args::Flag cpu_flag{ parser, "cpu", "Sample & record on the cpu rather than the accelerator (main viewport only; ignores escape buckets, frontiers & segments & can't record or replay seeds)", { "cpu" } };
+    args::Flag cpu_bands_flag{ parser, "cpu-bands", "With --cpu, route orbit points to the worker owning their band of rows instead of incrementing shared counters", { "cpu-bands" } };
+    args::ValueFlag<unsigned> cpu_pipeline_flag{ parser, "producers", "With --cpu, overlap sampling & recording through ring buffers with at most this many producing workers (0 adapts to queue depth)", { "cpu-pipeline" } };
+    args::MapFlag<string, CanvasLayout> cpu_layout_flag{ parser, "layout", "With --cpu, order of the canvas in memory: row-major or morton (64x64 tiles in Z order)", { "cpu-layout" },
+        { { "row-major", CanvasLayout::row_major }, { "morton", CanvasLayout::morton_tiles } }, CanvasLayout::row_major };
+    args::MapFlag<string, MemoryPlacement> cpu_placement_flag{ parser, "placement", "With --cpu, where canvas & ring buffer pages go across numa nodes: first-touch, interleave or replicate (a canvas per node, summed on upload)", { "cpu-placement" },
+        { { "first-touch", MemoryPlacement::first_touch }, { "interleave", MemoryPlacement::interleave }, { "replicate", MemoryPlacement::replicate } }, MemoryPlacement::first_touch };
+    args::MapFlag<string, PageSize> cpu_pages_flag{ parser, "pages", "With --cpu, page size backing the canvas & ring buffers: normal, 2mb or 1gb (1gb only for buffers near a whole number of gigabytes, 2mb otherwise; large pages are placed when allocated, so first-touch puts them on one node & interleave keeps normal pages; falls back to smaller pages without the lock pages in memory privilege)", { "cpu-pages" },
+        { { "normal", PageSize::normal }, { "2mb", PageSize::large }, { "1gb", PageSize::huge } }, PageSize::normal };
+    args::MapFlag<string, Formula> formula_flag{ parser, "formula", "Iteration recorded: mandelbrot (z^2 + c), multibrot3, multibrot4 (z^3 + c, z^4 + c) or burning-ship", { "formula" },
+        { { "mandelbrot", Formula::mandelbrot }, { "multibrot3", Formula::multibrot3 }, { "multibrot4", Formula::multibrot4 }, { "burning-ship", Formula::burning_ship } }, Formula::mandelbrot };
+    args::MapFlag<string, Precision> escape_precision_flag{ parser, "precision", "Arithmetic of the escape test: float, double (needs accelerator double support) or double-float (a float pair)", { "escape-precision" },
+        { { "float", Precision::float32 }, { "double", Precision::float64 }, { "double-float", Precision::double_float } }, Precision::float32 };
+    args::MapFlag<string, Precision> record_precision_flag{ parser, "precision", "Arithmetic orbits are recorded in: float, double or double-float; promoted further when the viewport is zoomed past it", { "record-precision" },
+        { { "float", Precision::float32 }, { "double", Precision::float64 }, { "double-float", Precision::double_float } }, Precision::float32 };
+    args::Flag no_promote_flag{ parser, "no-promote", "Record in --record-precision even when the viewport's cells are finer than it resolves", { "no-promote" } };
+    args::MapFlag<string, Symmetry> symmetry_flag{ parser, "symmetry", "conjugate records every orbit's mirror image too (for formulas symmetric about the real axis), none records orbits only as sampled", { "symmetry" },
+        { { "conjugate", Symmetry::conjugate }, { "none", Symmetry::none } }, Symmetry::conjugate };
+    args::Flag deep_zoom_flag{ parser, "deep-zoom", "Sample only the regions of initial points a survey saw reaching the viewports & iterate them as float deltas from a reference orbit per region", { "deep-zoom" } };
+    args::ValueFlag<unsigned> deep_zoom_regions_flag{ parser, "regions", "With --deep-zoom, most regions (each with a reference orbit) kept at once", { "deep-zoom-regions" } };
+    args::ValueFlag<unsigned> deep_zoom_survey_flag{ parser, "batches", "With --deep-zoom, batches of --points samples surveyed at every level of refinement", { "deep-zoom-survey" } };
+    args::ValueFlag<unsigned> cull_flag{ parser, "depth", "Stop sampling squares of the sample square proven by interval arithmetic to hold no recorded orbit, subdividing down to 2^depth cells a side (at most 12)", { "cull" } };
+    args::ValueFlag<string> cull_cache_flag{ parser, "directory", "With --cull, keep classifications in this directory for later runs with the same sample radius, depth & iteration ranges", { "cull-cache" } };
+    args::Flag avx512_scatter_flag{ parser, "avx512-scatter", "With --cpu-bands or --cpu-pipeline, apply band increments with AVX-512 conflict detection where the processor has it", { "avx512-scatter" } };
+    args::Flag benchmark_scatter_flag{ parser, "benchmark-scatter", "Skip rendering; time the scalar & AVX-512 band increments at the current dimension & print both", { "benchmark-scatter" } };
+    args::Flag save_frontier_flag{ parser, "save-frontier", "Also write the orbits still bounded at each channel's cap next to the raw histogram file", { "save-frontier" } };
+    args::ValueFlag<string> deepen_flag{ parser, "raw", "Start from a raw histogram written with --save-frontier & continue its parked orbits up to the current caps (--raw must name a different file)", { "deepen" } };
+    args::ValueFlag<string> record_seeds_flag{ parser, "seeds", "Path of a log of recorded initial points that can be replayed later", { "record-seeds" } };
+    args::ValueFlag<string> replay_seeds_flag{ parser, "seeds", "Skip sampling; replay a seed log at the current resolution, viewports & channel ranges", { "replay-seeds" } };
+    args::ValueFlag<string> tiff_flag{ parser, "tiff", "Path of tiled 16 bit BigTIFF file to write alongside the PNG", { "tiff" } };
+    args::ValueFlag<unsigned> tile_size_flag{ parser, "tile-size", "Tile size in pixels of the BigTIFF output (multiple of 16)", { "tile-size" } };
+    args::ValueFlag<unsigned> pyramid_flag{ parser, "levels", "Number of reduced resolution levels stored after the full BigTIFF image", { "pyramid-levels" } };
+    args::NargsValueFlag<double> center_flag{ parser, "center", "Real & imaginary parts of the point at the center of the canvas", { "center" }, 2 };
+    args::ValueFlag<double> span_flag{ parser, "span", "Length of the real axis covered by the canvas height", { "span" } };
+    args::ValueFlag<double> rotation_flag{ parser, "degrees", "Rotation of the canvas about its center", { "rotation" } };
+    args::ValueFlagList<string> inset_flag{ parser, "r,i,span", "Extra view recorded from the same orbits & written next to the PNG (repeatable, up to 3)", { "inset" } };
+    args::ValueFlag<float> sample_radius_flag{ parser, "radius", "Initial points are sampled from [-radius, radius] on both axes", { "sample-radius" } };
+    args::ValueFlag<unsigned> supersample_flag{ parser, "factor", "Accumulate at factor times the dimension & reduce to the dimension for output", { "supersample" } };
+    args::MapFlag<string, ReductionFilter> filter_flag{ parser, "filter", "Filter used to reduce the canvas for output: box or lanczos", { "filter" },
+        { { "box", ReductionFilter::box }, { "lanczos", ReductionFilter::lanczos } }, ReductionFilter::box };
+    args::ValueFlagList<unsigned> thumbnail_flag{ parser, "size", "Also write a PNG reduced to this longest side (repeatable)", { "thumbnail" } };
+    args::ValueFlag<string> preview_flag{ parser, "preview", "Path of a preview image (.qoi or .ppm) rewritten periodically while rendering", { "preview" } };
+    args::ValueFlag<double> preview_interval_flag{ parser, "seconds", "Seconds between preview images", { "preview-interval" } };
+    args::ValueFlag<unsigned> preview_size_flag{ parser, "size", "Longest side in pixels of preview images", { "preview-size" } };
+    args::MapFlag<string, ToneCurve> tone_curve_flag{ parser, "curve", "Tone curve: sqrt, gamma, log, asinh or equalize", { "tone-curve" },
+        { { "sqrt", ToneCurve::sqrt }, { "gamma", ToneCurve::gamma }, { "log", ToneCurve::log }, { "asinh", ToneCurve::asinh }, { "equalize", ToneCurve::equalize } }, ToneCurve::sqrt };
+    args::ValueFlag<float> gamma_flag{ parser, "gamma", "Exponent used by the gamma tone curve", { "gamma" } };
+    args::ValueFlag<float> clip_flag{ parser, "percentile", "Percentile of lit pixels that maps to white", { "clip-percentile" } };
+    args::NargsValueFlag<float> exposure_flag{ parser, "exposure", "Red, green & blue exposure multipliers", { "exposure" }, 3 };
+    args::NargsValueFlag<unsigned> red_range_flag{ parser, "range", "Escape iterations [min, max) recorded into the red channel", { "red-range" }, 2 };
+    args::NargsValueFlag<unsigned> green_range_flag{ parser, "range", "Escape iterations [min, max) recorded into the green channel", { "green-range" }, 2 };
+    args::NargsValueFlag<unsigned> blue_range_flag{ parser, "range", "Escape iterations [min, max) recorded into the blue channel", { "blue-range" }, 2 };
+    args::ValueFlag<unsigned> escape_buckets_flag{ parser, "bits", "Record one histogram bucketed by escape iteration (2^bits buckets per octave, bits at most 3) & compose the channels from it", { "escape-buckets" } };
+    args::Flag interleaved_flag{ parser, "interleaved", "Record all three channels from one generator's orbits into interleaved RGBx counters (main viewport only; can't be combined with insets, segments, frontiers or seed logs)", { "interleaved" } };
 };
 
+// inserts suffix ahead of the extension, if there is one
+wstring with_suffix(const wstring& filename, const wstring& suffix)
+{
+    const auto dot = filename.find_last_of(L'.');
+    const auto separator = filename.find_last_of(L"\\/");
+    if (dot == wstring::npos || (separator != wstring::npos && dot < separator)) return filename + suffix;
+    return filename.substr(0, dot) + suffix + filename.substr(dot);
+}
+
 class ConsoleAttacher
 {
     public:
@@ -105,6 +392,35 @@ int CALLBACK WinMain(HINSTANCE h_instance, HINSTANCE, LPSTR, int)
         return 1;
     }
 
+    if (!cli.load_raw_filename.empty())
+    {
+        auto histogram = read_histogram_file(cli.load_raw_filename);
+        if (histogram.flags & HISTOGRAM_FILE_ESCAPE_BUCKETS)
+        {
+            write_png(histogram.width, histogram.height,
+                compose_channel(histogram, cli.ranges[0]), compose_channel(histogram, cli.ranges[1]), compose_channel(histogram, cli.ranges[2]), cli.filename, cli.tone_map);
+            return 0;
+        }
+
+        auto& channels = histogram.channels;
+        auto& red = channels[0].counts;
+        auto& green = channels[min<size_t>(1, channels.size() - 1)].counts;
+        auto& blue = channels[min<size_t>(2, channels.size() - 1)].counts;
+        write_png(histogram.width, histogram.height, red, green, blue, cli.filename, cli.tone_map);
+        return 0;
+    }
+
+    if (cli.benchmark_scatter)
+    {
+        const auto cells = size_t(cli.dimension) * cli.dimension;
+        const auto result = benchmark_scatter_increment(cells, max<size_t>(cells, 1 << 26));
+        cout << result.increments << " increments into " << cells << " cells: scalar " << result.scalar_seconds << "s";
+        if (result.avx512_seconds != 0.0) cout << ", avx-512 " << result.avx512_seconds << "s";
+        cout << endl;
+        return 0;
+    }
+    enable_avx512_scatter(cli.avx512_scatter);
+
     auto d3d_device = create_device();
     auto accelerator_view = concurrency::direct3d::create_accelerator_view(d3d_device);
 
@@ -116,14 +432,207 @@ int CALLBACK WinMain(HINSTANCE h_instance, HINSTANCE, LPSTR, int)
         }
     );
 
-    auto presenter = BuddhabrotPresenter(window.handle(), d3d_device);
+    auto presenter = BuddhabrotPresenter(window.handle(), d3d_device, cli.tone_map);
+
+    const auto histogram_dimension = cli.dimension * cli.supersample;
+    const auto histogram_extent = concurrency::extent<2>(histogram_dimension, histogram_dimension);
+
+    // either one generator per channel (on the accelerator or the cpu), or a single generator feeding an escape
+    //  bucketed histogram that the channels are composed from or interleaved counters holding all of them
+    auto generators = vector<unique_ptr<BuddhabrotGenerator>>();
+    auto cpu_generators = vector<unique_ptr<CpuBuddhabrotGenerator>>();
+    auto bucketed = unique_ptr<BucketedHistogram>();
+    auto interleaved = unique_ptr<InterleavedHistogram>();
+    auto composed = vector<concurrency::array<unsigned, 2>>();
+    // a base histogram for deepening decides the viewport, since its counts are added to
+    auto base = Histogram();
+    if (!cli.deepen_filename.empty())
+    {
+        base = read_histogram_file(cli.deepen_filename);
+        throw_hresult_on_failure(base.width != histogram_dimension || base.height != histogram_dimension || base.channels.size() < 3 || (base.flags & HISTOGRAM_FILE_ESCAPE_BUCKETS) ? E_INVALIDARG : S_OK);
+        cli.viewport = base.viewport;
+        cli.insets.clear();
+    }
+
+    if (cli.cpu && cli.deepen_filename.empty())
+    {
+        for (const auto& range : cli.ranges)
+        {
+            cpu_generators.push_back(make_unique<CpuBuddhabrotGenerator>(histogram_extent, cli.points_per_iteration, range, cli.viewport, cli.sample_radius, default_scheduler(), cli.cpu_layout, cli.cpu_memory));
+            cpu_generators.back()->set_banded(cli.cpu_bands);
+            cpu_generators.back()->set_pipelined(cli.cpu_pipeline, cli.cpu_producers);
+            composed.emplace_back(histogram_extent, accelerator_view);
+        }
+
+        // large pages are placed when they are allocated rather than by first touch, & fall back to smaller pages, so
+        //  what is in effect can differ from what was asked for
+        if (cli.cpu_memory.pages != PageSize::normal || cli.cpu_memory.placement != MemoryPlacement::first_touch)
+        {
+            const char* page_names[] = { "4KB", "2MB", "1GB" };
+            const auto pages = cpu_generators[0]->get_page_size();
+            cout << "cpu canvas in " << page_names[int(pages)] << " pages, ";
+            if (cli.cpu_memory.placement == MemoryPlacement::replicate) cout << "a replica on each numa node";
+            else if (pages != PageSize::normal) cout << "all on the allocating thread's numa node";
+            else cout << (cli.cpu_memory.placement == MemoryPlacement::interleave ? "interleaved across numa nodes" : "placed by first touch");
+            cout << endl;
+        }
+    }
+    else if (cli.escape_buckets && cli.deepen_filename.empty())
+    {
+        auto max_iterations = 1u;
+        for (const auto& range : cli.ranges) max_iterations = max(max_iterations, get<1>(range));
+
+        generators.push_back(make_unique<BuddhabrotGenerator>(accelerator_view, histogram_extent, cli.points_per_iteration, make_tuple(0u, max_iterations), vector<Viewport>{ cli.viewport }, cli.sample_radius));
+        bucketed = make_unique<BucketedHistogram>(accelerator_view, histogram_extent, max_iterations, cli.bucket_sub_bits);
+        for (unsigned c = 0; c < 3; ++c) composed.emplace_back(histogram_extent, accelerator_view);
+    }
+    else if (cli.interleaved && cli.deepen_filename.empty())
+    {
+        interleaved = make_unique<InterleavedHistogram>(accelerator_view, histogram_extent, cli.ranges);
+        const auto max_iterations = interleaved->get_ranges().max_iterations;
 
-    auto red_generator = BuddhabrotGenerator(accelerator_view, concurrency::extent<2>(cli.dimension, cli.dimension), cli.points_per_iteration, make_tuple(0, 1024));
-    auto green_generator = BuddhabrotGenerator(accelerator_view, concurrency::extent<2>(cli.dimension, cli.dimension), cli.points_per_iteration, make_tuple(0, 2048));
-    auto blue_generator = BuddhabrotGenerator(accelerator_view, concurrency::extent<2>(cli.dimension, cli.dimension), cli.points_per_iteration, make_tuple(0, 4096));
+        generators.push_back(make_unique<BuddhabrotGenerator>(accelerator_view, histogram_extent, cli.points_per_iteration, make_tuple(0u, max_iterations), vector<Viewport>{ cli.viewport }, cli.sample_radius));
+        for (unsigned c = 0; c < 3; ++c) composed.emplace_back(histogram_extent, accelerator_view);
+    }
+    else
+    {
+        auto viewports = vector<Viewport>{ cli.viewport };
+        viewports.insert(viewports.end(), cli.insets.begin(), cli.insets.end());
+        for (const auto& range : cli.ranges)
+        {
+            generators.push_back(make_unique<BuddhabrotGenerator>(accelerator_view, histogram_extent, cli.points_per_iteration, range, viewports, cli.sample_radius));
+            generators.back()->set_segment_length(cli.segment_length);
+            generators.back()->set_orbit_settings(cli.orbit);
+            if (cli.deep_zoom) generators.back()->set_deep_zoom(cli.deep_zoom_settings);
+        }
+    }
+
+    if (cli.cull && cli.replay_seeds_filename.empty())
+    {
+        for (auto& generator : generators) generator->set_sample_culling(cli.culling);
+
+        const auto unsaved = any_of(generators.begin(), generators.end(),
+            [](const unique_ptr<BuddhabrotGenerator>& generator)
+            {
+                return generator->get_sample_cells() != nullptr && generator->get_sample_cells()->cache_write_failed;
+            }
+        );
+        if (unsaved) cerr << "warning: couldn't write the culling classification to the --cull-cache directory; it will be recomputed next run" << endl;
+    }
+
+    // only iterate() records in a promoted tier; the other accelerator paths record in float whatever the views need
+    const auto float_records = bucketed || interleaved || cli.segment_length != 0 || !cli.deepen_filename.empty() || !cli.replay_seeds_filename.empty();
+    if (float_records && cli.orbit.promote && !generators.empty() && generators[0]->promoted_precision(Precision::float32) != Precision::float32)
+    {
+        cerr << "warning: the views are zoomed past what float resolves, but --escape-buckets, --interleaved, --segment-length, --deepen & --replay-seeds record in float" << endl;
+    }
+
+    // the optional stages below hang off the per channel accelerator generators
+    const auto per_channel = !bucketed && !interleaved && cpu_generators.empty();
+
+    const concurrency::array<unsigned, 2>* histograms[3] = {};
+    auto compose_histograms = [&]()
+    {
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            if (!cpu_generators.empty())
+            {
+                cpu_generators[c]->copy_to(composed[c]);
+                histograms[c] = &composed[c];
+            }
+            else if (bucketed)
+            {
+                bucketed->compose(cli.ranges[c], composed[c]);
+                histograms[c] = &composed[c];
+            }
+            else if (interleaved)
+            {
+                interleaved->split(c, composed[c]);
+                histograms[c] = &composed[c];
+            }
+            else
+            {
+                histograms[c] = &generators[c]->get_record_array();
+            }
+        }
+    };
+
+    // frontier files sit next to the raw histogram they belong to, one per channel
+    auto frontier_filename = [](const wstring& raw_filename, unsigned channel)
+    {
+        return with_suffix(raw_filename, L"-frontier" + to_wstring(channel));
+    };
+
+    auto frontiers = vector<unique_ptr<FrontierWriter>>();
+    if (cli.save_frontier)
+    {
+        for (unsigned c = 0; c < generators.size(); ++c)
+        {
+            frontiers.push_back(make_unique<FrontierWriter>(frontier_filename(cli.raw_filename, c), get<1>(generators[c]->get_iteration_range())));
+            generators[c]->set_frontier(frontiers.back().get());
+        }
+    }
+
+    if (!cli.deepen_filename.empty())
+    {
+        for (unsigned c = 0; c < generators.size(); ++c)
+        {
+            generators[c]->load_counts(base.channels[c].counts, base.channels[c].samples);
+            base.channels[c].counts = vector<unsigned>();
+
+            // the base counts must be of the orbits escaping below the cap the frontier was parked at, in the range
+            //  this channel records
+            const auto parked = FrontierReader(frontier_filename(cli.deepen_filename, c));
+            const auto& base_range = base.channels[c].iteration_range;
+            throw_hresult_on_failure(get<1>(base_range) != parked.get_iterations() || get<0>(base_range) != get<0>(generators[c]->get_iteration_range()) ? E_INVALIDARG : S_OK);
+            if (parked.get_iterations() >= get<1>(generators[c]->get_iteration_range())) continue;
+
+            parked.for_each_batch(cli.points_per_iteration,
+                [&](const FrontierPoint* points, size_t count)
+                {
+                    generators[c]->deepen(points, count, parked.get_iterations());
+                }
+            );
+        }
+    }
+
+    // seeds are logged from the channel reaching the highest iteration count, which also logs the orbits below its
+    //  own range down to the lowest channel's, so the log covers every channel
+    auto seed_log = unique_ptr<SeedLogWriter>();
+    if (!cli.record_seeds_filename.empty() && per_channel)
+    {
+        auto* widest = max_element(generators.begin(), generators.end(),
+            [](const unique_ptr<BuddhabrotGenerator>& a, const unique_ptr<BuddhabrotGenerator>& b)
+            {
+                return get<1>(a->get_iteration_range()) < get<1>(b->get_iteration_range());
+            }
+        )->get();
+        auto min_iterations = get<0>(widest->get_iteration_range());
+        for (const auto& generator : generators) min_iterations = min(min_iterations, get<0>(generator->get_iteration_range()));
+
+        seed_log = make_unique<SeedLogWriter>(cli.record_seeds_filename, min_iterations, get<1>(widest->get_iteration_range()));
+        widest->set_seed_log(seed_log.get(), min_iterations);
+    }
+
+    auto preview = unique_ptr<PreviewWriter>();
+    if (!cli.preview_filename.empty())
+    {
+        preview = make_unique<PreviewWriter>(cli.preview_filename, cli.preview_size, chrono::duration<double>(cli.preview_interval), cli.tone_map);
+    }
+
+    if (!cli.replay_seeds_filename.empty())
+    {
+        const SeedLogReader seeds(cli.replay_seeds_filename);
+        seeds.for_each_batch(cli.points_per_iteration,
+            [&](const vector<OrbitSeed>& batch, unsigned long long samples)
+            {
+                for (auto& generator : generators) generator->replay(batch, samples);
+            }
+        );
+    }
 
     auto msg = MSG();
-    while (msg.message != WM_QUIT)
+    while (cli.replay_seeds_filename.empty() && msg.message != WM_QUIT)
     {
         if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
         {
@@ -139,10 +648,191 @@ int CALLBACK WinMain(HINSTANCE h_instance, HINSTANCE, LPSTR, int)
                 // OutputDebugString(s.str().c_str());
                 presenter.resize();
             }
-            presenter.render_and_present(red_generator.iterate(), green_generator.iterate(), blue_generator.iterate());
+            if (!cpu_generators.empty())
+            {
+                for (auto& generator : cpu_generators) generator->iterate();
+            }
+            else if (bucketed)
+            {
+                generators[0]->iterate(*bucketed);
+            }
+            else if (interleaved)
+            {
+                generators[0]->iterate(*interleaved);
+            }
+            else
+            {
+                for (auto& generator : generators) generator->iterate();
+            }
+
+            if (interleaved)
+            {
+                // the display reads the interleaved counts in place; planar copies are only made for previews
+                presenter.render_and_present(interleaved->counts);
+                if (preview)
+                {
+                    compose_histograms();
+                    preview->maybe_capture(*histograms[0], *histograms[1], *histograms[2]);
+                }
+            }
+            else
+            {
+                compose_histograms();
+                presenter.render_and_present(*histograms[0], *histograms[1], *histograms[2]);
+                if (preview) preview->maybe_capture(*histograms[0], *histograms[1], *histograms[2]);
+            }
         }
     }
     
-    write_png_from_arrays(cli.dimension, cli.dimension, red_generator.get_record_array(), green_generator.get_record_array(), blue_generator.get_record_array(), cli.filename);
+    compose_histograms();
+
+    // image outputs are reduced from the histogram resolution; the raw histogram is always written in full
+    const concurrency::array<unsigned, 2>* outputs[3] = { histograms[0], histograms[1], histograms[2] };
+    unique_ptr<concurrency::array<unsigned, 2>> reduced[3];
+    const auto output_extent = concurrency::extent<2>(cli.dimension, cli.dimension);
+    if (output_extent != histogram_extent)
+    {
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            reduced[c] = make_unique<concurrency::array<unsigned, 2>>(reduce_counts(*histograms[c], output_extent, cli.filter));
+            outputs[c] = reduced[c].get();
+        }
+    }
+
+    if (interleaved && output_extent == histogram_extent)
+    {
+        write_png_from_interleaved(cli.dimension, cli.dimension, interleaved->counts, cli.filename, cli.tone_map);
+    }
+    else
+    {
+        write_png_from_arrays(cli.dimension, cli.dimension, *outputs[0], *outputs[1], *outputs[2], cli.filename, cli.tone_map);
+    }
+
+    for (const auto size : cli.thumbnails)
+    {
+        const auto target = reduced_extent(histogram_extent, size);
+        write_png_from_arrays(target[1], target[0],
+            reduce_counts(*histograms[0], target, cli.filter),
+            reduce_counts(*histograms[1], target, cli.filter),
+            reduce_counts(*histograms[2], target, cli.filter),
+            with_suffix(cli.filename, L"-" + to_wstring(size)), cli.tone_map);
+    }
+
+    if (!cli.tiff_filename.empty())
+    {
+        write_tiled_bigtiff(*outputs[0], *outputs[1], *outputs[2], cli.tiff_filename, cli.tone_map, cli.tiff);
+    }
+
+    if (!cli.raw_filename.empty())
+    {
+        if (!cpu_generators.empty() || interleaved)
+        {
+            auto channels = vector<HistogramChannelSource>();
+            for (unsigned c = 0; c < 3; ++c)
+            {
+                const auto samples = interleaved ? generators[0]->get_samples_taken() : cpu_generators[c]->get_samples_taken();
+                channels.push_back({ &composed[c], cli.ranges[c], samples });
+            }
+            write_histogram_file(cli.raw_filename, channels, cli.viewport, cli.raw_type);
+        }
+        else if (bucketed)
+        {
+            write_histogram_file(cli.raw_filename, *bucketed, generators[0]->get_samples_taken(), cli.viewport, cli.raw_type);
+        }
+        else
+        {
+            auto channels = vector<HistogramChannelSource>();
+            for (const auto& generator : generators)
+            {
+                channels.push_back({ &generator->get_record_array(), generator->get_iteration_range(), generator->get_samples_taken() });
+            }
+            write_histogram_file(cli.raw_filename, channels, cli.viewport, cli.raw_type);
+        }
+    }
+
+    // insets get the main PNG & raw outputs, suffixed with their position on the command line
+    for (unsigned v = 1; per_channel && v < generators[0]->get_viewport_count(); ++v)
+    {
+        const auto suffix = L"-inset" + to_wstring(v);
+        const auto& red = generators[0]->get_record_array(v);
+        const auto& green = generators[1]->get_record_array(v);
+        const auto& blue = generators[2]->get_record_array(v);
+        if (output_extent != histogram_extent)
+        {
+            write_png_from_arrays(cli.dimension, cli.dimension,
+                reduce_counts(red, output_extent, cli.filter), reduce_counts(green, output_extent, cli.filter), reduce_counts(blue, output_extent, cli.filter),
+                with_suffix(cli.filename, suffix), cli.tone_map);
+        }
+        else
+        {
+            write_png_from_arrays(cli.dimension, cli.dimension, red, green, blue, with_suffix(cli.filename, suffix), cli.tone_map);
+        }
+
+        if (!cli.raw_filename.empty())
+        {
+            auto channels = vector<HistogramChannelSource>();
+            for (const auto& generator : generators)
+            {
+                channels.push_back({ &generator->get_record_array(v), generator->get_iteration_range(), generator->get_samples_taken() });
+            }
+            write_histogram_file(with_suffix(cli.raw_filename, suffix), channels, generators[0]->get_viewport(v), cli.raw_type);
+        }
+    }
+
+    if (cli.segment_length != 0 && per_channel)
+    {
+        for (const auto& generator : generators)
+        {
+            cout << "channel " << get<0>(generator->get_iteration_range()) << "-" << get<1>(generator->get_iteration_range()) << ": " << generator->get_samples_taken()
+                << " samples, lane occupancy " << generator->get_lane_occupancy() * 100.0 << "%" << endl;
+        }
+    }
+
+    for (const auto& generator : generators)
+    {
+        const auto* cells = generator->get_sample_cells();
+        if (cells == nullptr) continue;
+
+        cout << "channel " << get<0>(generator->get_iteration_range()) << "-" << get<1>(generator->get_iteration_range()) << ": sampled " << cells->kept_fraction() * 100.0
+            << "% of the sample square, culled " << cells->escaping_fraction * 100.0 << "% escaping early & " << cells->bounded_fraction * 100.0 << "% bounded" << endl;
+    }
+
+    if (cli.deep_zoom && per_channel)
+    {
+        for (const auto& generator : generators)
+        {
+            cout << "channel " << get<0>(generator->get_iteration_range()) << "-" << get<1>(generator->get_iteration_range()) << ": " << generator->get_deep_zoom_regions()
+                << " deep zoom regions covering " << generator->get_sampled_fraction() * 100.0 << "% of the sample square, " << generator->get_rebase_count() << " rebases" << endl;
+        }
+    }
+
+    // worth reporting once anything ran wider than float
+    if (per_channel)
+    {
+        auto counts = PrecisionCounts();
+        for (const auto& generator : generators)
+        {
+            for (unsigned tier = 0; tier < 3; ++tier)
+            {
+                counts.tested[tier] += generator->get_precision_counts().tested[tier];
+                counts.recorded[tier] += generator->get_precision_counts().recorded[tier];
+            }
+        }
+
+        if (counts.tested[1] + counts.tested[2] + counts.recorded[1] + counts.recorded[2] != 0)
+        {
+            const char* names[3] = { "float", "double", "double-float" };
+            cout << "samples escape tested in";
+            for (unsigned tier = 0; tier < 3; ++tier) cout << (tier == 0 ? " " : ", ") << names[tier] << " " << counts.tested[tier];
+            cout << "; orbits recorded in";
+            for (unsigned tier = 0; tier < 3; ++tier) cout << (tier == 0 ? " " : ", ") << names[tier] << " " << counts.recorded[tier];
+            cout << endl;
+        }
+    }
+
+    if (bucketed && bucketed->get_spill_dropped() != 0)
+    {
+        cerr << bucketed->get_spill_dropped() << " counter overflows were dropped; the escape bucket spill table is too small" << endl;
+    }
     return 0;
 }
@@ -0,0 +1,91 @@
+#ifndef _ORBIT_FORMULAS_H_
+#define _ORBIT_FORMULAS_H_
+
+#include <amp.h>
+
+#include "utilities.h"
+#include "double_float.h"
+
+enum class Formula
+{
+    mandelbrot,
+    multibrot3,
+    multibrot4,
+    burning_ship
+};
+
+// arithmetic the orbits are iterated in; float64 needs an accelerator with (at least limited) double support,
+//  double_float (a pair of floats) runs anywhere at a few times the cost of float
+enum class Precision
+{
+    float32,
+    float64,
+    double_float
+};
+
+enum class Symmetry
+{
+    none,
+    // every orbit's conjugate is recorded as well, which is free for formulas symmetric about the real axis (the
+    //  sampled square always is); ignored for the ones that aren't
+    conjugate
+};
+
+// what a generator's orbit kernels are specialised for; the defaults are the classic buddhabrot. the escape test
+//  only decides whether & for how long an orbit is recorded, so float usually does; recording places every point on
+//  the canvas & is where zoomed viewports run out of float. with promote set, recording is moved to the cheapest
+//  tier that still resolves the generator's finest viewport cell
+struct OrbitSettings
+{
+    Formula formula{ Formula::mandelbrot };
+    Precision escape_precision{ Precision::float32 };
+    Precision record_precision{ Precision::float32 };
+    Symmetry symmetry{ Symmetry::conjugate };
+    bool promote{ true };
+
+    bool is_default() const
+    {
+        return formula == Formula::mandelbrot && escape_precision == Precision::float32 && record_precision == Precision::float32 && symmetry == Symmetry::conjugate;
+    }
+};
+
+// the formulas are types rather than values so every kernel is compiled for exactly one of them. step advances z
+//  by one iteration; CONJUGATE_SYMMETRIC says whether the conjugate of an orbit is the orbit of the conjugate
+
+// z -> z^2 + c
+struct Mandelbrot
+{
+    static const bool CONJUGATE_SYMMETRIC = true;
+
+    template<typename T> static Complex<T> step(const Complex<T>& z, const Complex<T>& c) restrict(cpu, amp)
+    {
+        return c + (z * z);
+    }
+};
+
+// z -> z^Power + c, multiplied out; Power is a constant so the loop unrolls
+template<unsigned Power> struct Multibrot
+{
+    static const bool CONJUGATE_SYMMETRIC = true;
+
+    template<typename T> static Complex<T> step(const Complex<T>& z, const Complex<T>& c) restrict(cpu, amp)
+    {
+        auto power = z;
+        for (unsigned p = 1; p < Power; ++p) power = power * z;
+        return c + power;
+    }
+};
+
+// z -> (|re z| + i |im z|)^2 + c; folding z into the first quadrant breaks the real axis symmetry
+struct BurningShip
+{
+    static const bool CONJUGATE_SYMMETRIC = false;
+
+    template<typename T> static Complex<T> step(const Complex<T>& z, const Complex<T>& c) restrict(cpu, amp)
+    {
+        const auto folded = Complex<T>(z.r < T(0) ? -z.r : z.r, z.i < T(0) ? -z.i : z.i);
+        return c + (folded * folded);
+    }
+};
+
+#endif
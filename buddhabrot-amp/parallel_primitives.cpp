@@ -0,0 +1,94 @@
+#include <amp.h>
+
+#include "parallel_primitives.h"
+
+using namespace std;
+
+namespace
+{
+    const int SCAN_TILE = 256;
+
+    // exclusive scan within each tile; tile_sums gets every tile's total
+    void scan_tiles(const concurrency::array<unsigned, 1>& input, concurrency::array<unsigned, 1>& output, concurrency::array<unsigned, 1>& tile_sums)
+    {
+        const auto size = input.get_extent()[0];
+
+        parallel_for_each(input.get_extent().tile<SCAN_TILE>().pad(),
+            [=, &input, &output, &tile_sums](concurrency::tiled_index<SCAN_TILE> tidx) restrict(amp)
+            {
+                tile_static unsigned values[SCAN_TILE];
+
+                const auto global = tidx.global[0];
+                const auto local = tidx.local[0];
+                const auto value = global < size ? input[global] : 0u;
+                values[local] = value;
+                tidx.barrier.wait();
+
+                // Hillis-Steele; the tile is small enough that the extra adds cost less than the extra barriers of
+                //  a work efficient scan
+                for (int offset = 1; offset < SCAN_TILE; offset <<= 1)
+                {
+                    const auto add = local >= offset ? values[local - offset] : 0u;
+                    tidx.barrier.wait();
+                    values[local] += add;
+                    tidx.barrier.wait();
+                }
+
+                if (global < size) output[global] = values[local] - value;
+                if (local == SCAN_TILE - 1) tile_sums[tidx.tile[0]] = values[local];
+            }
+        );
+    }
+}
+
+PrefixScan::PrefixScan(int size, const concurrency::accelerator_view& accel_view) :
+    flag_offsets(concurrency::array<unsigned, 1>(size, accel_view))
+{
+    auto tiles = size;
+    do
+    {
+        tiles = (tiles + SCAN_TILE - 1) / SCAN_TILE;
+        tile_sums.emplace_back(tiles, accel_view);
+        if (tiles > 1) tile_offsets.emplace_back(tiles, accel_view);
+    }
+    while (tiles > 1);
+}
+
+void PrefixScan::scan(const concurrency::array<unsigned, 1>& input, concurrency::array<unsigned, 1>& output)
+{
+    scan_level(0, input, output);
+}
+
+void PrefixScan::scan_level(size_t level, const concurrency::array<unsigned, 1>& input, concurrency::array<unsigned, 1>& output)
+{
+    auto& sums = tile_sums[level];
+    scan_tiles(input, output, sums);
+    if (level + 1 == tile_sums.size()) return;
+
+    auto& offsets = tile_offsets[level];
+    scan_level(level + 1, sums, offsets);
+
+    parallel_for_each(input.get_extent(),
+        [&output, &offsets](concurrency::index<1> idx) restrict(amp)
+        {
+            output[idx] += offsets[idx[0] / SCAN_TILE];
+        }
+    );
+}
+
+unsigned PrefixScan::compact(const concurrency::array<unsigned, 1>& flags, concurrency::array<unsigned, 1>& positions)
+{
+    auto& offsets = flag_offsets;
+    scan(flags, offsets);
+
+    parallel_for_each(flags.get_extent(),
+        [&flags, &offsets, &positions](concurrency::index<1> idx) restrict(amp)
+        {
+            if (flags[idx] != 0) positions[offsets[idx]] = unsigned(idx[0]);
+        }
+    );
+
+    auto count = 0u;
+    concurrency::copy(tile_sums.back(), &count);
+    return count;
+}
@@ -0,0 +1,32 @@
+#ifndef _PARALLEL_PRIMITIVES_H_
+#define _PARALLEL_PRIMITIVES_H_
+
+#include <vector>
+
+#include <amp.h>
+
+// exclusive prefix sums & stream compaction over inputs of one fixed length. tiles are scanned in tile_static memory
+//  & their totals scanned recursively; the scratch arrays of every level are kept, so repeated calls allocate nothing
+class PrefixScan
+{
+    public:
+        PrefixScan(int size, const concurrency::accelerator_view& accel_view);
+
+        // exclusive prefix sum of input into output (which must be at least as long). the sum of all of input is left
+        //  on the accelerator rather than read back
+        void scan(const concurrency::array<unsigned, 1>& input, concurrency::array<unsigned, 1>& output);
+
+        // writes the indices of the non zero entries of flags (which must all be 0 or 1), in order, to the front of
+        //  positions & returns how many there are
+        unsigned compact(const concurrency::array<unsigned, 1>& flags, concurrency::array<unsigned, 1>& positions);
+
+    private:
+        void scan_level(size_t level, const concurrency::array<unsigned, 1>& input, concurrency::array<unsigned, 1>& output);
+
+        // every tile's total & their scan, one of each per level; the last level is a single tile whose total is the sum
+        std::vector<concurrency::array<unsigned, 1>> tile_sums;
+        std::vector<concurrency::array<unsigned, 1>> tile_offsets;
+        concurrency::array<unsigned, 1> flag_offsets;
+};
+
+#endif
@@ -7,9 +7,9 @@
 #include <wincodecsdk.h>
 
 #include <amp.h>
-#include <amp_math.h>
 
 #include "utilities.h"
+#include "tone_mapping.h"
 
 using namespace std;
 using concurrency::array_view;
@@ -32,7 +32,7 @@ struct PngWriterResources
     CComPtr<IWICStream> stream;
 };
 
-void write_png_from_arrays(UINT width, UINT height, const concurrency::array<unsigned, 2>& red, const concurrency::array<unsigned, 2>& green, const concurrency::array<unsigned, 2>& blue, const wstring filename)
+void write_png_from_arrays(UINT width, UINT height, const concurrency::array<unsigned, 2>& red, const concurrency::array<unsigned, 2>& green, const concurrency::array<unsigned, 2>& blue, const wstring filename, const ToneMapSettings& settings)
 {
     auto resources = PngWriterResources(filename);
 
@@ -44,22 +44,17 @@ void write_png_from_arrays(UINT width, UINT height, const concurrency::array<uns
     GUID pixel_format = GUID_WICPixelFormat32bppBGRA;
     throw_hresult_on_failure(frame->SetPixelFormat(&pixel_format));
 
-    const auto max_red_array = max_element_in_concurrency_array(red);
-    const auto max_green_array = max_element_in_concurrency_array(green);
-    const auto max_blue_array = max_element_in_concurrency_array(blue);
+    const auto map = make_rgb_tone_map(rgb_statistics(array_view<const unsigned, 2>(red), array_view<const unsigned, 2>(green), array_view<const unsigned, 2>(blue)), settings);
 
-    // sqrt cheats to pull up lows comparatively to highs
     auto buffer = vector<BYTE>(width * height * 4);
     {
         array_view<unsigned, 2> buffer_view(height, width, reinterpret_cast<unsigned*>(buffer.data()));
+        buffer_view.discard_data();
 
         parallel_for_each(buffer_view.extent,
-            [&, buffer_view](index<2> idx) restrict(amp)
+            [=, &red, &green, &blue](index<2> idx) restrict(amp)
         {
-            buffer_view[idx] = 255 << 24 |
-                static_cast<unsigned>(255 * concurrency::fast_math::sqrt(red[idx] / static_cast<float>(max_red_array[0]))) << 16 |
-                static_cast<unsigned>(255 * concurrency::fast_math::sqrt(green[idx] / static_cast<float>(max_green_array[0]))) << 8 |
-                static_cast<unsigned>(255 * concurrency::fast_math::sqrt(blue[idx] / static_cast<float>(max_blue_array[0])));
+            buffer_view[idx] = map.bgra(red[idx], green[idx], blue[idx]);
         }
         );
     }
@@ -69,7 +64,7 @@ void write_png_from_arrays(UINT width, UINT height, const concurrency::array<uns
     throw_hresult_on_failure(resources.encoder->Commit());
 }
 
-void write_png_from_array_views(UINT width, UINT height, const array_view<unsigned, 2>& red, const array_view<unsigned, 2>& green, const array_view<unsigned, 2>& blue, const wstring filename)
+void write_png_from_interleaved(UINT width, UINT height, const concurrency::array<unsigned, 3>& cells, const wstring filename, const ToneMapSettings& settings)
 {
     auto resources = PngWriterResources(filename);
 
@@ -81,24 +76,17 @@ void write_png_from_array_views(UINT width, UINT height, const array_view<unsign
     GUID pixel_format = GUID_WICPixelFormat32bppBGRA;
     throw_hresult_on_failure(frame->SetPixelFormat(&pixel_format));
 
-    const auto max_red = max_element_in_array_view(red);
-    const auto max_green = max_element_in_array_view(green);
-    const auto max_blue = max_element_in_array_view(blue);
+    const auto map = make_rgb_tone_map(rgb_statistics(array_view<const unsigned, 3>(cells)), settings);
 
-    // cout << max_red << ":" << max_green << ":" << max_blue << endl;
-
-    // sqrt cheats to pull up lows comparatively to highs
     auto buffer = vector<BYTE>(width * height * 4);
     {
-        array_view<unsigned, 2> bufferView(height, width, reinterpret_cast<unsigned*>(buffer.data()));
+        array_view<unsigned, 2> buffer_view(height, width, reinterpret_cast<unsigned*>(buffer.data()));
+        buffer_view.discard_data();
 
-        parallel_for_each(bufferView.extent,
-            [=](index<2> idx) restrict(amp)
+        parallel_for_each(buffer_view.extent,
+            [=, &cells](index<2> idx) restrict(amp)
             {
-                bufferView[idx] = 255 << 24 |
-                    static_cast<unsigned>(255 * concurrency::fast_math::sqrt(red[idx] / static_cast<float>(max_red))) << 16 |
-                    static_cast<unsigned>(255 * concurrency::fast_math::sqrt(green[idx] / static_cast<float>(max_green))) << 8 |
-                    static_cast<unsigned>(255 * concurrency::fast_math::sqrt(blue[idx] / static_cast<float>(max_blue)));
+                buffer_view[idx] = map.bgra(cells[index<3>(idx[0], idx[1], 0)], cells[index<3>(idx[0], idx[1], 1)], cells[index<3>(idx[0], idx[1], 2)]);
             }
         );
     }
@@ -108,7 +96,7 @@ void write_png_from_array_views(UINT width, UINT height, const array_view<unsign
     throw_hresult_on_failure(resources.encoder->Commit());
 }
 
-void write_png(UINT width, UINT height, vector<unsigned>& red, vector<unsigned>& green, vector<unsigned>& blue, const wstring filename)
+void write_png_from_array_views(UINT width, UINT height, const array_view<unsigned, 2>& red, const array_view<unsigned, 2>& green, const array_view<unsigned, 2>& blue, const wstring filename, const ToneMapSettings& settings)
 {
     auto resources = PngWriterResources(filename);
 
@@ -120,33 +108,44 @@ void write_png(UINT width, UINT height, vector<unsigned>& red, vector<unsigned>&
     GUID pixel_format = GUID_WICPixelFormat32bppBGRA;
     throw_hresult_on_failure(frame->SetPixelFormat(&pixel_format));
 
-    const unsigned max_red = *max_element(begin(red), end(red));
-    const unsigned max_green = *max_element(begin(green), end(green));
-    const unsigned max_blue = *max_element(begin(blue), end(blue));
-
-    // cout << max_red << ":" << max_green << ":" << max_blue << endl;
+    const auto map = make_rgb_tone_map(channel_statistics(red), channel_statistics(green), channel_statistics(blue), settings);
 
     auto buffer = vector<BYTE>(width * height * 4);
     {
         array_view<unsigned, 2> bufferView(height, width, reinterpret_cast<unsigned*>(buffer.data()));
-        array_view<unsigned, 1> red_view(height * width, red);
-        array_view<unsigned, 1> green_view(height * width, green);
-        array_view<unsigned, 1> blue_view(height * width, blue);
+        bufferView.discard_data();
 
         parallel_for_each(bufferView.extent,
             [=](index<2> idx) restrict(amp)
             {
-                bufferView[idx] = 255 << 24 |
-                    static_cast<unsigned>(255 * concurrency::fast_math::sqrt(red_view[idx[1] + (width * idx[0])] / static_cast<float>(max_red))) << 16 |
-                    static_cast<unsigned>(255 * concurrency::fast_math::sqrt(green_view[idx[1] + (width * idx[0])] / static_cast<float>(max_green))) << 8 |
-                    static_cast<unsigned>(255 * concurrency::fast_math::sqrt(blue_view[idx[1] + (width * idx[0])] / static_cast<float>(max_blue)));
+                bufferView[idx] = map.bgra(red[idx], green[idx], blue[idx]);
             }
         );
-
-        bufferView.synchronize();
     }
 
     throw_hresult_on_failure(frame->WritePixels(height, width * 4, width * height * 4, buffer.data()));
     throw_hresult_on_failure(frame->Commit());
     throw_hresult_on_failure(resources.encoder->Commit());
 }
+
+void write_png(UINT width, UINT height, vector<unsigned>& red, vector<unsigned>& green, vector<unsigned>& blue, const wstring filename, const ToneMapSettings& settings)
+{
+    auto resources = PngWriterResources(filename);
+
+    CComPtr<IWICBitmapFrameEncode> frame;
+    throw_hresult_on_failure(resources.encoder->CreateNewFrame(&frame, nullptr));
+    throw_hresult_on_failure(frame->Initialize(nullptr));
+    throw_hresult_on_failure(frame->SetSize(width, height));
+
+    GUID pixel_format = GUID_WICPixelFormat32bppBGRA;
+    throw_hresult_on_failure(frame->SetPixelFormat(&pixel_format));
+
+    const auto map = make_rgb_tone_map(channel_statistics(red), channel_statistics(green), channel_statistics(blue), settings);
+
+    auto buffer = vector<BYTE>(width * height * 4);
+    tone_map_to_bgra(width, height, red.data(), green.data(), blue.data(), reinterpret_cast<unsigned*>(buffer.data()), map);
+
+    throw_hresult_on_failure(frame->WritePixels(height, width * 4, width * height * 4, buffer.data()));
+    throw_hresult_on_failure(frame->Commit());
+    throw_hresult_on_failure(resources.encoder->Commit());
+}
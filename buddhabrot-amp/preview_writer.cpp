@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include <string>
+#include <vector>
+
+#define NOMINMAX
+#include <windows.h>
+#include <amp.h>
+
+#include "utilities.h"
+#include "preview_writer.h"
+#include "downsampler.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+namespace
+{
+    void put_big_endian(vector<BYTE>& out, uint32_t value)
+    {
+        out.push_back(static_cast<BYTE>(value >> 24));
+        out.push_back(static_cast<BYTE>(value >> 16));
+        out.push_back(static_cast<BYTE>(value >> 8));
+        out.push_back(static_cast<BYTE>(value));
+    }
+
+    // https://qoiformat.org/qoi-specification.pdf; input is the 0xAARRGGBB pixels the tone mapper produces
+    vector<BYTE> encode_qoi(unsigned width, unsigned height, const vector<unsigned>& pixels)
+    {
+        auto out = vector<BYTE>{ 'q', 'o', 'i', 'f' };
+        out.reserve(14 + pixels.size() * 4 + 8);
+        put_big_endian(out, width);
+        put_big_endian(out, height);
+        out.push_back(3);
+        out.push_back(0);
+
+        unsigned seen[64]{};
+        auto previous = 0xff000000u;
+        unsigned run = 0;
+
+        for (size_t i = 0; i < pixels.size(); ++i)
+        {
+            const auto pixel = pixels[i];
+            if (pixel == previous)
+            {
+                ++run;
+                if (run == 62 || i + 1 == pixels.size())
+                {
+                    out.push_back(static_cast<BYTE>(0xc0 | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0)
+            {
+                out.push_back(static_cast<BYTE>(0xc0 | (run - 1)));
+                run = 0;
+            }
+
+            const auto r = static_cast<BYTE>(pixel >> 16);
+            const auto g = static_cast<BYTE>(pixel >> 8);
+            const auto b = static_cast<BYTE>(pixel);
+            const auto hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+
+            if (seen[hash] == pixel)
+            {
+                out.push_back(static_cast<BYTE>(hash));
+            }
+            else
+            {
+                seen[hash] = pixel;
+
+                const auto dr = static_cast<signed char>(r - static_cast<BYTE>(previous >> 16));
+                const auto dg = static_cast<signed char>(g - static_cast<BYTE>(previous >> 8));
+                const auto db = static_cast<signed char>(b - static_cast<BYTE>(previous));
+                const auto dr_dg = dr - dg;
+                const auto db_dg = db - dg;
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    out.push_back(static_cast<BYTE>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                }
+                else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+                {
+                    out.push_back(static_cast<BYTE>(0x80 | (dg + 32)));
+                    out.push_back(static_cast<BYTE>((dr_dg + 8) << 4 | (db_dg + 8)));
+                }
+                else
+                {
+                    out.push_back(0xfe);
+                    out.push_back(r);
+                    out.push_back(g);
+                    out.push_back(b);
+                }
+            }
+
+            previous = pixel;
+        }
+
+        const BYTE end_marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+        out.insert(out.end(), begin(end_marker), end(end_marker));
+        return out;
+    }
+
+    vector<BYTE> encode_ppm(unsigned width, unsigned height, const vector<unsigned>& pixels)
+    {
+        const auto header = "P6\n" + to_string(width) + " " + to_string(height) + "\n255\n";
+        auto out = vector<BYTE>(header.begin(), header.end());
+        out.reserve(header.size() + pixels.size() * 3);
+        for (const auto pixel : pixels)
+        {
+            out.push_back(static_cast<BYTE>(pixel >> 16));
+            out.push_back(static_cast<BYTE>(pixel >> 8));
+            out.push_back(static_cast<BYTE>(pixel));
+        }
+        return out;
+    }
+
+    bool ends_with(const wstring& s, const wstring& suffix)
+    {
+        return s.size() >= suffix.size() && equal(suffix.rbegin(), suffix.rend(), s.rbegin(),
+            [](wchar_t a, wchar_t b)
+            {
+                return towlower(a) == towlower(b);
+            }
+        );
+    }
+}
+
+PreviewWriter::PreviewWriter(const wstring& filename, unsigned size, chrono::duration<double> interval, const ToneMapSettings& tone_map_settings) :
+    filename(filename),
+    size(size),
+    interval(interval),
+    tone_map_settings(tone_map_settings),
+    qoi(ends_with(filename, L".qoi")),
+    last_capture(chrono::steady_clock::now())
+{
+}
+
+PreviewWriter::~PreviewWriter()
+{
+    // the write task refers to this writer, so it has to finish first
+    unique_lock<std::mutex> lock(mutex);
+    written.wait(lock, [this]() { return !pending; });
+}
+
+void PreviewWriter::maybe_capture(const concurrency::array<unsigned, 2>& r, const concurrency::array<unsigned, 2>& g, const concurrency::array<unsigned, 2>& b)
+{
+    const auto now = chrono::steady_clock::now();
+    if (now - last_capture < interval) return;
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (pending) return;
+    }
+    last_capture = now;
+
+    const auto target = reduced_extent(r.get_extent(), size);
+
+    // the copies queue behind the kernels already issued, so all three channels come from the same frame
+    auto captured = make_shared<Snapshot>();
+    captured->height = target[0];
+    captured->width = target[1];
+    const concurrency::array<unsigned, 2>* channels[3] = { &r, &g, &b };
+    for (unsigned c = 0; c < 3; ++c)
+    {
+        captured->channels[c] = vector<unsigned>(size_t(target[0]) * target[1]);
+        concurrency::copy(reduce_counts(*channels[c], target, ReductionFilter::box), captured->channels[c].begin());
+    }
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        pending = true;
+    }
+
+    default_scheduler().submit(
+        [this, captured]()
+        {
+            try
+            {
+                write(*captured);
+            }
+            catch (...)
+            {
+                // a failed preview shouldn't take the render down with it, the next interval tries again. anything
+                //  escaping would also skip clearing pending below & leave the destructor waiting on it forever
+            }
+
+            lock_guard<std::mutex> lock(mutex);
+            pending = false;
+            written.notify_all();
+        }
+    );
+}
+
+void PreviewWriter::write(Snapshot& captured)
+{
+    auto& channels = captured.channels;
+    const auto map = make_rgb_tone_map(channel_statistics(channels[0]), channel_statistics(channels[1]), channel_statistics(channels[2]), tone_map_settings);
+
+    auto pixels = vector<unsigned>(size_t(captured.width) * captured.height);
+    tone_map_to_bgra(captured.width, captured.height, channels[0].data(), channels[1].data(), channels[2].data(), pixels.data(), map);
+
+    const auto encoded = qoi ? encode_qoi(captured.width, captured.height, pixels) : encode_ppm(captured.width, captured.height, pixels);
+
+    const auto temporary = filename + L".tmp";
+    {
+        auto file = FileHandle(CreateFileW(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+        write_file_at(file.handle, 0, encoded.data(), encoded.size());
+    }
+    throw_hresult_on_failure(MoveFileExW(temporary.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) ? S_OK : last_win32_error());
+}
@@ -0,0 +1,49 @@
+#ifndef _PREVIEW_WRITER_H_
+#define _PREVIEW_WRITER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <amp.h>
+
+#include "tone_mapping.h"
+
+// periodically writes a small QOI (for a .qoi filename) or binary PPM snapshot of the canvases; the file is
+//  written next to the target & renamed over it so readers never see a partial image
+class PreviewWriter
+{
+    public:
+        PreviewWriter(const std::wstring& filename, unsigned size, std::chrono::duration<double> interval, const ToneMapSettings&);
+        ~PreviewWriter();
+
+        // only a downsampled copy leaves the accelerator; tone mapping & encoding run as a task on the cpu
+        //  scheduler. a capture is skipped while the previous preview is still being written
+        void maybe_capture(const concurrency::array<unsigned, 2>& r, const concurrency::array<unsigned, 2>& g, const concurrency::array<unsigned, 2>& b);
+
+    private:
+        struct Snapshot
+        {
+            unsigned width;
+            unsigned height;
+            std::vector<unsigned> channels[3];
+        };
+
+        void write(Snapshot&);
+
+        const std::wstring filename;
+        const unsigned size;
+        const std::chrono::duration<double> interval;
+        const ToneMapSettings tone_map_settings;
+        const bool qoi;
+
+        std::chrono::steady_clock::time_point last_capture;
+        std::mutex mutex;
+        std::condition_variable written;
+        bool pending{ false };
+};
+
+#endif
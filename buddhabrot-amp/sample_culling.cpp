@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+#define NOMINMAX
+#include <windows.h>
+
+#include "utilities.h"
+#include "interval.h"
+#include "sample_culling.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+namespace
+{
+    const char CULLING_FILE_MAGIC[8] = { 'B', 'B', 'C', 'U', 'L', 'L', '\0', '\0' };
+    const uint32_t CULLING_FILE_VERSION = 1;
+
+    // the key of a classification is stored with it, so a file that doesn't match is simply reclassified
+    struct CullingFileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t depth;
+        uint32_t first_recorded;
+        uint32_t max_iterations;
+        float radius;
+        uint32_t reserved;
+        uint64_t count;
+        double escaping_fraction;
+        double bounded_fraction;
+    };
+
+    // squares are classified in parallel from this level (16 x 16) down
+    const unsigned TOP_LEVEL = 4;
+
+    // kept cells & culled areas, in cells of the finest level
+    struct Tally
+    {
+        vector<uint32_t> cells;
+        unsigned long long escaping;
+        unsigned long long bounded;
+    };
+
+    // square (x, y) of level covers 2^(depth - level) cells of the finest level a side
+    void subdivide(float radius, unsigned depth, unsigned level, unsigned x, unsigned y, unsigned first_recorded, unsigned max_iterations, Tally& tally)
+    {
+        const auto size = 2.0 * radius / (1u << level);
+        const auto area = 1ull << (2 * (depth - level));
+        switch (classify_square(-radius + x * size, -radius + y * size, size, first_recorded, max_iterations))
+        {
+            case SquareClass::escapes:
+                tally.escaping += area;
+                return;
+            case SquareClass::bounded:
+                tally.bounded += area;
+                return;
+            default:
+                break;
+        }
+
+        if (level == depth)
+        {
+            tally.cells.push_back((y << depth) + x);
+            return;
+        }
+        for (unsigned quarter = 0; quarter < 4; ++quarter)
+        {
+            subdivide(radius, depth, level + 1, x * 2 + (quarter & 1), y * 2 + (quarter >> 1), first_recorded, max_iterations, tally);
+        }
+    }
+
+    SampleCells classify_sample_square(float radius, unsigned depth, unsigned first_recorded, unsigned max_iterations)
+    {
+        const auto top = min(TOP_LEVEL, depth);
+        const auto top_side = 1u << top;
+        auto tallies = vector<Tally>(size_t(top_side) * top_side);
+        default_scheduler().parallel_for(0, tallies.size(), 1,
+            [&](size_t first, size_t last)
+            {
+                for (auto square = first; square < last; ++square)
+                {
+                    subdivide(radius, depth, top, unsigned(square % top_side), unsigned(square / top_side), first_recorded, max_iterations, tallies[square]);
+                }
+            }
+        );
+
+        auto result = SampleCells();
+        result.depth = depth;
+        auto escaping = 0ull;
+        auto bounded = 0ull;
+        for (const auto& tally : tallies)
+        {
+            result.cells.insert(result.cells.end(), tally.cells.begin(), tally.cells.end());
+            escaping += tally.escaping;
+            bounded += tally.bounded;
+        }
+        sort(result.cells.begin(), result.cells.end());
+
+        const auto total = double(1u << depth) * double(1u << depth);
+        result.escaping_fraction = escaping / total;
+        result.bounded_fraction = bounded / total;
+        return result;
+    }
+
+    wstring cache_filename(const wstring& directory, float radius, unsigned depth, unsigned first_recorded, unsigned max_iterations)
+    {
+        wstringstream name;
+        name << directory << L"\\cull-" << radius << L"-" << depth << L"-" << first_recorded << L"-" << max_iterations << L".bin";
+        return name.str();
+    }
+
+    bool read_cache(const wstring& filename, const CullingFileHeader& key, SampleCells& result)
+    {
+        const auto handle = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) return false;
+        const auto file = FileHandle(handle);
+
+        auto header = CullingFileHeader();
+        auto read = DWORD(0);
+        if (!ReadFile(file.handle, &header, sizeof(header), &read, nullptr) || read != sizeof(header)) return false;
+        if (memcmp(header.magic, key.magic, sizeof(header.magic)) != 0 || header.version != key.version || header.depth != key.depth
+            || header.first_recorded != key.first_recorded || header.max_iterations != key.max_iterations || header.radius != key.radius)
+        {
+            return false;
+        }
+
+        // a damaged file could otherwise size a huge read or place samples outside the square
+        const auto cell_count = 1ull << (2 * header.depth);
+        if (header.count > cell_count) return false;
+
+        auto cells = vector<uint32_t>(size_t(header.count));
+        const auto bytes = DWORD(cells.size() * sizeof(uint32_t));
+        if (!ReadFile(file.handle, cells.data(), bytes, &read, nullptr) || read != bytes) return false;
+        if (any_of(cells.begin(), cells.end(), [=](uint32_t cell) { return cell >= cell_count; })) return false;
+
+        result.depth = header.depth;
+        result.cells.swap(cells);
+        result.escaping_fraction = header.escaping_fraction;
+        result.bounded_fraction = header.bounded_fraction;
+        return true;
+    }
+
+    // written aside & renamed into place, so an interrupted write never leaves a truncated file for read_cache
+    void write_cache(const wstring& filename, const CullingFileHeader& header, const vector<uint32_t>& cells)
+    {
+        const auto temporary = filename + L".tmp";
+        {
+            auto file = FileHandle(CreateFileW(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+            write_file_at(file.handle, 0, &header, sizeof(header));
+            write_file_at(file.handle, sizeof(header), cells.data(), cells.size() * sizeof(uint32_t));
+        }
+        throw_hresult_on_failure(MoveFileExW(temporary.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) ? S_OK : last_win32_error());
+    }
+}
+
+SquareClass classify_square(double r, double i, double size, unsigned first_recorded, unsigned max_iterations)
+{
+    const auto c_r = Interval::outward(r, r + size);
+    const auto c_i = Interval::outward(i, i + size);
+
+    // the main cardioid & period 2 bulb in closed form (as in_cardioid_or_bulb), bounded over the whole square
+    const auto x = c_r - Interval::point(0.25);
+    const auto q = x.square() + c_i.square();
+    if ((q * (q + x) - Interval::point(0.25) * c_i.square()).hi <= 0.0) return SquareClass::bounded;
+    if (((c_r + Interval::point(1.0)).square() + c_i.square()).hi <= 0.0625) return SquareClass::bounded;
+
+    auto z_r = Interval::point(0.0);
+    auto z_i = Interval::point(0.0);
+    auto bounded = true;
+    for (unsigned n = 0; n < max_iterations; ++n)
+    {
+        const auto next_r = z_r.square() - z_i.square() + c_r;
+        z_i = Interval::point(2.0) * z_r * z_i + c_i;
+        z_r = next_r;
+
+        // every point has escaped, at n or earlier
+        const auto magnitude = z_r.square() + z_i.square();
+        if (magnitude.lo >= 4.0) return n < first_recorded ? SquareClass::escapes : SquareClass::undecided;
+
+        // written so NaNs from intervals that blew up fail as well
+        if (!(magnitude.hi < 4.0)) bounded = false;
+        if (!bounded && n + 1 >= first_recorded) return SquareClass::undecided;
+    }
+    return bounded ? SquareClass::bounded : SquareClass::undecided;
+}
+
+const SampleCells& cull_sample_square(float radius, unsigned first_recorded, unsigned max_iterations, const SampleCullingSettings& settings)
+{
+    static auto classified = map<tuple<float, unsigned, unsigned, unsigned>, SampleCells>();
+
+    const auto key = make_tuple(radius, settings.depth, first_recorded, max_iterations);
+    const auto found = classified.find(key);
+    if (found != classified.end()) return found->second;
+
+    auto header = CullingFileHeader();
+    copy(begin(CULLING_FILE_MAGIC), end(CULLING_FILE_MAGIC), header.magic);
+    header.version = CULLING_FILE_VERSION;
+    header.depth = settings.depth;
+    header.first_recorded = first_recorded;
+    header.max_iterations = max_iterations;
+    header.radius = radius;
+
+    const auto filename = settings.cache_directory.empty() ? wstring() : cache_filename(settings.cache_directory, radius, settings.depth, first_recorded, max_iterations);
+    auto result = SampleCells();
+    if (filename.empty() || !read_cache(filename, header, result))
+    {
+        result = classify_sample_square(radius, settings.depth, first_recorded, max_iterations);
+        if (!filename.empty())
+        {
+            header.count = result.cells.size();
+            header.escaping_fraction = result.escaping_fraction;
+            header.bounded_fraction = result.bounded_fraction;
+
+            // the cache only saves later runs the classification, so failing to write it doesn't stop this one
+            try
+            {
+                write_cache(filename, header, result.cells);
+            }
+            catch (...)
+            {
+                result.cache_write_failed = true;
+            }
+        }
+    }
+    return classified.emplace(key, move(result)).first->second;
+}
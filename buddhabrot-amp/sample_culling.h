@@ -0,0 +1,54 @@
+#ifndef _SAMPLE_CULLING_H_
+#define _SAMPLE_CULLING_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SampleCullingSettings
+{
+    // the sample square is subdivided down to 2^depth cells a side at most
+    unsigned depth{ 9 };
+    // when set, classifications are kept here & reused by later runs with the same sample radius, depth & iteration
+    //  bounds
+    std::wstring cache_directory;
+};
+
+// what is left of the sample square [-radius, radius]^2 once the squares proven to hold no recorded orbit are cut:
+//  the cells of the finest level (2^depth a side) that may still hold one, as row major indices with the real axis
+//  along the rows
+struct SampleCells
+{
+    unsigned depth;
+    std::vector<uint32_t> cells;
+    // shares of the square cut because all of their points escape too early to be recorded, or none escapes before
+    //  the cap
+    double escaping_fraction;
+    double bounded_fraction;
+    // the classification couldn't be kept in the cache directory; it was still computed & is used as usual
+    bool cache_write_failed{ false };
+
+    double kept_fraction() const
+    {
+        return double(cells.size()) / (double(1u << depth) * double(1u << depth));
+    }
+};
+
+enum class SquareClass
+{
+    escapes,
+    bounded,
+    undecided
+};
+
+// the square with corner (r, i) & side size: escapes when every point escapes before first_recorded, bounded
+//  when none escapes before max_iterations
+SquareClass classify_square(double r, double i, double size, unsigned first_recorded, unsigned max_iterations);
+
+// squares are iterated whole with interval arithmetic (rounded outwards, so every point's orbit stays inside the
+//  intervals) & cut when every point escapes before first_recorded or stays bounded for max_iterations; undecided
+//  squares are split in four down to settings.depth. the result is computed once per process for each radius,
+//  depth & pair of bounds, & once per cache directory when one is set
+const SampleCells& cull_sample_square(float radius, unsigned first_recorded, unsigned max_iterations, const SampleCullingSettings& settings);
+
+#endif
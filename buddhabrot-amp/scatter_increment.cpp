@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <intrin.h>
+#include <immintrin.h>
+
+#include "utilities.h"
+#include "scatter_increment.h"
+
+using namespace std;
+
+namespace
+{
+    const size_t LANES = 16;
+
+    // gather & scatter cost about as much as the scalar loop they replace on many processors, so the vector path
+    //  is opt in; benchmark_scatter_increment says which wins on a given machine
+    bool use_avx512 = false;
+
+    template<typename F> double time_seconds(F f)
+    {
+        const auto start = chrono::high_resolution_clock::now();
+        f();
+        return chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+    }
+}
+
+void scatter_increment(unsigned* counts, const unsigned* cells, size_t count)
+{
+    if (use_avx512)
+    {
+        scatter_increment_avx512(counts, cells, count);
+    }
+    else
+    {
+        scatter_increment_scalar(counts, cells, count);
+    }
+}
+
+void scatter_increment_scalar(unsigned* counts, const unsigned* cells, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) ++counts[cells[i]];
+}
+
+// sixteen cells at a time: gather, add, scatter. vpconflictd marks the lanes repeating an earlier lane's cell; each
+//  such lane finds its nearest earlier twin (31 - lzcnt) & the increments are summed down those chains by pointer
+//  jumping, so the last lane of every repeated cell ends up holding the total. scatters to the same address land in
+//  lane order, so that last lane is the write that sticks
+void scatter_increment_avx512(unsigned* counts, const unsigned* cells, size_t count)
+{
+    const auto none = _mm512_set1_epi32(-1);
+    const auto last_bit = _mm512_set1_epi32(31);
+    const auto one = _mm512_set1_epi32(1);
+
+    auto i = size_t();
+    for (; i + LANES <= count; i += LANES)
+    {
+        const auto indices = _mm512_loadu_si512(cells + i);
+        auto previous = _mm512_sub_epi32(last_bit, _mm512_lzcnt_epi32(_mm512_conflict_epi32(indices)));
+        auto increments = one;
+
+        for (auto chained = _mm512_cmpneq_epi32_mask(previous, none); chained != 0; chained = _mm512_mask_cmpneq_epi32_mask(chained, previous, none))
+        {
+            increments = _mm512_mask_add_epi32(increments, chained, increments, _mm512_maskz_permutexvar_epi32(chained, previous, increments));
+            previous = _mm512_mask_permutexvar_epi32(previous, chained, previous, previous);
+        }
+
+        const auto gathered = _mm512_i32gather_epi32(indices, counts, 4);
+        _mm512_i32scatter_epi32(counts, indices, _mm512_add_epi32(gathered, increments), 4);
+    }
+
+    scatter_increment_scalar(counts, cells + i, count - i);
+}
+
+bool enable_avx512_scatter(bool enable)
+{
+    use_avx512 = enable && has_avx512_conflict_detection();
+    return use_avx512;
+}
+
+bool has_avx512_conflict_detection()
+{
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // the os has to save the opmask & zmm state (xcr0 bits 1, 2 & 5-7) as well as the cpu supporting F & CD
+    __cpuid(info, 1);
+    const auto osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0xe6) != 0xe6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 28)) != 0;
+}
+
+ScatterBenchmark benchmark_scatter_increment(size_t cells, size_t increments)
+{
+    auto engine = mt19937(1);
+    auto anywhere = uniform_int_distribution<unsigned>(0, unsigned(cells - 1));
+    auto hot = uniform_int_distribution<unsigned>(0, unsigned(min<size_t>(cells, 256) - 1));
+    auto indices = vector<unsigned>(increments);
+    for (auto& index : indices) index = (engine() & 3) == 0 ? hot(engine) : anywhere(engine);
+
+    auto result = ScatterBenchmark();
+    result.increments = increments;
+
+    auto counts = vector<unsigned>(cells);
+    result.scalar_seconds = time_seconds([&]() { scatter_increment_scalar(counts.data(), indices.data(), indices.size()); });
+
+    if (has_avx512_conflict_detection())
+    {
+        auto vector_counts = vector<unsigned>(cells);
+        result.avx512_seconds = time_seconds([&]() { scatter_increment_avx512(vector_counts.data(), indices.data(), indices.size()); });
+        // both paths have to agree before either timing means anything
+        throw_hresult_on_failure(counts != vector_counts ? E_FAIL : S_OK);
+    }
+    return result;
+}
@@ -0,0 +1,30 @@
+#ifndef _SCATTER_INCREMENT_H_
+#define _SCATTER_INCREMENT_H_
+
+#include <cstddef>
+
+// adds one to counts[cells[i]] for every i, repeated cells included. counts must be private to the caller for the
+//  duration (an owned band, a worker's own histogram): nothing here is atomic
+void scatter_increment(unsigned* counts, const unsigned* cells, size_t count);
+
+// the two implementations scatter_increment picks between; the avx-512 one needs the F & CD extensions
+void scatter_increment_scalar(unsigned* counts, const unsigned* cells, size_t count);
+void scatter_increment_avx512(unsigned* counts, const unsigned* cells, size_t count);
+bool has_avx512_conflict_detection();
+// scatter_increment uses the scalar path unless this is called with true on a processor that has avx-512 F & CD;
+//  returns whether the avx-512 path is now in use
+bool enable_avx512_scatter(bool enable);
+
+struct ScatterBenchmark
+{
+    double scalar_seconds;
+    // 0 when the processor can't run the avx-512 path
+    double avx512_seconds;
+    size_t increments;
+};
+
+// times both paths over the same index stream into a cells sized histogram: a quarter of the indices fall on a
+//  small hot set, like the bright spine of a render, & the rest anywhere
+ScatterBenchmark benchmark_scatter_increment(size_t cells, size_t increments);
+
+#endif
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cstring>
+
+#define NOMINMAX
+#include <windows.h>
+
+#include "seed_log.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+namespace
+{
+    const char SEED_LOG_MAGIC[8] = { 'B', 'B', 'S', 'E', 'E', 'D', 'S', '\0' };
+    const uint32_t SEED_LOG_VERSION = 2;
+
+    struct SeedLogHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t max_iterations;
+        uint32_t min_iterations;
+    };
+
+    struct BlockHeader
+    {
+        uint32_t count;
+        uint32_t payload_size;
+        uint64_t samples;
+    };
+
+    // floats as unsigned integers that sort in the same order, so sorted values have small non negative deltas
+    uint32_t ordered_bits(float value)
+    {
+        auto bits = uint32_t();
+        memcpy(&bits, &value, sizeof(bits));
+        return (bits & 0x80000000) ? ~bits : bits | 0x80000000;
+    }
+
+    float from_ordered_bits(uint32_t ordered)
+    {
+        const auto bits = (ordered & 0x80000000) ? ordered & 0x7fffffff : ~ordered;
+        auto value = 0.0f;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    void put_varint(vector<uint8_t>& out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(uint8_t(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(uint8_t(value));
+    }
+
+    // a block is only trusted as far as its payload_size, so a corrupt one fails instead of reading past the mapping
+    const HRESULT BAD_FORMAT = HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+
+    uint32_t get_varint(const uint8_t*& in, const uint8_t* end)
+    {
+        auto value = uint32_t();
+        for (unsigned shift = 0; shift < 35; shift += 7)
+        {
+            throw_hresult_on_failure(in == end ? BAD_FORMAT : S_OK);
+            const auto byte = *in++;
+            value |= uint32_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        throw_hresult_on_failure(BAD_FORMAT);
+        return value;
+    }
+
+    void decode_block(const uint8_t* in, const uint8_t* end, uint32_t count, OrbitSeed* out)
+    {
+        auto r = uint32_t();
+        for (uint32_t s = 0; s < count; ++s)
+        {
+            r += get_varint(in, end);
+            auto i = uint32_t();
+            throw_hresult_on_failure(end - in < ptrdiff_t(sizeof(i)) ? BAD_FORMAT : S_OK);
+            memcpy(&i, in, sizeof(i));
+            in += sizeof(i);
+
+            out[s].r = from_ordered_bits(r);
+            out[s].i = from_ordered_bits(i);
+            out[s].escape_iteration = get_varint(in, end);
+        }
+    }
+
+    void check_header(const SeedLogHeader& header)
+    {
+        throw_hresult_on_failure(memcmp(header.magic, SEED_LOG_MAGIC, sizeof(SEED_LOG_MAGIC)) != 0 || header.version != SEED_LOG_VERSION ? BAD_FORMAT : S_OK);
+    }
+}
+
+SeedLogWriter::SeedLogWriter(const wstring& filename, uint32_t min_iterations, uint32_t max_iterations) :
+    file(CreateFileW(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr)),
+    offset(sizeof(SeedLogHeader))
+{
+    auto header = SeedLogHeader();
+    copy(begin(SEED_LOG_MAGIC), end(SEED_LOG_MAGIC), header.magic);
+    header.version = SEED_LOG_VERSION;
+    header.max_iterations = max_iterations;
+    header.min_iterations = min_iterations;
+    write_file_at(file.handle, 0, &header, sizeof(header));
+}
+
+void SeedLogWriter::append(vector<OrbitSeed>& seeds, unsigned long long samples)
+{
+    sort(seeds.begin(), seeds.end(),
+        [](const OrbitSeed& a, const OrbitSeed& b)
+        {
+            return ordered_bits(a.r) < ordered_bits(b.r);
+        }
+    );
+
+    buffer.assign(sizeof(BlockHeader), 0);
+    auto previous_r = uint32_t();
+    for (const auto& seed : seeds)
+    {
+        const auto r = ordered_bits(seed.r);
+        put_varint(buffer, r - previous_r);
+        previous_r = r;
+
+        const auto i = ordered_bits(seed.i);
+        const auto* i_bytes = reinterpret_cast<const uint8_t*>(&i);
+        buffer.insert(buffer.end(), i_bytes, i_bytes + sizeof(i));
+        put_varint(buffer, seed.escape_iteration);
+    }
+
+    auto header = BlockHeader();
+    header.count = static_cast<uint32_t>(seeds.size());
+    header.payload_size = static_cast<uint32_t>(buffer.size() - sizeof(BlockHeader));
+    header.samples = samples;
+    memcpy(buffer.data(), &header, sizeof(header));
+
+    write_file_at(file.handle, offset, buffer.data(), buffer.size());
+    offset += buffer.size();
+}
+
+SeedLogReader::SeedLogReader(const wstring& filename) :
+    file(CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr)),
+    mapping(CreateFileMappingW(file.handle, nullptr, PAGE_READONLY, 0, 0, nullptr), nullptr),
+    data(static_cast<const uint8_t*>(MapViewOfFile(mapping.handle, FILE_MAP_READ, 0, 0, 0)))
+{
+    throw_hresult_on_failure(data == nullptr ? last_win32_error() : S_OK);
+
+    auto file_size = LARGE_INTEGER();
+    throw_hresult_on_failure(GetFileSizeEx(file.handle, &file_size) ? S_OK : last_win32_error());
+    const auto size = uint64_t(file_size.QuadPart);
+
+    auto header = SeedLogHeader();
+    throw_hresult_on_failure(size < sizeof(header) ? BAD_FORMAT : S_OK);
+    memcpy(&header, data, sizeof(header));
+    check_header(header);
+    min_iterations = header.min_iterations;
+    max_iterations = header.max_iterations;
+
+    // only the block headers are touched here; payloads are paged in as they are decoded
+    for (auto position = uint64_t(sizeof(header)); position + sizeof(BlockHeader) <= size; )
+    {
+        auto block_header = BlockHeader();
+        memcpy(&block_header, data + position, sizeof(block_header));
+        const auto payload_offset = position + sizeof(BlockHeader);
+        if (payload_offset + block_header.payload_size > size) break;
+
+        // every seed takes at least a byte for each varint & four for its imaginary part
+        throw_hresult_on_failure(block_header.count > block_header.payload_size / 6 ? BAD_FORMAT : S_OK);
+
+        blocks.push_back({ payload_offset, block_header.payload_size, block_header.count, block_header.samples });
+        position = payload_offset + block_header.payload_size;
+    }
+}
+
+SeedLogReader::~SeedLogReader()
+{
+    UnmapViewOfFile(data);
+}
+
+void SeedLogReader::for_each_batch(size_t batch_size, const function<void(const vector<OrbitSeed>&, unsigned long long samples)>& consume) const
+{
+    auto seeds = vector<OrbitSeed>();
+    auto first_seed = vector<size_t>();
+    for (size_t first = 0; first < blocks.size(); )
+    {
+        // whole blocks until the batch is full
+        auto last = first;
+        auto seed_count = size_t();
+        auto samples = 0ull;
+        first_seed.clear();
+        while (last < blocks.size() && (last == first || seed_count + blocks[last].count <= batch_size))
+        {
+            first_seed.push_back(seed_count);
+            seed_count += blocks[last].count;
+            samples += blocks[last].samples;
+            ++last;
+        }
+
+        seeds.resize(seed_count);
+        default_scheduler().parallel_for(first, last, 1,
+            [&](size_t first_block, size_t last_block)
+            {
+                for (auto b = first_block; b < last_block; ++b)
+                {
+                    const auto* payload = data + blocks[b].payload_offset;
+                    decode_block(payload, payload + blocks[b].payload_size, blocks[b].count, seeds.data() + first_seed[b - first]);
+                }
+            }
+        );
+
+        consume(seeds, samples);
+        first = last;
+    }
+}
+
+tuple<uint32_t, uint32_t> read_seed_log_range(const wstring& filename)
+{
+    const auto file = FileHandle(CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+
+    auto header = SeedLogHeader();
+    auto read = DWORD(0);
+    throw_hresult_on_failure(ReadFile(file.handle, &header, sizeof(header), &read, nullptr) ? S_OK : last_win32_error());
+    throw_hresult_on_failure(read != sizeof(header) ? BAD_FORMAT : S_OK);
+    check_header(header);
+    return make_tuple(header.min_iterations, header.max_iterations);
+}
@@ -0,0 +1,77 @@
+#ifndef _SEED_LOG_H_
+#define _SEED_LOG_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "utilities.h"
+
+// an initial point whose orbit escaped at escape_iteration; replaying it needs no escape test
+struct OrbitSeed
+{
+    float r;
+    float i;
+    uint32_t escape_iteration;
+};
+
+// seed logs are a small header followed by independently decodable blocks, one per appended batch. within a block
+//  seeds are sorted by real part so it can be stored as varint deltas; a truncated trailing block (from a killed
+//  run) is ignored on read. a log holds every orbit escaping in [min_iterations, max_iterations) of the samples
+//  behind it, so only channels within that window replay complete
+class SeedLogWriter
+{
+    public:
+        SeedLogWriter(const std::wstring& filename, uint32_t min_iterations, uint32_t max_iterations);
+
+        // samples is the number of initial points drawn to find these seeds, so replayed histograms keep their totals
+        void append(std::vector<OrbitSeed>& seeds, unsigned long long samples);
+
+    private:
+        FileHandle file;
+        unsigned long long offset;
+        std::vector<uint8_t> buffer;
+};
+
+class SeedLogReader
+{
+    public:
+        SeedLogReader(const std::wstring& filename);
+        ~SeedLogReader();
+
+        uint32_t get_min_iterations() const
+        {
+            return min_iterations;
+        }
+        uint32_t get_max_iterations() const
+        {
+            return max_iterations;
+        }
+
+        // decodes about batch_size seeds worth of blocks at a time in parallel straight out of the mapped file &
+        //  hands each batch to consume along with the samples behind it
+        void for_each_batch(size_t batch_size, const std::function<void(const std::vector<OrbitSeed>&, unsigned long long samples)>& consume) const;
+
+    private:
+        struct Block
+        {
+            uint64_t payload_offset;
+            uint32_t payload_size;
+            uint32_t count;
+            uint64_t samples;
+        };
+
+        FileHandle file;
+        FileHandle mapping;
+        const uint8_t* data;
+        uint32_t min_iterations;
+        uint32_t max_iterations;
+        std::vector<Block> blocks;
+};
+
+// the [min_iterations, max_iterations) window of a seed log, from its header alone
+std::tuple<uint32_t, uint32_t> read_seed_log_range(const std::wstring& filename);
+
+#endif
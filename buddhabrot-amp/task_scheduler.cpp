@@ -0,0 +1,251 @@
+#define NOMINMAX
+#include <windows.h>
+
+#include "task_scheduler.h"
+
+using namespace std;
+
+namespace
+{
+    // lets a worker find its own deque, & tells apart calls made from outside the pool
+    thread_local const TaskScheduler* current_scheduler = nullptr;
+    thread_local unsigned current_worker = 0;
+
+    // one affinity per logical processor, dealt round robin across the numa nodes (& with them the processor groups,
+    //  so machines with more than 64 logical processors are covered as well): consecutive workers land on different
+    //  nodes, so any worker count spreads evenly over the memory each node holds
+    vector<GROUP_AFFINITY> processors_by_node()
+    {
+        auto nodes = vector<vector<GROUP_AFFINITY>>();
+        auto highest = ULONG();
+        if (!GetNumaHighestNodeNumber(&highest)) highest = 0;
+        for (USHORT node = 0; node <= highest; ++node)
+        {
+            auto node_mask = GROUP_AFFINITY();
+            if (!GetNumaNodeProcessorMaskEx(node, &node_mask) || node_mask.Mask == 0) continue;
+
+            nodes.emplace_back();
+            for (unsigned bit = 0; bit < sizeof(KAFFINITY) * 8; ++bit)
+            {
+                if ((node_mask.Mask >> bit & 1) == 0) continue;
+
+                auto affinity = GROUP_AFFINITY();
+                affinity.Group = node_mask.Group;
+                affinity.Mask = KAFFINITY(1) << bit;
+                nodes.back().push_back(affinity);
+            }
+        }
+
+        auto result = vector<GROUP_AFFINITY>();
+        for (size_t i = 0; ; ++i)
+        {
+            const auto before = result.size();
+            for (const auto& processors : nodes)
+            {
+                if (i < processors.size()) result.push_back(processors[i]);
+            }
+            if (result.size() == before) return result;
+        }
+    }
+
+    void pin_to_processor(unsigned index)
+    {
+        static const auto processors = processors_by_node();
+        if (index < processors.size()) SetThreadGroupAffinity(GetCurrentThread(), &processors[index], nullptr);
+    }
+}
+
+TaskScheduler::TaskScheduler(unsigned worker_count, bool pin)
+{
+    if (worker_count == 0) worker_count = max(1ul, GetActiveProcessorCount(ALL_PROCESSOR_GROUPS));
+
+    // every deque exists before any worker can try to steal from it
+    for (unsigned w = 0; w < worker_count; ++w) workers.push_back(make_unique<Worker>());
+    for (unsigned w = 0; w < worker_count; ++w)
+    {
+        workers[w]->thread = thread([this, w, pin]() { run_worker(w, pin); });
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        auto lock = unique_lock<mutex>(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers) worker->thread.join();
+}
+
+void TaskScheduler::parallel_for(size_t first, size_t last, size_t grain, const function<void(size_t, size_t)>& body)
+{
+    if (first >= last) return;
+
+    Group group;
+    try
+    {
+        split(first, last, max<size_t>(1, grain), body, group);
+    }
+    catch (...)
+    {
+        auto lock = unique_lock<mutex>(group.error_mutex);
+        if (!group.error) group.error = current_exception();
+    }
+
+    // help out (which also covers calls made from inside a task) until every piece has run
+    const auto self = current_scheduler == this ? current_worker : unsigned(workers.size());
+    while (group.pending.load() != 0)
+    {
+        if (!try_run_one(self)) this_thread::yield();
+    }
+
+    if (group.error) rethrow_exception(group.error);
+}
+
+void TaskScheduler::submit(function<void()> task)
+{
+    {
+        auto lock = unique_lock<mutex>(sleep_mutex);
+        background.push_back({ move(task), nullptr });
+        ++queued;
+    }
+    wake.notify_one();
+}
+
+void TaskScheduler::split(size_t first, size_t last, size_t grain, const function<void(size_t, size_t)>& body, Group& group)
+{
+    while (last - first > grain)
+    {
+        const auto middle = first + (last - first) / 2;
+
+        // counted before it is queued so a thief can't finish it first, & uncounted again if queueing fails
+        ++group.pending;
+        try
+        {
+            push({ [=, &body, &group]() { split(middle, last, grain, body, group); }, &group });
+        }
+        catch (...)
+        {
+            --group.pending;
+            throw;
+        }
+        last = middle;
+    }
+    body(first, last);
+}
+
+void TaskScheduler::push(Task task)
+{
+    // workers push onto their own deque; anything from outside the pool is dealt round robin
+    const auto target = current_scheduler == this ? current_worker : next_victim++ % workers.size();
+    {
+        auto& worker = *workers[target];
+        auto lock = unique_lock<mutex>(worker.mutex);
+        worker.tasks.push_back(move(task));
+    }
+
+    ++queued;
+    {
+        // taken so a worker between checking queued & waiting cannot miss the notification
+        auto lock = unique_lock<mutex>(sleep_mutex);
+    }
+    wake.notify_one();
+}
+
+bool TaskScheduler::try_run_one(unsigned self)
+{
+    auto task = Task();
+    auto found = false;
+
+    if (self < workers.size())
+    {
+        auto& own = *workers[self];
+        auto lock = unique_lock<mutex>(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    // steal from the front of someone else's deque, starting at a different victim each time
+    const auto start = next_victim++;
+    for (size_t v = 0; !found && v < workers.size(); ++v)
+    {
+        const auto victim = (start + v) % workers.size();
+        if (victim == self) continue;
+
+        auto& other = *workers[victim];
+        auto lock = unique_lock<mutex>(other.mutex);
+        if (!other.tasks.empty())
+        {
+            task = move(other.tasks.front());
+            other.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if (!found) return false;
+
+    --queued;
+    run_task(task);
+    return true;
+}
+
+bool TaskScheduler::try_run_background()
+{
+    auto task = Task();
+    {
+        auto lock = unique_lock<mutex>(sleep_mutex);
+        if (background.empty()) return false;
+        task = move(background.front());
+        background.pop_front();
+    }
+
+    --queued;
+    run_task(task);
+    return true;
+}
+
+void TaskScheduler::run_task(Task& task)
+{
+    try
+    {
+        task.run();
+    }
+    catch (...)
+    {
+        if (task.group != nullptr)
+        {
+            auto lock = unique_lock<mutex>(task.group->error_mutex);
+            if (!task.group->error) task.group->error = current_exception();
+        }
+    }
+
+    if (task.group != nullptr) --task.group->pending;
+}
+
+void TaskScheduler::run_worker(unsigned index, bool pin)
+{
+    current_scheduler = this;
+    current_worker = index;
+    if (pin) pin_to_processor(index);
+
+    for (;;)
+    {
+        if (try_run_one(index) || try_run_background()) continue;
+
+        // queued work is drained before a stopping scheduler lets its workers go
+        auto lock = unique_lock<mutex>(sleep_mutex);
+        wake.wait(lock, [this]() { return stopping || queued.load() != 0; });
+        if (stopping && queued.load() == 0) return;
+    }
+}
+
+TaskScheduler& default_scheduler()
+{
+    static TaskScheduler scheduler;
+    return scheduler;
+}
@@ -0,0 +1,81 @@
+#ifndef _TASK_SCHEDULER_H_
+#define _TASK_SCHEDULER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// work stealing pool for every cpu side stage. each worker owns a deque: it pushes & pops work at the back (so it
+//  keeps working on what is hot in its cache) while idle workers steal from the front, which holds the largest
+//  pieces of a split range
+class TaskScheduler
+{
+    public:
+        // workers == 0 uses one per logical processor; pinned workers are bound to one processor each, taking the numa
+        //  nodes in turn
+        explicit TaskScheduler(unsigned workers = 0, bool pin = true);
+        // runs every queued task to completion, then joins the workers
+        ~TaskScheduler();
+
+        unsigned get_worker_count() const
+        {
+            return unsigned(workers.size());
+        }
+
+        // calls body(first, last) over [first, last) in pieces of at least grain elements & returns once all of them
+        //  have run. ranges are split lazily in halves so thieves take big pieces; the calling thread helps rather
+        //  than blocking. the first exception thrown by body is rethrown here
+        void parallel_for(size_t first, size_t last, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+        // fire & forget; task must not throw. these wait in their own queue for a worker with nothing else to do &
+        //  are never picked up by a thread helping out in parallel_for, so a slow one (a preview write) can't stall it
+        void submit(std::function<void()> task);
+
+    private:
+        struct Group
+        {
+            std::atomic<size_t> pending{ 0 };
+            std::exception_ptr error;
+            std::mutex error_mutex;
+        };
+
+        struct Task
+        {
+            std::function<void()> run;
+            Group* group;
+        };
+
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+            std::thread thread;
+        };
+
+        void run_worker(unsigned index, bool pin);
+        void push(Task task);
+        bool try_run_one(unsigned self);
+        bool try_run_background();
+        void run_task(Task& task);
+        void split(size_t first, size_t last, size_t grain, const std::function<void(size_t, size_t)>& body, Group& group);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        // submitted tasks, guarded by sleep_mutex; queued counts these as well
+        std::deque<Task> background;
+        std::atomic<size_t> queued{ 0 };
+        std::atomic<unsigned> next_victim{ 0 };
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+        bool stopping{ false };
+};
+
+// shared by all of the cpu side stages, created on first use
+TaskScheduler& default_scheduler();
+
+#endif
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define NOMINMAX
+#include <windows.h>
+#include <amp.h>
+
+#include "utilities.h"
+#include "tiff_writer.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+namespace
+{
+    const unsigned LZW_CLEAR = 256;
+    const unsigned LZW_EOI = 257;
+    const unsigned LZW_FIRST = 258;
+    const unsigned LZW_MIN_BITS = 9;
+    const unsigned LZW_MAX_BITS = 12;
+    const unsigned LZW_TABLE_FULL = (1 << LZW_MAX_BITS) - 2;
+    const unsigned LZW_HASH_BITS = 13;
+    const unsigned LZW_HASH_SIZE = 1 << LZW_HASH_BITS;
+
+    struct BitWriter
+    {
+        // TIFF packs LZW codes most significant bit first
+        void put(unsigned code, unsigned bits)
+        {
+            buffer = (buffer << bits) | code;
+            count += bits;
+            while (count >= 8)
+            {
+                count -= 8;
+                out.push_back(static_cast<BYTE>(buffer >> count));
+            }
+            buffer &= (1u << count) - 1;
+        }
+
+        void flush()
+        {
+            if (count > 0) out.push_back(static_cast<BYTE>(buffer << (8 - count)));
+            buffer = 0;
+            count = 0;
+        }
+
+        vector<BYTE>& out;
+        uint32_t buffer;
+        unsigned count;
+    };
+
+    // code width & table resets follow libtiff's encoder exactly, readers depend on the decoder growing its
+    //  code width in lock step with us
+    vector<BYTE> lzw_compress(const BYTE* data, size_t size)
+    {
+        auto out = vector<BYTE>();
+        out.reserve(size / 2 + 16);
+        auto bits = BitWriter{ out, 0, 0 };
+
+        // open addressing table of (prefix code << 8 | byte) -> code; cleared whenever the code table fills
+        auto keys = vector<int32_t>(LZW_HASH_SIZE, -1);
+        auto codes = vector<uint16_t>(LZW_HASH_SIZE);
+        auto width = LZW_MIN_BITS;
+        auto next_code = LZW_FIRST;
+
+        bits.put(LZW_CLEAR, width);
+        if (size == 0)
+        {
+            bits.put(LZW_EOI, width);
+            bits.flush();
+            return out;
+        }
+
+        unsigned prefix = data[0];
+        for (size_t i = 1; i < size; ++i)
+        {
+            const auto key = static_cast<int32_t>(prefix << 8 | data[i]);
+            auto slot = (static_cast<uint32_t>(key) * 2654435761u) >> (32 - LZW_HASH_BITS);
+            while (keys[slot] != -1 && keys[slot] != key) slot = (slot + 1) & (LZW_HASH_SIZE - 1);
+
+            if (keys[slot] == key)
+            {
+                prefix = codes[slot];
+                continue;
+            }
+
+            bits.put(prefix, width);
+            keys[slot] = key;
+            codes[slot] = static_cast<uint16_t>(next_code++);
+            prefix = data[i];
+
+            if (next_code == LZW_TABLE_FULL)
+            {
+                bits.put(LZW_CLEAR, width);
+                fill(keys.begin(), keys.end(), -1);
+                width = LZW_MIN_BITS;
+                next_code = LZW_FIRST;
+            }
+            else if (next_code > (1u << width) - 1)
+            {
+                ++width;
+            }
+        }
+
+        // the decoder adds one more entry after the last code, which can widen the EOI code
+        bits.put(prefix, width);
+        if (++next_code == LZW_TABLE_FULL)
+        {
+            bits.put(LZW_CLEAR, width);
+            width = LZW_MIN_BITS;
+        }
+        else if (next_code > (1u << width) - 1)
+        {
+            ++width;
+        }
+        bits.put(LZW_EOI, width);
+        bits.flush();
+        return out;
+    }
+
+    concurrency::array<unsigned, 2> halve(const concurrency::array<unsigned, 2>& source)
+    {
+        const auto source_extent = source.get_extent();
+        auto result = concurrency::array<unsigned, 2>(concurrency::extent<2>((source_extent[0] + 1) / 2, (source_extent[1] + 1) / 2), source.accelerator_view);
+
+        parallel_for_each(result.extent,
+            [=, &source, &result](concurrency::index<2> idx) restrict(amp)
+            {
+                auto sum = 0u;
+                for (int dy = 0; dy < 2; ++dy)
+                {
+                    for (int dx = 0; dx < 2; ++dx)
+                    {
+                        const auto source_idx = concurrency::index<2>(idx[0] * 2 + dy, idx[1] * 2 + dx);
+                        if (source_extent.contains(source_idx)) sum += source[source_idx];
+                    }
+                }
+                result[idx] = sum;
+            }
+        );
+
+        return result;
+    }
+
+    struct TiffLevel
+    {
+        unsigned width;
+        unsigned height;
+        vector<uint64_t> tile_offsets;
+        vector<uint64_t> tile_byte_counts;
+    };
+
+    class TiffFile
+    {
+        public:
+            TiffFile(const wstring& filename) :
+                file(CreateFileW(filename.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr))
+            {
+            }
+
+            uint64_t append(const void* data, size_t size)
+            {
+                const auto offset = position;
+                write_file_at(file.handle, offset, data, size);
+                position += size;
+                return offset;
+            }
+
+            void align()
+            {
+                const BYTE zeros[8]{};
+                if (position % 8 != 0) append(zeros, size_t(8 - position % 8));
+            }
+
+            void write_level(const TiffLevel& level, unsigned tile_size, bool reduced)
+            {
+                align();
+                const auto tile_count = level.tile_offsets.size();
+
+                // arrays that don't fit in the 8 byte value field live out of line
+                auto offsets_value = level.tile_offsets[0];
+                auto counts_value = level.tile_byte_counts[0];
+                if (tile_count > 1)
+                {
+                    offsets_value = append(level.tile_offsets.data(), tile_count * sizeof(uint64_t));
+                    counts_value = append(level.tile_byte_counts.data(), tile_count * sizeof(uint64_t));
+                }
+
+                const uint64_t three_shorts_16 = 16ull | 16ull << 16 | 16ull << 32;
+                const uint64_t three_shorts_1 = 1ull | 1ull << 16 | 1ull << 32;
+
+                auto ifd = vector<BYTE>();
+                const uint64_t entry_count = 14;
+                put(ifd, entry_count);
+                put_entry(ifd, 254, TYPE_LONG, 1, reduced ? 1 : 0);      // NewSubfileType
+                put_entry(ifd, 256, TYPE_LONG, 1, level.width);          // ImageWidth
+                put_entry(ifd, 257, TYPE_LONG, 1, level.height);         // ImageLength
+                put_entry(ifd, 258, TYPE_SHORT, 3, three_shorts_16);     // BitsPerSample
+                put_entry(ifd, 259, TYPE_SHORT, 1, 5);                   // Compression: LZW
+                put_entry(ifd, 262, TYPE_SHORT, 1, 2);                   // PhotometricInterpretation: RGB
+                put_entry(ifd, 277, TYPE_SHORT, 1, 3);                   // SamplesPerPixel
+                put_entry(ifd, 284, TYPE_SHORT, 1, 1);                   // PlanarConfiguration: chunky
+                put_entry(ifd, 317, TYPE_SHORT, 1, 2);                   // Predictor: horizontal differencing
+                put_entry(ifd, 322, TYPE_LONG, 1, tile_size);            // TileWidth
+                put_entry(ifd, 323, TYPE_LONG, 1, tile_size);            // TileLength
+                put_entry(ifd, 324, TYPE_LONG8, tile_count, offsets_value);
+                put_entry(ifd, 325, TYPE_LONG8, tile_count, counts_value);
+                put_entry(ifd, 339, TYPE_SHORT, 3, three_shorts_1);      // SampleFormat: unsigned
+                put(ifd, uint64_t(0));
+
+                const auto ifd_offset = append(ifd.data(), ifd.size());
+                // chain from the header or the previous IFD's next pointer
+                write_file_at(file.handle, next_ifd_pointer, &ifd_offset, sizeof(ifd_offset));
+                next_ifd_pointer = ifd_offset + ifd.size() - sizeof(uint64_t);
+            }
+
+            void write_header()
+            {
+                auto header = vector<BYTE>{ 'I', 'I' };
+                put(header, uint16_t(43));
+                put(header, uint16_t(8));
+                put(header, uint16_t(0));
+                put(header, uint64_t(0));
+                write_file_at(file.handle, 0, header.data(), header.size());
+            }
+
+        private:
+            static const uint16_t TYPE_SHORT = 3;
+            static const uint16_t TYPE_LONG = 4;
+            static const uint16_t TYPE_LONG8 = 16;
+
+            template<typename T> static void put(vector<BYTE>& out, T value)
+            {
+                const auto* bytes = reinterpret_cast<const BYTE*>(&value);
+                out.insert(out.end(), bytes, bytes + sizeof(T));
+            }
+
+            static void put_entry(vector<BYTE>& out, uint16_t tag, uint16_t type, uint64_t count, uint64_t value)
+            {
+                put(out, tag);
+                put(out, type);
+                put(out, count);
+                put(out, value);
+            }
+
+            FileHandle file;
+            uint64_t position{ 16 };
+            uint64_t next_ifd_pointer{ 8 };
+    };
+
+    // a band is tile_size rows (fewer at the bottom) of every channel, copied off the accelerator in one go
+    vector<BYTE> encode_tile(const vector<unsigned> (&band)[3], const vector<unsigned> (&luts)[3], const ChannelToneMap* (&maps)[3],
+        unsigned band_rows, unsigned width, unsigned tile_x, unsigned tile_size)
+    {
+        auto tile = vector<uint16_t>(size_t(tile_size) * tile_size * 3, 0);
+        const auto first_column = tile_x * tile_size;
+        const auto columns = min(tile_size, width - first_column);
+
+        for (unsigned y = 0; y < band_rows; ++y)
+        {
+            auto* row = tile.data() + size_t(y) * tile_size * 3;
+            for (unsigned c = 0; c < 3; ++c)
+            {
+                const auto* counts = band[c].data() + size_t(y) * width + first_column;
+                const auto& lut = luts[c];
+                if (!lut.empty())
+                {
+                    for (unsigned x = 0; x < columns; ++x) row[x * 3 + c] = static_cast<uint16_t>(lut[counts[x]]);
+                }
+                else
+                {
+                    for (unsigned x = 0; x < columns; ++x) row[x * 3 + c] = static_cast<uint16_t>(65535.0f * maps[c]->apply(counts[x]));
+                }
+            }
+
+            // predictor 2 works on whole samples, right to left so each difference uses the original neighbour
+            for (auto i = tile_size * 3 - 1; i >= 3; --i) row[i] = static_cast<uint16_t>(row[i] - row[i - 3]);
+        }
+
+        return lzw_compress(reinterpret_cast<const BYTE*>(tile.data()), tile.size() * sizeof(uint16_t));
+    }
+
+    TiffLevel write_level_tiles(TiffFile& tiff, const concurrency::array<unsigned, 2>* (&channels)[3], const ToneMapSettings& settings, unsigned tile_size)
+    {
+        const auto extent = channels[0]->get_extent();
+
+        auto level = TiffLevel();
+        level.height = extent[0];
+        level.width = extent[1];
+
+        const auto map = make_rgb_tone_map(
+            rgb_statistics(concurrency::array_view<const unsigned, 2>(*channels[0]), concurrency::array_view<const unsigned, 2>(*channels[1]), concurrency::array_view<const unsigned, 2>(*channels[2])),
+            settings);
+        const ChannelToneMap* maps[3] = { &map.red, &map.green, &map.blue };
+        const vector<unsigned> luts[3] = { build_tone_lut(map.red, 65535.0f), build_tone_lut(map.green, 65535.0f), build_tone_lut(map.blue, 65535.0f) };
+
+        const auto tiles_across = (level.width + tile_size - 1) / tile_size;
+        const auto tiles_down = (level.height + tile_size - 1) / tile_size;
+
+        vector<unsigned> band[3];
+        for (unsigned tile_y = 0; tile_y < tiles_down; ++tile_y)
+        {
+            const auto first_row = tile_y * tile_size;
+            const auto band_rows = min(tile_size, level.height - first_row);
+            for (unsigned c = 0; c < 3; ++c)
+            {
+                band[c].resize(size_t(band_rows) * level.width);
+                const auto section = channels[c]->section(concurrency::index<2>(first_row, 0), concurrency::extent<2>(band_rows, level.width));
+                concurrency::copy(section, band[c].begin());
+            }
+
+            auto tiles = vector<vector<BYTE>>(tiles_across);
+            default_scheduler().parallel_for(0, tiles_across, 1,
+                [&](size_t first, size_t last)
+                {
+                    for (auto tile_x = first; tile_x < last; ++tile_x)
+                    {
+                        tiles[tile_x] = encode_tile(band, luts, maps, band_rows, level.width, unsigned(tile_x), tile_size);
+                    }
+                }
+            );
+
+            // tiles go out row by row in the order TIFF expects their offsets
+            for (const auto& tile : tiles)
+            {
+                level.tile_offsets.push_back(tiff.append(tile.data(), tile.size()));
+                level.tile_byte_counts.push_back(tile.size());
+            }
+        }
+
+        return level;
+    }
+}
+
+void write_tiled_bigtiff(const concurrency::array<unsigned, 2>& red, const concurrency::array<unsigned, 2>& green, const concurrency::array<unsigned, 2>& blue, const wstring& filename, const ToneMapSettings& settings, const TiffSettings& tiff_settings)
+{
+    const auto tile_size = tiff_settings.tile_size;
+    throw_hresult_on_failure(tile_size == 0 || tile_size % 16 != 0 ? E_INVALIDARG : S_OK);
+
+    auto tiff = TiffFile(filename);
+    tiff.write_header();
+
+    auto levels = vector<TiffLevel>();
+    const concurrency::array<unsigned, 2>* channels[3] = { &red, &green, &blue };
+    unique_ptr<concurrency::array<unsigned, 2>> reduced[3];
+
+    for (unsigned level = 0; level <= tiff_settings.pyramid_levels; ++level)
+    {
+        levels.push_back(write_level_tiles(tiff, channels, settings, tile_size));
+
+        const auto extent = channels[0]->get_extent();
+        if (level == tiff_settings.pyramid_levels || (unsigned(extent[0]) <= tile_size && unsigned(extent[1]) <= tile_size)) break;
+
+        // each level is summed down from the one before it on the accelerator
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            reduced[c] = make_unique<concurrency::array<unsigned, 2>>(halve(*channels[c]));
+            channels[c] = reduced[c].get();
+        }
+    }
+
+    for (size_t l = 0; l < levels.size(); ++l)
+    {
+        tiff.write_level(levels[l], tile_size, l > 0);
+    }
+}
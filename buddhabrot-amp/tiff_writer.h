@@ -0,0 +1,22 @@
+#ifndef _TIFF_WRITER_H_
+#define _TIFF_WRITER_H_
+
+#include <string>
+
+#include <amp.h>
+
+#include "tone_mapping.h"
+
+struct TiffSettings
+{
+    // tiles are square; TIFF requires a multiple of 16
+    unsigned tile_size{ 256 };
+    // each extra level halves the previous one & is stored as a reduced resolution image after the full one
+    unsigned pyramid_levels{ 0 };
+};
+
+// writes a tiled BigTIFF with 16 bit RGB channels; tiles are LZW compressed in parallel one band of tiles at a
+//  time, so the full image is never held on the cpu
+void write_tiled_bigtiff(const concurrency::array<unsigned, 2>& red, const concurrency::array<unsigned, 2>& green, const concurrency::array<unsigned, 2>& blue, const std::wstring& filename, const ToneMapSettings&, const TiffSettings&);
+
+#endif
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <vector>
+
+#include <amp.h>
+
+#include "tone_mapping.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+namespace
+{
+    // slots per channel in the tiled reduction: bins followed by the lit pixel count & the max
+    const unsigned STATISTICS_SLOTS = TONE_MAP_BINS + 2;
+
+    // counts_at(index<2>, channel) reads one channel's count, however the counts are laid out. every channel is
+    //  reduced in the same dispatch & read back at once, so a frame waits on the accelerator once rather than per
+    //  channel
+    template<unsigned Channels, typename CountsAt> RgbStatistics tiled_statistics(concurrency::extent<2> extent, const CountsAt& counts_at)
+    {
+        static_assert(Channels * STATISTICS_SLOTS <= 16 * 16, "every slot is cleared & flushed by one thread of a tile");
+
+        auto result = vector<unsigned>(Channels * STATISTICS_SLOTS, 0);
+        auto result_view = concurrency::array_view<unsigned, 1>(int(result.size()), result);
+
+        // per tile histograms in tile_static memory keep the global atomics down to a handful per tile
+        parallel_for_each(extent.tile<16, 16>().pad(),
+            [=](concurrency::tiled_index<16, 16> tidx) restrict(amp)
+            {
+                tile_static unsigned local[Channels * STATISTICS_SLOTS];
+                const auto local_id = unsigned(tidx.local[0] * 16 + tidx.local[1]);
+
+                if (local_id < Channels * STATISTICS_SLOTS) local[local_id] = 0;
+                tidx.barrier.wait();
+
+                if (extent.contains(tidx.global))
+                {
+                    for (unsigned channel = 0; channel < Channels; ++channel)
+                    {
+                        const auto count = counts_at(tidx.global, channel);
+                        if (count == 0) continue;
+
+                        auto* slots = &local[channel * STATISTICS_SLOTS];
+                        concurrency::atomic_fetch_inc(&slots[tone_map_bin(count)]);
+                        concurrency::atomic_fetch_inc(&slots[TONE_MAP_BINS]);
+                        concurrency::atomic_fetch_max(&slots[TONE_MAP_BINS + 1], count);
+                    }
+                }
+                tidx.barrier.wait();
+
+                if (local_id >= Channels * STATISTICS_SLOTS) return;
+                if (local_id % STATISTICS_SLOTS != TONE_MAP_BINS + 1)
+                {
+                    if (local[local_id] > 0) concurrency::atomic_fetch_add(&result_view[local_id], local[local_id]);
+                }
+                else
+                {
+                    concurrency::atomic_fetch_max(&result_view[local_id], local[local_id]);
+                }
+            }
+        );
+        result_view.synchronize();
+
+        auto stats = RgbStatistics();
+        ChannelStatistics* channels[3] = { &stats.red, &stats.green, &stats.blue };
+        for (unsigned channel = 0; channel < Channels; ++channel)
+        {
+            const auto slots = result.begin() + channel * STATISTICS_SLOTS;
+            copy(slots, slots + TONE_MAP_BINS, channels[channel]->bins);
+            channels[channel]->lit_pixels = slots[TONE_MAP_BINS];
+            channels[channel]->max = slots[TONE_MAP_BINS + 1];
+        }
+        return stats;
+    }
+}
+
+RgbStatistics rgb_statistics(const concurrency::array_view<const unsigned, 2>& r, const concurrency::array_view<const unsigned, 2>& g, const concurrency::array_view<const unsigned, 2>& b)
+{
+    return tiled_statistics<3>(r.get_extent(),
+        [=](concurrency::index<2> idx, unsigned channel) restrict(amp)
+        {
+            return channel == 0 ? r[idx] : channel == 1 ? g[idx] : b[idx];
+        }
+    );
+}
+
+RgbStatistics rgb_statistics(const concurrency::array_view<const unsigned, 3>& cells)
+{
+    return tiled_statistics<3>(concurrency::extent<2>(cells.get_extent()[0], cells.get_extent()[1]),
+        [=](concurrency::index<2> idx, unsigned channel) restrict(amp)
+        {
+            return cells[concurrency::index<3>(idx[0], idx[1], int(channel))];
+        }
+    );
+}
+
+ChannelStatistics channel_statistics(const vector<unsigned>& counts)
+{
+    // one partial per block, combined once every block is done
+    const size_t block = 1 << 16;
+    auto partial = vector<ChannelStatistics>((counts.size() + block - 1) / block);
+    default_scheduler().parallel_for(0, partial.size(), 1,
+        [&](size_t first, size_t last)
+        {
+            for (auto b = first; b < last; ++b)
+            {
+                auto& stats = partial[b];
+                const auto end = min(counts.size(), (b + 1) * block);
+                for (auto i = b * block; i < end; ++i)
+                {
+                    const auto count = counts[i];
+                    if (count == 0) continue;
+                    ++stats.bins[tone_map_bin(count)];
+                    ++stats.lit_pixels;
+                    stats.max = max(stats.max, count);
+                }
+            }
+        }
+    );
+
+    auto stats = ChannelStatistics();
+    for (const auto& s : partial)
+    {
+        for (unsigned b = 0; b < TONE_MAP_BINS; ++b) stats.bins[b] += s.bins[b];
+        stats.lit_pixels += s.lit_pixels;
+        stats.max = max(stats.max, s.max);
+    }
+    return stats;
+}
+
+ChannelToneMap make_channel_tone_map(const ChannelStatistics& stats, const ToneMapSettings& settings, unsigned channel)
+{
+    auto map = ChannelToneMap();
+    map.curve = static_cast<unsigned>(settings.curve);
+    map.max_count = stats.max;
+    map.exposure = settings.exposure[channel];
+    map.gamma = settings.gamma;
+
+    // the white point is the upper edge of the bin holding the requested percentile, never above the real max
+    auto white = static_cast<float>(max(stats.max, 1u));
+    if (settings.clip_percentile < 100.0f && stats.lit_pixels > 0)
+    {
+        const auto target = static_cast<double>(stats.lit_pixels) * settings.clip_percentile / 100.0;
+        auto cumulative = 0.0;
+        for (unsigned b = 0; b < TONE_MAP_BINS; ++b)
+        {
+            cumulative += stats.bins[b];
+            if (cumulative >= target)
+            {
+                white = min(white, pow(2.0f, (b + 1) / 2.0f));
+                break;
+            }
+        }
+    }
+    map.white = white;
+
+    switch (settings.curve)
+    {
+        case ToneCurve::log:
+            map.curve_scale = 1.0f / log(1.0f + white);
+            break;
+        case ToneCurve::asinh:
+            map.curve_scale = 1.0f / tone_math::asinh(white);
+            break;
+        default:
+            map.curve_scale = 1.0f;
+    }
+
+    auto cumulative = 0.0;
+    const auto lit = static_cast<double>(max(stats.lit_pixels, 1u));
+    map.cdf[0] = 0.0f;
+    for (unsigned b = 0; b < TONE_MAP_BINS; ++b)
+    {
+        cumulative += stats.bins[b];
+        map.cdf[b + 1] = static_cast<float>(cumulative / lit);
+    }
+
+    return map;
+}
+
+RgbToneMap make_rgb_tone_map(const ChannelStatistics& r, const ChannelStatistics& g, const ChannelStatistics& b, const ToneMapSettings& settings)
+{
+    return RgbToneMap{ make_channel_tone_map(r, settings, 0), make_channel_tone_map(g, settings, 1), make_channel_tone_map(b, settings, 2) };
+}
+
+RgbToneMap make_rgb_tone_map(const RgbStatistics& stats, const ToneMapSettings& settings)
+{
+    return make_rgb_tone_map(stats.red, stats.green, stats.blue, settings);
+}
+
+vector<unsigned> build_tone_lut(const ChannelToneMap& map, float scale, unsigned shift)
+{
+    if (map.max_count > TONE_MAP_LUT_LIMIT) return vector<unsigned>();
+
+    auto lut = vector<unsigned>(map.max_count + 1);
+    default_scheduler().parallel_for(0, lut.size(), 1 << 12,
+        [&](size_t first, size_t last)
+        {
+            for (auto count = first; count < last; ++count)
+            {
+                lut[count] = static_cast<unsigned>(scale * map.apply(unsigned(count))) << shift;
+            }
+        }
+    );
+    return lut;
+}
+
+void tone_map_to_bgra(unsigned width, unsigned height, const unsigned* r, const unsigned* g, const unsigned* b, unsigned* output, const RgbToneMap& map)
+{
+    // luts hold the already shifted channel bits so a row is three loads & two ors per pixel
+    const auto r_lut = build_tone_lut(map.red, 255.0f, 16);
+    const auto g_lut = build_tone_lut(map.green, 255.0f, 8);
+    const auto b_lut = build_tone_lut(map.blue, 255.0f, 0);
+
+    if (r_lut.empty() || g_lut.empty() || b_lut.empty())
+    {
+        default_scheduler().parallel_for(0, height, 4,
+            [&](size_t first, size_t last)
+            {
+                for (auto y = first; y < last; ++y)
+                {
+                    const auto row = y * width;
+                    for (unsigned x = 0; x < width; ++x)
+                    {
+                        output[row + x] = map.bgra(r[row + x], g[row + x], b[row + x]);
+                    }
+                }
+            }
+        );
+        return;
+    }
+
+    const auto* r_table = r_lut.data();
+    const auto* g_table = g_lut.data();
+    const auto* b_table = b_lut.data();
+    default_scheduler().parallel_for(0, height, 4,
+        [&](size_t first, size_t last)
+        {
+            for (auto y = first; y < last; ++y)
+            {
+                const auto row = y * width;
+                const auto* r_row = r + row;
+                const auto* g_row = g + row;
+                const auto* b_row = b + row;
+                auto* out_row = output + row;
+                for (unsigned x = 0; x < width; ++x)
+                {
+                    out_row[x] = 255u << 24 | r_table[r_row[x]] | g_table[g_row[x]] | b_table[b_row[x]];
+                }
+            }
+        }
+    );
+}
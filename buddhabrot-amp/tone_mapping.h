@@ -0,0 +1,151 @@
+#ifndef _TONE_MAPPING_H_
+#define _TONE_MAPPING_H_
+
+#include <vector>
+#include <cmath>
+
+#include <amp.h>
+#include <amp_math.h>
+
+enum class ToneCurve : unsigned
+{
+    sqrt,
+    gamma,
+    log,
+    asinh,
+    equalize
+};
+
+struct ToneMapSettings
+{
+    ToneCurve curve{ ToneCurve::sqrt };
+    float gamma{ 0.5f };
+    // counts above this percentile of lit pixels saturate; 100 maps the brightest pixel to white
+    float clip_percentile{ 100.0f };
+    float exposure[3]{ 1.0f, 1.0f, 1.0f };
+};
+
+// counts are binned per half octave, which covers the full unsigned range
+const unsigned TONE_MAP_BINS = 64;
+
+// counts at or below this get mapped through a precomputed table on the cpu
+const unsigned TONE_MAP_LUT_LIMIT = 1 << 20;
+
+struct ChannelStatistics
+{
+    unsigned max;
+    unsigned lit_pixels;
+    unsigned bins[TONE_MAP_BINS];
+};
+
+// the kernels need their callees defined in the same translation unit (see buddhabrot_generator.cpp), hence
+//  everything restrict(amp) in here is defined inline; overloading on restrict picks the math library per side
+namespace tone_math
+{
+    inline float sqrt(float x) restrict(cpu) { return std::sqrt(x); }
+    inline float sqrt(float x) restrict(amp) { return concurrency::fast_math::sqrt(x); }
+    inline float pow(float x, float y) restrict(cpu) { return std::pow(x, y); }
+    inline float pow(float x, float y) restrict(amp) { return concurrency::fast_math::pow(x, y); }
+    inline float log(float x) restrict(cpu) { return std::log(x); }
+    inline float log(float x) restrict(amp) { return concurrency::fast_math::log(x); }
+    inline float log2(float x) restrict(cpu) { return std::log2(x); }
+    inline float log2(float x) restrict(amp) { return concurrency::fast_math::log2(x); }
+
+    inline float asinh(float x) restrict(cpu, amp)
+    {
+        return log(x + sqrt(x * x + 1.0f));
+    }
+}
+
+inline unsigned tone_map_bin(unsigned count) restrict(cpu, amp)
+{
+    const auto bin = static_cast<unsigned>(2.0f * tone_math::log2(static_cast<float>(count)));
+    return bin < TONE_MAP_BINS ? bin : TONE_MAP_BINS - 1;
+}
+
+// everything needed to map one channel's counts to [0, 1]; plain data so kernels can capture it by value
+struct ChannelToneMap
+{
+    float apply(unsigned count) const restrict(cpu, amp)
+    {
+        const auto exposed = count * exposure;
+        if (exposed <= 0.0f) return 0.0f;
+
+        auto value = 0.0f;
+        switch (curve)
+        {
+            case static_cast<unsigned>(ToneCurve::gamma):
+                value = tone_math::pow(exposed / white, gamma);
+                break;
+            case static_cast<unsigned>(ToneCurve::log):
+                value = tone_math::log(1.0f + exposed) * curve_scale;
+                break;
+            case static_cast<unsigned>(ToneCurve::asinh):
+                value = tone_math::asinh(exposed) * curve_scale;
+                break;
+            case static_cast<unsigned>(ToneCurve::equalize):
+            {
+                // linear between bin edges; edges sit at 2^(bin / 2)
+                const auto position = 2.0f * tone_math::log2(exposed);
+                const auto bin = position < 0.0f ? 0u : static_cast<unsigned>(position);
+                if (bin >= TONE_MAP_BINS) return 1.0f;
+                const auto fraction = position < 0.0f ? 0.0f : position - bin;
+                value = cdf[bin] + fraction * (cdf[bin + 1] - cdf[bin]);
+                break;
+            }
+            default:
+                value = tone_math::sqrt(exposed / white);
+        }
+        return value < 1.0f ? value : 1.0f;
+    }
+
+    unsigned curve;
+    unsigned max_count;
+    float white;
+    float exposure;
+    float gamma;
+    float curve_scale;
+    // fraction of lit pixels below each bin edge, used by ToneCurve::equalize
+    float cdf[TONE_MAP_BINS + 1];
+};
+
+struct RgbToneMap
+{
+    // packed the way WIC's 32bppBGRA expects it
+    unsigned bgra(unsigned r, unsigned g, unsigned b) const restrict(cpu, amp)
+    {
+        return 255u << 24 |
+            static_cast<unsigned>(255.0f * red.apply(r)) << 16 |
+            static_cast<unsigned>(255.0f * green.apply(g)) << 8 |
+            static_cast<unsigned>(255.0f * blue.apply(b));
+    }
+
+    ChannelToneMap red;
+    ChannelToneMap green;
+    ChannelToneMap blue;
+};
+
+struct RgbStatistics
+{
+    ChannelStatistics red;
+    ChannelStatistics green;
+    ChannelStatistics blue;
+};
+
+// all three channels on the accelerator in one dispatch & one readback
+RgbStatistics rgb_statistics(const concurrency::array_view<const unsigned, 2>& r, const concurrency::array_view<const unsigned, 2>& g, const concurrency::array_view<const unsigned, 2>& b);
+// interleaved (row, column, channel) cells, read in place
+RgbStatistics rgb_statistics(const concurrency::array_view<const unsigned, 3>& cells);
+ChannelStatistics channel_statistics(const std::vector<unsigned>& counts);
+
+ChannelToneMap make_channel_tone_map(const ChannelStatistics&, const ToneMapSettings&, unsigned channel);
+RgbToneMap make_rgb_tone_map(const ChannelStatistics& r, const ChannelStatistics& g, const ChannelStatistics& b, const ToneMapSettings&);
+RgbToneMap make_rgb_tone_map(const RgbStatistics&, const ToneMapSettings&);
+
+// table of scale * apply(count) << shift for every count up to the channel max; empty when the max is over TONE_MAP_LUT_LIMIT
+std::vector<unsigned> build_tone_lut(const ChannelToneMap&, float scale, unsigned shift = 0);
+
+// integer counts that fit under TONE_MAP_LUT_LIMIT go through a table built once per channel; rows run in parallel
+void tone_map_to_bgra(unsigned width, unsigned height, const unsigned* r, const unsigned* g, const unsigned* b, unsigned* output, const RgbToneMap&);
+
+#endif
@@ -4,3 +4,25 @@ void throw_hresult_on_failure(HRESULT hr)
 {
     if (FAILED(hr)) throw hr;
 }
+
+HRESULT last_win32_error()
+{
+    return HRESULT_FROM_WIN32(GetLastError());
+}
+
+void write_file_at(HANDLE file, unsigned long long offset, const void* data, size_t size)
+{
+    auto position = LARGE_INTEGER();
+    position.QuadPart = static_cast<LONGLONG>(offset);
+    throw_hresult_on_failure(SetFilePointerEx(file, position, nullptr, FILE_BEGIN) ? S_OK : last_win32_error());
+
+    const auto* bytes = static_cast<const BYTE*>(data);
+    while (size > 0)
+    {
+        const auto chunk = static_cast<DWORD>(size < (1u << 30) ? size : (1u << 30));
+        DWORD written = 0;
+        throw_hresult_on_failure(WriteFile(file, bytes, chunk, &written, nullptr) ? S_OK : last_win32_error());
+        bytes += written;
+        size -= written;
+    }
+}
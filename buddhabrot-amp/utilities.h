@@ -59,28 +59,38 @@ template<typename DurationType = std::chrono::duration<double>> class Timer
 
 template<typename T> struct Complex
 {
-    Complex(T real, T imaginary) restrict(amp) : r(real), i(imaginary)
+    Complex(T real, T imaginary) restrict(cpu, amp) : r(real), i(imaginary)
     {
     }
 
-    Complex& operator=(const Complex& other) restrict(amp)
+    Complex& operator=(const Complex& other) restrict(cpu, amp)
     {
         r = other.r;
         i = other.i;
         return *this;
     }
 
-    Complex operator+(const Complex& other) const restrict(amp)
+    Complex operator+(const Complex& other) const restrict(cpu, amp)
     {
         return Complex(r + other.r, i + other.i);
     }
 
-    Complex operator*(const Complex& other) const restrict(amp)
+    Complex operator-(const Complex& other) const restrict(cpu, amp)
+    {
+        return Complex(r - other.r, i - other.i);
+    }
+
+    Complex operator*(const Complex& other) const restrict(cpu, amp)
     {
         return Complex(r * other.r - (i * other.i), r * other.i + other.r * i);
     }
 
-    T magnitude_squared() const restrict(amp)
+    Complex conjugate() const restrict(cpu, amp)
+    {
+        return Complex(r, -i);
+    }
+
+    T magnitude_squared() const restrict(cpu, amp)
     {
         return r * r + i * i;
     }
@@ -89,11 +99,44 @@ template<typename T> struct Complex
     T i;
 };
 
-void write_png(UINT width, UINT height, std::vector<unsigned>& red, std::vector<unsigned>& green, std::vector<unsigned>& blue, const std::wstring filename);
-void write_png_from_array_views(UINT width, UINT height, const concurrency::array_view<unsigned, 2>& red, const concurrency::array_view<unsigned, 2>& green, const concurrency::array_view<unsigned, 2>& blue, const std::wstring filename);
-void write_png_from_arrays(UINT width, UINT height, const concurrency::array<unsigned, 2>& red, const concurrency::array<unsigned, 2>& green, const concurrency::array<unsigned, 2>& blue, const std::wstring filename);
+struct ToneMapSettings;
+
+void write_png(UINT width, UINT height, std::vector<unsigned>& red, std::vector<unsigned>& green, std::vector<unsigned>& blue, const std::wstring filename, const ToneMapSettings& settings);
+void write_png_from_array_views(UINT width, UINT height, const concurrency::array_view<unsigned, 2>& red, const concurrency::array_view<unsigned, 2>& green, const concurrency::array_view<unsigned, 2>& blue, const std::wstring filename, const ToneMapSettings& settings);
+void write_png_from_arrays(UINT width, UINT height, const concurrency::array<unsigned, 2>& red, const concurrency::array<unsigned, 2>& green, const concurrency::array<unsigned, 2>& blue, const std::wstring filename, const ToneMapSettings& settings);
+// counts interleaved as (row, column, channel) with red, green & blue in channels 0-2
+void write_png_from_interleaved(UINT width, UINT height, const concurrency::array<unsigned, 3>& cells, const std::wstring filename, const ToneMapSettings& settings);
 
 void throw_hresult_on_failure(HRESULT);
+HRESULT last_win32_error();
+
+// owns a win32 handle; CreateFileMapping reports failure as NULL rather than INVALID_HANDLE_VALUE
+struct FileHandle
+{
+    FileHandle(HANDLE handle, HANDLE invalid_value = INVALID_HANDLE_VALUE) : handle(handle)
+    {
+        throw_hresult_on_failure(handle == invalid_value ? last_win32_error() : S_OK);
+    }
+
+    FileHandle(FileHandle&& other) : handle(other.handle)
+    {
+        other.handle = nullptr;
+    }
+
+    ~FileHandle()
+    {
+        if (handle != nullptr && handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+    }
+
+    HANDLE handle;
+
+    private:
+        FileHandle(const FileHandle&);
+        FileHandle& operator=(const FileHandle&);
+};
+
+// WriteFile takes a DWORD so large writes go out in pieces
+void write_file_at(HANDLE file, unsigned long long offset, const void* data, size_t size);
 
 template<typename IType> CComPtr<IType> query_interface(IUnknown* p)
 {
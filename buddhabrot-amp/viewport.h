@@ -0,0 +1,114 @@
+#ifndef _VIEWPORT_H_
+#define _VIEWPORT_H_
+
+#include <cmath>
+
+#include <amp.h>
+
+#include "utilities.h"
+#include "double_float.h"
+
+// maps orbit points to canvas cells in float. the offset from the center is taken first so precision is spent on
+//  the visible region rather than on the distance of the region from the origin
+struct ViewportTransform
+{
+    // false (and pixel untouched) when z lands outside the canvas
+    bool to_pixel(const Complex<float>& z, concurrency::index<2>& pixel) const restrict(cpu, amp)
+    {
+        return offset_to_pixel(z.r - center_r, z.i - center_i, pixel);
+    }
+
+    // z in a wider type than float (double or DoubleFloat): the offset is taken against the full center in that type
+    //  & only narrowed afterwards, so viewports zoomed past float's resolution still tell neighbouring cells apart
+    template<typename T> bool to_pixel(const Complex<T>& z, concurrency::index<2>& pixel) const restrict(cpu, amp)
+    {
+        const auto dr = z.r - (T(center_r) + T(center_r_low));
+        const auto di = z.i - (T(center_i) + T(center_i_low));
+        return offset_to_pixel(float(dr), float(di), pixel);
+    }
+
+    // a perturbed orbit's point, its reference orbit's point (kept as DoubleFloat) plus a float delta. both are summed
+    //  against the center before narrowing, so points still close to their reference keep the delta's precision
+    bool to_pixel(const Complex<DoubleFloat>& reference, const Complex<float>& delta, concurrency::index<2>& pixel) const restrict(cpu, amp)
+    {
+        const auto dr = (reference.r - DoubleFloat(center_r, center_r_low)) + DoubleFloat(delta.r);
+        const auto di = (reference.i - DoubleFloat(center_i, center_i_low)) + DoubleFloat(delta.i);
+        return offset_to_pixel(float(dr), float(di), pixel);
+    }
+
+    // as above with the delta in DoubleFloat or double, for orbits whose delta grows too large for float to place
+    //  them within a cell
+    bool to_pixel(const Complex<DoubleFloat>& reference, const Complex<DoubleFloat>& delta, concurrency::index<2>& pixel) const restrict(cpu, amp)
+    {
+        const auto dr = (reference.r - DoubleFloat(center_r, center_r_low)) + delta.r;
+        const auto di = (reference.i - DoubleFloat(center_i, center_i_low)) + delta.i;
+        return offset_to_pixel(float(dr), float(di), pixel);
+    }
+
+    bool to_pixel(const Complex<DoubleFloat>& reference, const Complex<double>& delta, concurrency::index<2>& pixel) const restrict(cpu, amp)
+    {
+        const auto dr = ((double(reference.r.hi) - center_r) + (double(reference.r.lo) - center_r_low)) + delta.r;
+        const auto di = ((double(reference.i.hi) - center_i) + (double(reference.i.lo) - center_i_low)) + delta.i;
+        return offset_to_pixel(float(dr), float(di), pixel);
+    }
+
+    bool offset_to_pixel(float dr, float di, concurrency::index<2>& pixel) const restrict(cpu, amp)
+    {
+        const auto y = row_r * dr + row_i * di + half_height;
+        const auto x = col_r * dr + col_i * di + half_width;
+
+        // written so NaNs from diverged orbits fail as well
+        if (!(y >= 0.0f && y < height && x >= 0.0f && x < width)) return false;
+
+        pixel = concurrency::index<2>(int(y), int(x));
+        return true;
+    }
+
+    float center_r;
+    float center_i;
+    // what rounding the center to float dropped
+    float center_r_low;
+    float center_i_low;
+    float row_r;
+    float row_i;
+    float col_r;
+    float col_i;
+    float half_height;
+    float half_width;
+    float height;
+    float width;
+};
+
+// the canvas height covers span along the real axis (which runs down the rows), width follows from the canvas
+//  aspect with square cells; rotation is in radians about the center
+struct Viewport
+{
+    ViewportTransform transform(concurrency::extent<2> canvas) const
+    {
+        const auto cells_per_unit = canvas[0] / span;
+        const auto c = std::cos(rotation) * cells_per_unit;
+        const auto s = std::sin(rotation) * cells_per_unit;
+
+        auto t = ViewportTransform();
+        t.center_r = float(center_r);
+        t.center_i = float(center_i);
+        t.center_r_low = float(center_r - t.center_r);
+        t.center_i_low = float(center_i - t.center_i);
+        t.row_r = float(c);
+        t.row_i = float(s);
+        t.col_r = float(-s);
+        t.col_i = float(c);
+        t.half_height = canvas[0] / 2.0f;
+        t.half_width = canvas[1] / 2.0f;
+        t.height = float(canvas[0]);
+        t.width = float(canvas[1]);
+        return t;
+    }
+
+    double center_r{ 0.0 };
+    double center_i{ 0.0 };
+    double span{ 3.6 };
+    double rotation{ 0.0 };
+};
+
+#endif